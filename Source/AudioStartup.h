@@ -0,0 +1,225 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include "VirtualAudioDevice.h"
+
+#if JUCE_WINDOWS
+ // WASAPI enumeration needs COM on the calling thread (from ole32, which JUCE links)
+ extern "C" __declspec(dllimport) long __stdcall CoInitializeEx(void*, unsigned long);
+ extern "C" __declspec(dllimport) void __stdcall CoUninitialize();
+#endif
+
+// =========== StartupTrace ===========
+// Milliseconds since the application started, for tracking launch time:
+// window shown, first frame painted, device open, first audio callback.
+struct StartupTrace
+{
+    static double now() { return juce::Time::getMillisecondCounterHiRes(); }
+    static void   begin() { origin() = now(); }
+
+    static void mark(const char* what, double at = 0.0)
+    {
+        juce::ignoreUnused(what, at);
+        DBG("[Startup] " << what << ": " << juce::String((at > 0.0 ? at : now()) - origin(), 1) << " ms");
+    }
+
+private:
+    static double& origin() { static double t = now(); return t; }
+};
+
+// =========== AudioStartup ===========
+// Opens the audio device on a background thread so the window appears at
+// once; enumerating devices can take seconds (ALSA especially). The setup
+// that last opened is cached by the caller (see createCachedState) and tried
+// first, as-is. Only if it fails are the backends probed, best first:
+// WASAPI then DirectSound on Windows; on Linux JACK when a server is running,
+// else ALSA on the sound card itself (not the sound server's plugin, which
+// adds its own buffering), falling back to ALSA's default device. A backend
+// named in `preferredBackend` goes first. MIDI inputs are enabled on the
+// same thread. A device type of the caller's own (addDeviceType) joins the
+// built-in ones there too, as the built-in list is created by the first
+// device manager call.
+//
+// Until `onDone` has run on the message thread nothing else may touch the
+// device manager.
+class AudioStartup : private juce::Thread,
+                     private juce::AsyncUpdater
+{
+public:
+    enum class State { idle, opening, open, failed };
+
+    AudioStartup() : juce::Thread("Audio startup") {}
+    ~AudioStartup() override { waitUntilDone(); cancelPendingUpdate(); }
+
+    // ===== message thread =====
+    void start(juce::AudioDeviceManager& dm, int numOutputs, std::unique_ptr<juce::XmlElement> cachedState,
+               const juce::String& preferredBackend, std::function<void()> onDone)
+    {
+        jassert(state.load() == State::idle);
+        manager = &dm;
+        outputs = numOutputs;
+        preferred = preferredBackend;
+        cached = std::move(cachedState);
+        done = std::move(onDone);
+        state.store(State::opening);
+        startThread();
+    }
+
+    // Before start(); e.g. VirtualAudioDeviceType.
+    void addDeviceType(std::unique_ptr<juce::AudioIODeviceType> type) { extraType = std::move(type); }
+
+    // Blocks until the device is open (or has failed); opening can't be
+    // interrupted midway.
+    void waitUntilDone() { stopThread(15000); }
+
+    State getState() const { return state.load(); }
+    bool  isOpen() const { return state.load() == State::open; }
+    const juce::String& getError() const { return error; }   // once done
+    bool  usedCachedSetup() const { return fromCache; }
+
+    // What to cache for the next launch: the open device's type and setup,
+    // in AudioDeviceManager's own state format.
+    static std::unique_ptr<juce::XmlElement> createCachedState(juce::AudioDeviceManager& dm)
+    {
+        auto* dev = dm.getCurrentAudioDevice();
+        if (dev == nullptr || dev->getTypeName() == VirtualAudioDeviceType::typeName) return {};   // chosen by its setting every launch
+
+        const auto setup = dm.getAudioDeviceSetup();
+        auto xml = std::make_unique<juce::XmlElement>("DEVICESETUP");
+        xml->setAttribute("deviceType", dm.getCurrentAudioDeviceType());
+        xml->setAttribute("audioOutputDeviceName", setup.outputDeviceName);
+        xml->setAttribute("audioInputDeviceName", setup.inputDeviceName);
+        xml->setAttribute("audioDeviceRate", setup.sampleRate);
+        xml->setAttribute("audioDeviceBufferSize", setup.bufferSize);
+        if (!setup.useDefaultInputChannels)  xml->setAttribute("audioDeviceInChans", setup.inputChannels.toString(2));
+        if (!setup.useDefaultOutputChannels) xml->setAttribute("audioDeviceOutChans", setup.outputChannels.toString(2));
+        return xml;
+    }
+
+private:
+    void run() override
+    {
+        const auto t0 = StartupTrace::now();
+        juce::ignoreUnused(t0);
+       #if JUCE_WINDOWS
+        const bool com = CoInitializeEx(nullptr, 0x2 /* COINIT_APARTMENTTHREADED */) >= 0;
+       #endif
+
+        if (extraType != nullptr)
+        {
+            manager->getAvailableDeviceTypes();   // the built-in types first
+            manager->addAudioDeviceType(std::move(extraType));
+        }
+
+        if (cached != nullptr)
+        {
+            const auto err = manager->initialise(0, outputs, cached.get(), false);
+            fromCache = err.isEmpty() && manager->getCurrentAudioDevice() != nullptr;
+            if (!fromCache) DBG("[Audio] cached device failed: " << err);
+        }
+        if (!fromCache) probe();
+
+        for (const auto& d : juce::MidiInput::getAvailableDevices())
+            manager->setMidiInputDeviceEnabled(d.identifier, true);
+
+        if (manager->getCurrentAudioDevice() != nullptr)
+        {
+            DBG("[Audio] Device: " << manager->getCurrentAudioDevice()->getName() << "  SR=" << manager->getCurrentAudioDevice()->getCurrentSampleRate()
+                << (fromCache ? " (cached)" : "") << ", " << juce::String(StartupTrace::now() - t0, 1) << " ms");
+            state.store(State::open);
+        }
+        else
+        {
+            if (error.isEmpty()) error = "No audio device could be opened.";
+            state.store(State::failed);
+        }
+
+       #if JUCE_WINDOWS
+        if (com) CoUninitialize();
+       #endif
+        triggerAsyncUpdate();
+    }
+
+    static juce::StringArray backendOrder(const juce::String& preferredBackend)
+    {
+        juce::StringArray order;
+        if (preferredBackend.isNotEmpty()) order.add(preferredBackend);
+       #if JUCE_WINDOWS
+        order.addArray(juce::StringArray{ "Windows Audio", "DirectSound" });
+       #elif JUCE_LINUX || JUCE_BSD
+        order.addArray(juce::StringArray{ "JACK", "ALSA" });
+       #endif
+        order.removeDuplicates(true);
+        return order;
+    }
+
+    // ALSA lists the sound server's plugins next to the cards; the first
+    // name that isn't one of them is a card.
+    static juce::String hardwareOutput(const juce::String& typeName, const juce::StringArray& names)
+    {
+        if (!typeName.equalsIgnoreCase("ALSA")) return {};
+        for (const auto& n : names)
+            if (!(n.containsIgnoreCase("default") || n.containsIgnoreCase("pulse") || n.containsIgnoreCase("pipewire")
+                  || n.containsIgnoreCase("jack") || n.containsIgnoreCase("dmix") || n.containsIgnoreCase("sysdefault")))
+                return n;
+        return {};
+    }
+
+    bool opened() const { return manager->getCurrentAudioDevice() != nullptr; }
+
+    void probe()
+    {
+        manager->closeAudioDevice();
+        auto& types = manager->getAvailableDeviceTypes();
+
+        for (const auto& name : backendOrder(preferred))
+        {
+            juce::AudioIODeviceType* type = nullptr;
+            for (auto* t : types)
+                if (t && t->getTypeName().equalsIgnoreCase(name)) { type = t; break; }
+            if (type == nullptr) continue;
+
+            type->scanForDevices();
+            const auto outs = type->getDeviceNames(false);
+            if (outs.isEmpty()) continue;       // e.g. no JACK server running
+
+            manager->setCurrentAudioDeviceType(type->getTypeName(), true);
+            if (const auto hw = hardwareOutput(type->getTypeName(), outs); hw.isNotEmpty())
+            {
+                error = manager->initialise(0, outputs, nullptr, false, hw, nullptr);
+                if (opened()) return;
+                DBG("[Audio] " << hw << " is busy, using the default device: " << error);
+            }
+            error = manager->initialise(0, outputs, nullptr, true, {}, nullptr);
+            if (opened()) return;
+            DBG("[Audio] " << type->getTypeName() << " failed: " << error);
+        }
+
+        // anything that works
+        for (auto* t : types)
+        {
+            if (t == nullptr || t->getTypeName().isEmpty()) continue;
+            manager->setCurrentAudioDeviceType(t->getTypeName(), true);
+            error = manager->initialise(0, outputs, nullptr, true, {}, nullptr);
+            if (opened()) return;
+        }
+        if (types.isEmpty()) DBG("[Audio] No device types found!");
+    }
+
+    void handleAsyncUpdate() override
+    {
+        if (done) done();
+    }
+
+    juce::AudioDeviceManager*         manager = nullptr;
+    int                               outputs = 2;
+    std::unique_ptr<juce::XmlElement> cached;
+    std::unique_ptr<juce::AudioIODeviceType> extraType;
+    std::function<void()>             done;
+    juce::String                      preferred;
+
+    std::atomic<State> state{ State::idle };
+    juce::String       error;
+    bool               fromCache = false;
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// =========== BounceRecorder.h ===========
+// Records the final mix (all outputs, after the limiter) and optionally one
+// mono pre-fader stem per layer. The audio thread only pushes samples into
+// each file's ThreadedWriter FIFO; a background thread does the encoding and
+// disk I/O. If the disk falls behind, samples that don't fit are dropped and
+// counted as overruns instead of holding up the callback.
+class BounceRecorder
+{
+public:
+    enum class Format { wav, flac };
+
+    BounceRecorder() : writerThread("Tri-Beat recorder") {}
+    ~BounceRecorder() { stop(); }
+
+    // ===== message thread =====
+    // Stems are written next to the mix as <name>-layerN.<ext>.
+    bool start(const juce::File& file, Format format, double sampleRate, int numChannels, int numStems)
+    {
+        stop();
+        if (sampleRate <= 0.0 || numChannels <= 0) return false;
+
+        // FLAC tops out at 8 channels; wide multichannel mixes go to WAV
+        if (format == Format::flac && numChannels > 8) format = Format::wav;
+
+        const auto ext = format == Format::flac ? ".flac" : ".wav";
+        const auto mixFile = file.withFileExtension(ext);
+
+        auto newMix = createWriter(mixFile, format, sampleRate, numChannels);
+        if (newMix == nullptr) return false;
+
+        std::vector<std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter>> newStems;
+        for (int i = 0; i < numStems; ++i)
+        {
+            auto stemFile = mixFile.getSiblingFile(mixFile.getFileNameWithoutExtension() + "-layer" + juce::String(i + 1) + ext);
+            if (auto w = createWriter(stemFile, format, sampleRate, 1))
+                newStems.push_back(std::move(w));
+        }
+
+        writerThread.startThread();
+        overruns = 0;
+        written = 0;
+        channelPtrs.assign((size_t)numChannels, nullptr);
+
+        const juce::ScopedLock sl(writerLock);
+        mix = std::move(newMix);
+        stems = std::move(newStems);
+        mixChannels = numChannels;
+        numStemWriters = (int)stems.size();
+        active = true;
+        return true;
+    }
+
+    // Flushes whatever is still queued and closes the files.
+    void stop()
+    {
+        std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> oldMix;
+        std::vector<std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter>> oldStems;
+        {
+            const juce::ScopedLock sl(writerLock);
+            active = false;
+            numStemWriters = 0;
+            oldMix = std::move(mix);
+            oldStems = std::move(stems);
+            stems.clear();
+        }
+        oldMix.reset();
+        oldStems.clear();
+    }
+
+    bool isRecording() const { return active.load(); }
+    bool wantsStems() const { return active.load() && numStemWriters.load() > 0; }
+
+    juce::int64 getOverruns() const { return overruns.load(); }
+    double getSecondsWritten(double sampleRate) const { return sampleRate > 0.0 ? (double)written.load() / sampleRate : 0.0; }
+
+    // ===== audio thread =====
+    // Brackets one callback so the mix and the stems start and stop on the
+    // same sample. Never blocks: if the message thread is starting/stopping,
+    // the block is skipped and counted.
+    bool beginBlock()
+    {
+        if (!active.load()) return false;
+        if (!writerLock.tryEnter()) { overruns.fetch_add(1); return false; }
+        if (mix == nullptr) { writerLock.exit(); return false; }
+        return true;
+    }
+
+    void endBlock() { writerLock.exit(); }
+
+    // Between beginBlock()/endBlock() only.
+    void writeMix(const juce::AudioBuffer<float>& buf, int start, int n)
+    {
+        const int numCh = juce::jmin(mixChannels, buf.getNumChannels());
+        for (int ch = 0; ch < mixChannels; ++ch)
+            channelPtrs[(size_t)ch] = ch < numCh ? buf.getReadPointer(ch, start) : buf.getReadPointer(0, start);
+
+        if (!mix->write(channelPtrs.data(), n)) overruns.fetch_add(1);
+        else                                    written.fetch_add(n);
+    }
+
+    void writeStem(int index, const float* mono, int n)
+    {
+        if (!juce::isPositiveAndBelow(index, (int)stems.size())) return;
+        const float* chans[] = { mono };
+        if (!stems[(size_t)index]->write(chans, n)) overruns.fetch_add(1);
+    }
+
+private:
+    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> createWriter(const juce::File& f, Format format,
+                                                                          double sampleRate, int numChannels)
+    {
+        f.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream = f.createOutputStream();
+        if (stream == nullptr) return {};
+
+        juce::WavAudioFormat wav;
+        juce::FlacAudioFormat flac;
+        juce::AudioFormat& fmt = format == Format::flac ? static_cast<juce::AudioFormat&>(flac) : wav;
+
+        auto* writer = fmt.createWriterFor(stream.get(), sampleRate, (unsigned)numChannels, 24, {}, 0);
+        if (writer == nullptr) return {};
+        stream.release(); // owned by the writer now
+
+        // ~2 s of slack for disk stalls
+        return std::make_unique<juce::AudioFormatWriter::ThreadedWriter>(writer, writerThread, (int)(sampleRate * 2.0));
+    }
+
+    juce::TimeSliceThread writerThread;
+
+    juce::CriticalSection writerLock;   // only ever try-locked by the audio thread
+    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> mix;
+    std::vector<std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter>> stems;
+    std::vector<const float*> channelPtrs;
+    int mixChannels = 0;
+
+    std::atomic<bool>        active{ false };
+    std::atomic<int>         numStemWriters{ 0 };
+    std::atomic<juce::int64> overruns{ 0 }, written{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(BounceRecorder)
+};
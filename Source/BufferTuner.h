@@ -0,0 +1,173 @@
+#pragma once
+#include <JuceHeader.h>
+#include <algorithm>
+#include <functional>
+#include "LayerEngine.h"
+
+// =========== BufferTuner.h ===========
+// Finds the smallest buffer size the current device runs without dropouts
+// at the current load. Starting from the size in use it steps down through
+// the sizes the device offers, runs each for a couple of seconds and
+// watches the device's xrun count (AudioDeviceManager adds callbacks that
+// overran their buffer) and the engine's worst callback load. The first
+// size that fails ends the search and the last good one is kept; if the
+// starting size already fails it steps up instead.
+// Results are stored per device (type, output, rate) with the number of
+// layers they were measured with. Message thread only.
+class BufferTuner : private juce::Timer
+{
+public:
+    static constexpr int   settleMs = 300, trialMs = 2000;
+    static constexpr float maxPeakLoad = 0.7f;     // of the block duration
+
+    struct Result
+    {
+        int bufferSize = 0;
+        int layers = 0;
+    };
+
+    ~BufferTuner() override { cancel(); }
+
+    void start(juce::AudioDeviceManager& dm, LayerEngine& e, int numLayers, std::function<void(const Result&)> onDone)
+    {
+        cancel();
+        auto* dev = dm.getCurrentAudioDevice();
+        if (dev == nullptr) return;
+
+        sizes.clear();
+        for (int s : dev->getAvailableBufferSizes())
+            if (s >= 16) sizes.push_back(s);
+        if (sizes.empty()) return;
+        std::sort(sizes.begin(), sizes.end());
+
+        manager = &dm; engine = &e; layers = numLayers; done = std::move(onDone);
+
+        const int current = dev->getCurrentBufferSizeSamples();
+        startIndex = (int)(std::lower_bound(sizes.begin(), sizes.end(), current) - sizes.begin());
+        startIndex = juce::jmin(startIndex, (int)sizes.size() - 1);
+        index = startIndex; best = -1; goingDown = true;
+
+        engine->setMeasuringLoad(true);
+        trySize();
+        startTimer(100);
+    }
+
+    void cancel()
+    {
+        if (!isTimerRunning()) return;
+        stopTimer();
+        engine->setMeasuringLoad(false);
+    }
+
+    bool isRunning() const { return isTimerRunning(); }
+
+    juce::String getStatus() const
+    {
+        if (!isRunning()) return {};
+        const double sr = juce::jmax(1.0, manager->getAudioDeviceSetup().sampleRate);
+        return "Tuning buffer: " + juce::String(sizes[(size_t)index]) + " samples ("
+             + juce::String(1000.0 * sizes[(size_t)index] / sr, 1) + " ms)...";
+    }
+
+    // ===== per-device results =====
+    static juce::String deviceKey(juce::AudioDeviceManager& dm)
+    {
+        const auto setup = dm.getAudioDeviceSetup();
+        return dm.getCurrentAudioDeviceType() + "|" + setup.outputDeviceName + "|" + juce::String((int)setup.sampleRate);
+    }
+
+    static Result load(const juce::PropertySet& settings, const juce::String& key)
+    {
+        Result r;
+        if (auto xml = settings.getXmlValue("bufferTuning"))
+            if (auto* d = xml->getChildByAttribute("key", key))
+            {
+                r.bufferSize = d->getIntAttribute("bufferSize");
+                r.layers = d->getIntAttribute("layers");
+            }
+        return r;
+    }
+
+    static void save(juce::PropertySet& settings, const juce::String& key, const Result& r)
+    {
+        auto xml = settings.getXmlValue("bufferTuning");
+        if (xml == nullptr) xml = std::make_unique<juce::XmlElement>("BufferTuning");
+
+        auto* d = xml->getChildByAttribute("key", key);
+        if (d == nullptr) { d = xml->createNewChildElement("Device"); d->setAttribute("key", key); }
+        d->setAttribute("bufferSize", r.bufferSize);
+        d->setAttribute("layers", r.layers);
+        settings.setValue("bufferTuning", xml.get());
+    }
+
+private:
+    void trySize()
+    {
+        auto setup = manager->getAudioDeviceSetup();
+        setup.bufferSize = sizes[(size_t)index];
+        manager->setAudioDeviceSetup(setup, true);
+
+        phaseStart = juce::Time::getMillisecondCounter();
+        measuring = false;
+    }
+
+    void timerCallback() override
+    {
+        if (manager->getCurrentAudioDevice() == nullptr) { cancel(); return; }
+
+        const auto elapsed = juce::Time::getMillisecondCounter() - phaseStart;
+        if (!measuring)
+        {
+            if (elapsed < (juce::uint32)settleMs) return;
+            // the device restarts on a size change; only count from here
+            measuring = true;
+            phaseStart = juce::Time::getMillisecondCounter();
+            xrunsAtStart = manager->getXRunCount();
+            engine->takePeakLoad();
+            return;
+        }
+        if (elapsed < (juce::uint32)trialMs) return;
+
+        const int   xruns = manager->getXRunCount() - xrunsAtStart;
+        const float peak = engine->takePeakLoad();
+        const bool  stable = xruns == 0 && peak < maxPeakLoad;
+        DBG("[Tune] " << sizes[(size_t)index] << " samples: " << xruns << " xrun(s), peak load " << juce::String(peak, 2)
+            << (stable ? " ok" : " FAIL"));
+
+        if (goingDown)
+        {
+            if (stable) best = index;
+            if (stable && index > 0)     { --index; trySize(); return; }
+            if (best >= 0)               { finish(best); return; }
+
+            goingDown = false;      // the size we started at isn't stable either
+            index = startIndex;
+        }
+        else if (stable)
+        {
+            finish(index);
+            return;
+        }
+
+        if (index + 1 < (int)sizes.size()) { ++index; trySize(); }
+        else                               finish(index);
+    }
+
+    void finish(int i)
+    {
+        index = i;
+        if (manager->getAudioDeviceSetup().bufferSize != sizes[(size_t)i]) trySize();
+        cancel();
+        if (done) done({ sizes[(size_t)i], layers });
+    }
+
+    juce::AudioDeviceManager* manager = nullptr;
+    LayerEngine*              engine = nullptr;
+    std::function<void(const Result&)> done;
+
+    std::vector<int> sizes;
+    int  layers = 0, startIndex = 0, index = 0, best = -1;
+    bool goingDown = true, measuring = false;
+    juce::uint32 phaseStart = 0;
+    int  xrunsAtStart = 0;
+};
@@ -0,0 +1,543 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include "VoicePool.h"
+
+// --- TriggerSink: gets every step the render loops fire (audio thread, must not block) ---
+struct TriggerSink
+{
+    enum Role { Downbeat, Upbeat, Subdivision, MetronomeDown, MetronomeUp };
+
+    virtual ~TriggerSink() = default;
+    virtual void trigger(int sampleOffset, int layer, Role role, float gain) = 0;
+};
+
+// --- MetronomeSource: 4/4  play/stop/seek ---
+struct MetronomeSource : public juce::AudioSource
+{
+    // timing
+    double  sampleRate = 48000.0;
+    double  bpm = 120.0;
+    double  samplesPerBeat = 48000.0 * 60.0 / 120.0;
+    int     beatsPerBar = 4;
+
+    // transport
+    int64_t transportSamples = 0;
+    int64_t lastBeatIndex = -1;
+    std::atomic<bool> playing{ true };   // read by the message thread
+
+    // trigger output (MIDI etc.)
+    TriggerSink* sink = nullptr;
+
+    // output routing: first device channel and 1 (mono) or 2 (pair); set
+    // from the message thread while playing
+    std::atomic<int> outChannel{ 0 }, outWidth{ 2 };
+
+    // level and constant-power pan (-1..1), likewise; mixGain is the engine's ramp state
+    std::atomic<float> outGain{ 1.0f }, outPan{ 0.0f };
+    float mixGain[2] = { -1.0f, -1.0f };
+
+    // tiny click synth
+    struct ClickSynth {
+        double sr = 48000.0, freq = 1200.0, phase = 0.0, inc = 0.0, env = 0.0, decay = 0.995;
+        float  gain = 1.0f;
+        void prepare(double s) { sr = s; setFreq(freq); env = 0.0; }
+        void setFreq(double f) { freq = f; inc = juce::MathConstants<double>::twoPi * freq / sr; }
+        void trigger(float g) { env = 1.0; gain = g; }
+        float next() {
+            float s = (float)std::sin(phase) * (float)env * gain;
+            phase += inc; if (phase >= juce::MathConstants<double>::twoPi) phase -= juce::MathConstants<double>::twoPi;
+            env *= decay; if (env < 1.0e-4) env = 0.0; return s;
+        }
+    } click;
+
+    // tones
+    double downHz = 1000.0, upHz = 1500.0;
+    float  downGain = 1.0f, upGain = 0.9f;
+
+    // API
+    void setTempo(double b) { bpm = b; samplesPerBeat = sampleRate * 60.0 / juce::jmax(1.0, b); }
+    void setBeatsPerBar(int n) { beatsPerBar = juce::jlimit(1, 64, n); }
+    void setPlaying(bool b) { playing = b; }
+    bool isPlaying() const { return playing; }
+    void resetTransport() { transportSamples = 0; lastBeatIndex = -1; }
+    void seekToSample(int64_t t)
+    {
+        transportSamples = juce::jmax<int64_t>(0, t);
+        lastBeatIndex = (transportSamples == 0 || samplesPerBeat <= 0.0) ? -1
+                      : (int64_t)std::floor((double)(transportSamples - 1) / samplesPerBeat);
+    }
+
+    // AudioSource
+    void prepareToPlay(int /*block*/, double sr) override
+    {
+        sampleRate = sr; setTempo(bpm); click.prepare(sr); lastBeatIndex = -1;
+    }
+
+    void releaseResources() override {}
+
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
+    {
+        auto* buffer = info.buffer; if (!buffer) return;
+
+        if (!render(buffer->getWritePointer(0, info.startSample), info.numSamples, info.startSample))
+        {
+            buffer->clear(info.startSample, info.numSamples);
+            return;
+        }
+        for (int ch = 1; ch < buffer->getNumChannels(); ++ch)
+            buffer->copyFrom(ch, info.startSample, *buffer, 0, info.startSample, info.numSamples);
+    }
+
+    // Writes n mono samples to out; returns false (out untouched) when stopped.
+    // sinkOffset is added to the sample offsets reported to the sink.
+    bool render(float* out, int n, int sinkOffset = 0)
+    {
+        if (!playing) return false;
+
+        for (int i = 0;i < n;++i)
+        {
+            const int64_t beatIdx = (samplesPerBeat > 0.0 ? (int64_t)std::floor((double)transportSamples / samplesPerBeat) : 0);
+            if (beatIdx != lastBeatIndex)
+            {
+                lastBeatIndex = beatIdx;
+                const int which = (int)(beatIdx % (int64_t)juce::jmax(1, beatsPerBar));
+                const bool isDown = (which == 0);
+                click.setFreq(isDown ? downHz : upHz);
+                click.trigger(isDown ? downGain : upGain);
+                if (sink) sink->trigger(sinkOffset + i, -1, isDown ? TriggerSink::MetronomeDown : TriggerSink::MetronomeUp,
+                                        isDown ? downGain : upGain);
+            }
+            out[i] = click.next();
+            ++transportSamples;
+        }
+        return true;
+    }
+};
+
+
+
+struct ClickSynth
+{
+    void prepare (double sr)
+    {
+        sampleRate = sr;
+        phase = 0.0;
+        env = 0.0;
+        setFrequency (clickFreqHz);
+    }
+
+    void setFrequency (double hz)
+    {
+        clickFreqHz = hz;
+        phaseInc = juce::MathConstants<double>::twoPi * clickFreqHz / sampleRate;
+    }
+
+    void trigger (float gain = 1.0f)   
+    {
+        env = 1.0;
+        hitGain = juce::jlimit (0.0f, 4.0f, gain);
+    }
+
+    inline float getNextSample()
+    {
+        float s = (float) std::sin (phase) * (float) env;
+        phase += phaseInc;
+        if (phase >= juce::MathConstants<double>::twoPi)
+            phase -= juce::MathConstants<double>::twoPi;
+
+        env *= envDecay;
+        if (env < 1.0e-4) env = 0.0;
+
+        return s * baseGain * hitGain;  
+    }
+
+    double sampleRate = 48000.0;
+    double clickFreqHz = 1400.0;
+    double phase = 0.0, phaseInc = 0.0;
+    double env = 0.0, envDecay = 0.995;
+    float  baseGain = 0.25f;      
+    float  hitGain  = 1.0f;      
+};
+
+
+
+// =========== ClickAudioSource.h ===========
+struct ClickAudioSource : public juce::AudioSource
+{
+    // ===== timing & mode =====
+    double sampleRate = 48000.0, bpm = 120.0, samplesPerBeat = 48000.0 * 60.0 / 120.0;
+    int64_t transportSamples = 0;
+    bool    polyrhythm = true;
+    int     subdivisions = 3;     
+    int     beatsPerBar = 3;       
+    int     hostBeatsPerBar = 4;   
+
+    // ===== state =====
+    // Step k of a polyrhythm fires on sample ceil(k * stepLength), the first
+    // sample at or after its exact time, as the metronome's beats do: each
+    // step's rounding (stepError, in samples) is taken off the next one, so
+    // layers never drift however long they play. stepSamps is the longest
+    // a step can be.
+    int64_t stepSamps = 1, stepCountdown = 1;
+    double  stepLength = 1.0, stepError = 0.0;
+    int     stepIndex = -1;
+    int64_t lastBeatIndex = -1;
+    std::atomic<bool> playing{ true };   // read by the message thread
+
+    // ===== accents =====
+    int upIndex = -1, downIndex = -1;
+
+    // ===== trigger output (MIDI etc.) =====
+    TriggerSink* sink = nullptr;
+    int          sinkLayer = 0;
+
+    // ===== output routing: first device channel, 1 (mono) or 2 (pair) =====
+    // Routing, mix, tones and the subdivision mute are set from the message
+    // thread while the layer plays, so they are atomics.
+    std::atomic<int> outChannel{ 0 }, outWidth{ 2 };
+
+    // ===== mix: level and constant-power pan (-1..1) =====
+    std::atomic<float> outGain{ 1.0f }, outPan{ 0.0f };
+    float mixGain[2] = { -1.0f, -1.0f };   // last gains applied by the engine
+
+    // Gains of the pool hits in the chunk being rendered, set by the engine
+    // to follow the ramp it mixes this layer's own line with (level/pan
+    // changes, the preset fade-in): hitFrom at the chunk's first sample to
+    // hitTo after hitLength samples. hitLength 0 = outGain/outPan as they are.
+    float hitFrom[2] = { 1.0f, 1.0f }, hitTo[2] = { 1.0f, 1.0f };
+    int   hitLength = 0;
+    float hitGain[2] = { -1.0f, -1.0f };   // the engine's ramp state, like mixGain
+
+    // ===== tiny click synth (fallback) =====
+    struct ClickSynth {
+        double sr = 48000.0, freq = 1200.0, phase = 0.0, inc = 0.0, env = 0.0, decay = 0.995;
+        float  outGain = 1.0f;
+        void prepare(double s) { sr = s; setFreq(freq); env = 0.0; }
+        void setFreq(double f) { freq = f; inc = juce::MathConstants<double>::twoPi * freq / sr; }
+        void trigger(float g) { env = 1.0; outGain = g; }
+        float next() {
+            float s = (float)std::sin(phase) * (float)env * outGain;
+            phase += inc; if (phase >= juce::MathConstants<double>::twoPi) phase -= juce::MathConstants<double>::twoPi;
+            env *= decay; if (env < 1.0e-4) env = 0.0; return s;
+        }
+    } click;
+
+    // ===== one-shot drum =====
+    // Buffers are shared between layers that use the same file(s), which is
+    // what lets the VoicePool merge their hits. A buffer may hold velocity
+    // layers and round-robin takes; each hit picks one (see SampleBuffer).
+    using SampleData = SampleBuffer::Ptr;
+
+    // hit gain -> sample velocity layer (the loudest role gain is 1.2)
+    static float hitVelocity(float g) { return juce::jlimit(0.0f, 1.0f, g / 1.2f); }
+
+    struct OneShot
+    {
+        SampleData data;     // what plays: `source`, or a repitched copy of it
+        SampleData source;   // as loaded
+        int   pos = 0, end = 0;
+        float gain = 1.0f;
+        bool  active = false;
+        juce::uint32 roundRobin = 0;
+        VoicePool::Handle handle;   // share in a pool voice, if any
+
+        void setSample(SampleData buf, SampleData original = {})
+        {
+            data = (buf != nullptr && buf->getNumSamples() > 0) ? std::move(buf) : nullptr;
+            source = data != nullptr ? (original != nullptr ? std::move(original) : data) : nullptr;
+            pos = end = 0; active = false; roundRobin = 0;
+        }
+        void setSample(const juce::AudioBuffer<float>& buf, const SampleBuffer::Options& opts = {})
+        {
+            setSample(SampleBuffer::create(buf, opts));
+        }
+        void clear() { data.reset(); source.reset(); pos = end = 0; active = false; }
+
+        bool hasSample() const { return data != nullptr; }
+
+        // next take for this hit
+        const SampleBuffer::Zone& select(float g) { return data->select(hitVelocity(g), roundRobin); }
+
+        void trigger(float g)
+        {
+            if (!hasSample()) return;
+            const auto& z = select(g);
+            gain = g; pos = z.start; end = z.start + z.length; active = true;
+        }
+        float next()
+        {
+            if (!active || !hasSample()) return 0.0f;
+            if (pos >= end) { active = false; return 0.0f; }
+            const float s = data->getSample(pos++);
+            return s * gain;
+        }
+        bool isActive() const { return active; }
+    };
+
+    // Shared sample voices (set by the engine); without one each one-shot
+    // plays itself as before.
+    VoicePool* pool = nullptr;
+    VoicePool::Deferred* deferredPool = nullptr;   // while rendering on a worker: record instead
+
+    // Takes this layer's shares out of the pool (layer removed or switched out).
+    void releasePoolVoices(VoicePool& p)
+    {
+        p.release(kick.handle); p.release(snare.handle); p.release(hihat.handle);
+    }
+
+    OneShot kick, snare, hihat;
+    std::atomic<bool> muteSubdivisions{ false };
+
+    // ===== tones =====
+    std::atomic<double> normalFreqHz{ 1200.0 }, upFreqHz{ 880.0 }, downFreqHz{ 440.0 };
+    float  normalGain = 0.7f, upGain = 1.0f, downGain = 1.2f;
+
+    // ===== API =====
+    // Steps per cycle (sides), in either mode. Nothing is sized by it: a
+    // step is a countdown and an index, so a block costs the same at 256.
+    static constexpr int maxSteps = 256;
+
+    void  setTempo(double newBpm) { bpm = newBpm; samplesPerBeat = sampleRate * 60.0 / juce::jmax(1.0, newBpm); recalcStep(); }
+    void  setPolyrhythm(bool b) { polyrhythm = b; recalcStep(); }
+    void  setSubdivisions(int n) { subdivisions = juce::jlimit(1, maxSteps, n); recalcStep(); }
+    void  setBeatsPerBar(int n) { beatsPerBar = juce::jlimit(1, maxSteps, n); }
+    void  setHostBeatsPerBar(int n) { hostBeatsPerBar = juce::jlimit(1, 64, n); recalcStep(); }
+    void  setUpbeatIndex(int idx) { upIndex = (idx >= 0 ? idx % juce::jmax(1, currentCount()) : -1); }
+    void  setDownbeatIndex(int idx) { downIndex = (idx >= 0 ? idx % juce::jmax(1, currentCount()) : -1); }
+    // Accent samples follow the note selectors too: at the default notes
+    // (A4 up, A3 down) they play as recorded. role: 0 kick, 1 snare, 2 hihat.
+    static constexpr double upRootHz = 440.0, downRootHz = 220.0;
+    double getSampleSemitones(int role) const
+    {
+        if (role == 0) return 12.0 * std::log2(juce::jmax(1.0, upFreqHz.load()) / upRootHz);
+        if (role == 1) return 12.0 * std::log2(juce::jmax(1.0, downFreqHz.load()) / downRootHz);
+        return 0.0;
+    }
+    OneShot& getOneShot(int role) { return role == 0 ? kick : role == 1 ? snare : hihat; }
+
+    void  setUpbeatFreqHz(double f) { upFreqHz = f; }
+    void  setDownbeatFreqHz(double f) { downFreqHz = f; }
+    void  setNormalFreqHz(double f) { normalFreqHz = f; }
+    void  setMuteSubdivisions(bool m) { muteSubdivisions = m; }
+
+    void  setPlaying(bool b) { playing = b; }
+    bool  isPlaying() const { return playing; }
+
+    void restart() { transportSamples = 0; stepIndex = -1; lastBeatIndex = -1; recalcStep(); stepCountdown = 1; stepError = 0.0; }
+    void resetTransport() { restart(); }
+    void setTransportSamples(int64_t s) { transportSamples = s; if (s == 0) { stepIndex = -1; lastBeatIndex = -1; recalcStep(); stepCountdown = 1; stepError = 0.0; } }
+    int64_t getTransportSamples() const { return transportSamples; }
+    // samples between steps (polyrhythm) or beats; consecutive triggers are
+    // never closer than its floor
+    double  getStepLength() const { return stepLength; }
+
+    // Jump to any transport position with the step grid already in place,
+    // so the next step fires exactly where it would have (external sync).
+    void seekToSample(int64_t t)
+    {
+        recalcStep();
+        transportSamples = juce::jmax<int64_t>(0, t);
+        const int64_t prev = transportSamples - 1;
+
+        if (polyrhythm)
+        {
+            const int64_t last = (prev < 0 ? -1 : (int64_t)std::floor((double)prev / stepLength));
+            stepIndex = (last < 0 ? -1 : (int)(last % (int64_t)juce::jmax(1, subdivisions)));
+            const double  due = (double)(last + 1) * stepLength;
+            const int64_t next = stepStart(due);
+            stepCountdown = next - transportSamples + 1;
+            stepError = (double)next - due;
+        }
+        else
+        {
+            lastBeatIndex = (prev < 0 || samplesPerBeat <= 0.0) ? -1 : (int64_t)std::floor((double)prev / samplesPerBeat);
+        }
+    }
+
+    // The step (vertex) scheduled nearest to transport position t, and how
+    // far t is from it in samples (positive = after the step).
+    int nearestStep(double t, double& offsetSamples) const
+    {
+        const double len = polyrhythm ? stepLength : samplesPerBeat;
+        if (len <= 0.0) { offsetSamples = 0.0; return -1; }
+
+        const double k = std::round(t / len);
+        offsetSamples = t - k * len;
+        const int64_t count = juce::jmax(1, currentCount());
+        return (int)((((int64_t)k % count) + count) % count);
+    }
+
+    double getPhase01() const
+    {
+        if (sampleRate <= 0.0 || bpm <= 0.0) return 0.0;
+        const double spb = sampleRate * (60.0 / bpm);
+        const int    barN = polyrhythm ? hostBeatsPerBar : beatsPerBar; //Measure the bar length
+        const double spbar = spb * (double)juce::jmax(1, barN);
+        if (spbar <= 0.0) return 0.0;
+        return std::fmod((double)transportSamples / spbar, 1.0);
+    }
+    double getVisualLapPhase01() const { return getPhase01(); }
+
+    // ===== AudioSource =====
+    void prepareToPlay(int /*block*/, double sr) override
+    {
+        sampleRate = sr; setTempo(bpm); click.prepare(sr);
+        recalcStep(); stepIndex = -1; stepCountdown = 1; stepError = 0.0; lastBeatIndex = -1;
+    }
+    void releaseResources() override {}
+
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
+    {
+        auto* buffer = info.buffer; if (!buffer) return;
+
+        if (!render(buffer->getWritePointer(0, info.startSample), info.numSamples, info.startSample))
+        {
+            buffer->clear(info.startSample, info.numSamples);
+            return;
+        }
+        for (int ch = 1; ch < buffer->getNumChannels(); ++ch)
+            buffer->copyFrom(ch, info.startSample, *buffer, 0, info.startSample, info.numSamples);
+    }
+
+    // Writes n mono samples to out; returns false (out untouched) when stopped.
+    // sinkOffset is added to the sample offsets reported to the sink.
+    bool render(float* out, int n, int sinkOffset = 0)
+    {
+        if (!playing) return false;
+
+        if (polyrhythm)
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                if (--stepCountdown <= 0)
+                {
+
+                  
+                    const double  want = stepLength - stepError;
+                    const int64_t len = juce::jmax<int64_t>(1, stepStart(want));
+                    stepError = (double)len - want;
+                    stepCountdown += len;
+                    stepIndex = (stepIndex + 1) % juce::jmax(1, subdivisions); 
+
+                   
+                    const bool isDown = (downIndex >= 0 && stepIndex == downIndex);
+                    const bool isUp = (upIndex >= 0 && stepIndex == upIndex);
+                    const bool isSub = (!isDown && !isUp);
+
+                    if (sink && !(isSub && muteSubdivisions))
+                        sink->trigger(sinkOffset + i, sinkLayer,
+                                      isDown ? TriggerSink::Downbeat : isUp ? TriggerSink::Upbeat : TriggerSink::Subdivision,
+                                      isDown ? downGain : isUp ? upGain : normalGain);
+
+                    bool usedSample = false;
+
+                    if (isDown)
+                    {
+                        if (snare.hasSample()) { fire(snare, i, downGain); usedSample = true; }
+                    }
+                    else if (isUp)
+                    {
+                        if (kick.hasSample()) { fire(kick, i, upGain);    usedSample = true; }
+                    }
+                    else // subdivision
+                    {
+                        if (!muteSubdivisions)
+                        {
+                            if (hihat.hasSample()) { fire(hihat, i, normalGain); usedSample = true; }
+                        }
+                    }
+
+                  
+                    if (!usedSample)
+                    {
+                        if (!(isSub && muteSubdivisions))
+                        {
+                            double f = normalFreqHz; float g = normalGain;
+                            if (isDown) { f = downFreqHz; g = downGain; }
+                            else if (isUp) { f = upFreqHz; g = upGain; }
+                            click.setFreq(f); click.trigger(g);
+                        }
+                    }
+
+                }
+
+                const float drums = kick.next() + snare.next() + hihat.next();
+                const float tone = click.next();
+                out[i] = drums + tone;
+                ++transportSamples;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                const int64_t beatIdx = (samplesPerBeat > 0.0 ? (int64_t)std::floor((double)transportSamples / samplesPerBeat) : 0);
+                if (beatIdx != lastBeatIndex)
+                {
+                    lastBeatIndex = beatIdx;
+                    const int whichInBar = (int)(beatIdx % (int64_t)juce::jmax(1, beatsPerBar));
+                    const bool isDown = (downIndex >= 0 && whichInBar == downIndex);
+                    const bool isUp = (upIndex >= 0 && whichInBar == upIndex);
+
+                    if (!muteSubdivisions || isDown || isUp)
+                    {
+                        double f = normalFreqHz; float g = normalGain;
+                        if (isDown) { f = downFreqHz; g = downGain; }
+                        else if (isUp) { f = upFreqHz; g = upGain; }
+                        click.setFreq(f); click.trigger(g);
+                        if (sink)
+                            sink->trigger(sinkOffset + i, sinkLayer,
+                                          isDown ? TriggerSink::Downbeat : isUp ? TriggerSink::Upbeat : TriggerSink::Subdivision, g);
+                    }
+                }
+
+                out[i] = kick.next() + snare.next() + hihat.next() + click.next();
+                ++transportSamples;
+            }
+        }
+        return true;
+    }
+
+private:
+    void fire(OneShot& shot, int offset, float g)
+    {
+        if (pool == nullptr) { shot.trigger(g); return; }
+
+        float gains[2];
+        if (hitLength > 0)
+        {
+            const float t = (float)offset / (float)hitLength;
+            for (int c = 0; c < 2; ++c) gains[c] = g * (hitFrom[c] + (hitTo[c] - hitFrom[c]) * t);
+        }
+        else
+        {
+            routeGains(outGain * g, outPan, outWidth, gains);
+        }
+        shot.active = false;
+        if (deferredPool) deferredPool->add(shot.handle, offset, shot.data.get(), shot.select(g), outChannel, outWidth, gains);
+        else pool->trigger(shot.handle, offset, shot.data.get(), shot.select(g), outChannel, outWidth, gains);
+    }
+
+    // first sample at or after t (a hair of slack for t that should be whole)
+    static int64_t stepStart(double t) { return (int64_t)std::ceil(t - 1.0e-7); }
+
+    void recalcStep()
+    {
+        if (samplesPerBeat <= 0.0) { stepSamps = 1; stepLength = 1.0; stepCountdown = 1; stepError = 0.0; return; }
+        if (polyrhythm)
+        {
+            const double samplesPerBar = samplesPerBeat * (double)juce::jmax(1, hostBeatsPerBar);
+            stepLength = juce::jmax(1.0, samplesPerBar / (double)juce::jmax(1, subdivisions));
+        }
+        else
+        {
+            stepLength = juce::jmax(1.0, samplesPerBeat);
+        }
+        stepSamps = juce::jmax<int64_t>(1, stepStart(stepLength));
+        if (stepCountdown <= 0 || stepCountdown > stepSamps) { stepCountdown = stepSamps; stepError = 0.0; }
+        stepError = juce::jlimit(0.0, 1.0, stepError);
+    }
+    int currentCount() const { return polyrhythm ? subdivisions : beatsPerBar; }
+};
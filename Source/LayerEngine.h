@@ -0,0 +1,829 @@
+#pragma once
+#include <JuceHeader.h>
+#include "ClickAudioSource.h"
+#include "PresetBank.h"
+#include "MidiTriggerOutput.h"
+#include "MidiClockFollower.h"
+#include "MasterLimiter.h"
+#include "VoicePool.h"
+#include "BounceRecorder.h"
+#include "PracticeMonitor.h"
+#include "ParallelRenderer.h"
+#include "RealtimeGuard.h"
+#include "RtCheck.h"
+
+// =========== LayerEngine.h ===========
+// Renders the metronome and every live layer into the device buffer.
+// Takes the place of MixerAudioSource so that a preset switch can swap the
+// whole layer set on the audio thread, exactly on a bar line, without
+// adding/removing mixer inputs or allocating.
+// Each source renders one mono line which is added straight into the
+// device channels it is routed to (outChannel/outWidth); there is no
+// intermediate stereo bus, so any number of outputs costs the same.
+// Level/pan and fades are applied while adding (vector ops), then the
+// master gain and look-ahead limiter run over all outputs. Sample hits of
+// the live layers go through a shared VoicePool that merges coincident ones.
+// An attached BounceRecorder gets the finished mix (and per-layer stems);
+// an attached PracticeMonitor sees the device input before it is cleared.
+// With render threads set and enough layers, the layers render on a
+// ParallelRenderer into lines of their own; MIDI and pool triggers are
+// recorded per layer, and the audio thread then replays and mixes them in
+// layer order, so the output is the same as rendering serially.
+// In realtimeMode (RealtimeGuard) the buffers are locked and prefaulted in
+// prepareToPlay and the callback thread asks for real-time priority.
+// The message thread never locks the callback: scalar parameters are
+// atomics, and anything structural is posted as a change that the next
+// block runs before it renders (see post()).
+class LayerEngine : public juce::AudioSource
+{
+public:
+    static constexpr int maxLayers = 256;
+    static constexpr int maxOutputs = 64;
+
+    LayerEngine()
+    {
+        live.reserve((size_t)maxLayers);
+        outgoing.reserve((size_t)maxLayers);
+    }
+
+    // ===== message thread: changes =====
+    // Whatever the audio thread reads that isn't an atomic (the layer list,
+    // a layer's tempo, shape, accents and transport, its samples, the
+    // metronome's transport) changes only on the audio thread: post() queues
+    // a change and the next block runs it before rendering anything, in the
+    // order they were posted, so no block sees a layer half-changed and the
+    // callback never waits for the message thread. Before prepareToPlay (no
+    // device running) a change runs at once. A change may not allocate or
+    // free: what it swaps out stays in its captures, which are destroyed on
+    // the message thread, at the next post() after it has run.
+    // Level, pan, routing, tones and the subdivision mute are atomics on the
+    // sources and are set directly.
+    using Change = juce::FixedSizeFunction<64, void()>;
+    static constexpr int maxPendingChanges = 1024;
+
+    void post(Change change)
+    {
+        for (;;)
+        {
+            {
+                const juce::ScopedLock sl(lock);
+                if (!prepared) { change(); return; }
+
+                recycleChanges();
+                if (changeFifo.getFreeSpace() > 0)
+                {
+                    changeFifo.write(1).forEach([&](int i) { changes[(size_t)i] = std::move(change); });
+                    ++unrecycledChanges;
+                    return;
+                }
+            }
+            juce::Thread::sleep(1);   // full: the next block empties it
+        }
+    }
+
+    // Inside a change (audio thread): fn(layer) for every live layer.
+    template <typename Fn>
+    void forEachLayer(Fn&& fn) { for (auto* v : live) fn(*v); }
+
+    void setMetronome(MetronomeSource* m) { post([this, m] { metronome = m; }); }
+    void setPresetBank(PresetBank* b) { post([this, b] { bank = b; }); }
+    void setMidiOutput(MidiTriggerOutput* m) { post([this, m] { midi = m; }); }
+    void setClockFollower(MidiClockFollower* f) { post([this, f] { follower = f; }); }
+    void setRecorder(BounceRecorder* r) { post([this, r] { recorder = r; }); }
+    void setPracticeMonitor(PracticeMonitor* p)
+    {
+        {
+            const juce::ScopedLock sl(lock);
+            if (p && prepared) p->prepare(sampleRate, blockSize);
+        }
+        post([this, p] { practice = p; });
+    }
+
+    // Worst callback load (render time / block duration) since the last call,
+    // while measuring is on. For the buffer tuner; off it costs nothing.
+    void  setMeasuringLoad(bool b) { peakLoad.store(0.0f); measuringLoad.store(b); }
+    float takePeakLoad() { return peakLoad.exchange(0.0f); }
+
+    // Millisecond counter at the first rendered block, 0 before (startup trace).
+    double getFirstBlockTime() const { return firstBlockTime.load(std::memory_order_relaxed); }
+
+    // Renders the layers on `threads` real-time workers (plus the audio
+    // thread) whenever at least `minLayers` are live; below that, or with 0
+    // threads, everything renders on the audio thread as before. The new
+    // workers and lines are set up here and swapped in by a change; the old
+    // ones stop with it.
+    void setRenderThreads(int threads, int minLayers = 32)
+    {
+        threads = juce::jlimit(0, 15, threads);
+        minLayers = juce::jmax(2, minLayers);
+        if (threads == requestedThreads && minLayers == requestedMinLayers) return;
+        requestedThreads = threads;
+        requestedMinLayers = minLayers;
+
+        auto next = std::make_shared<RenderSetup>();
+        next->threads = threads;
+        next->minLayers = minLayers;
+        if (threads > 0)
+        {
+            int lineLength = 0;
+            {
+                const juce::ScopedLock sl(lock);
+                lineLength = blockSize;
+            }
+            next->workers = std::make_unique<ParallelRenderer>();
+            next->workers->start(threads);
+            next->lines.setSize(maxLayers, lineLength);
+            next->events.resize((size_t)maxLayers);
+            if (RealtimeGuard::isEnabled())
+            {
+                RealtimeGuard::lockBuffer(next->lines);
+                RealtimeGuard::lockMemory(next->events.data(), next->events.size() * sizeof(LayerEvents), true);
+            }
+        }
+
+        post([this, next]
+            {
+                std::swap(workers, next->workers);
+                std::swap(layerLines, next->lines);
+                std::swap(layerEvents, next->events);
+                renderThreads = next->threads;
+                minParallelLayers = next->minLayers;
+            });
+    }
+
+    // 0 = hard cut on the bar line
+    void setCrossfadeMs(double ms) { crossfadeMs.store(juce::jmax(0.0, ms)); }
+
+    // ===== master bus =====
+    void setMasterGainDb(float db) { masterGain.store(juce::Decibels::decibelsToGain(db, -96.0f)); }
+    void setLimiterEnabled(bool b) { limiterEnabled.store(b); }
+    void setLimiterCeilingDb(float db) { limiterCeiling.store(juce::Decibels::decibelsToGain(juce::jmin(0.0f, db))); }
+
+    // With alignWith, the new layer goes live at that layer's transport,
+    // seeked onto its own step grid in the change that adds it, so it doesn't
+    // drift by the blocks rendered in between. prepareToPlay resets the grid,
+    // which is why the seek can't be done by the caller beforehand.
+    void addLayer(ClickAudioSource* src, const ClickAudioSource* alignWith = nullptr)
+    {
+        if (src == nullptr) return;
+        post([this, src, alignWith]
+            {
+                jassert((int)live.size() < maxLayers);
+                if ((int)live.size() >= maxLayers) return;
+                if (prepared) src->prepareToPlay(blockSize, sampleRate);
+                if (alignWith != nullptr) src->seekToSample(alignWith->getTransportSamples());
+                live.push_back(src);
+            });
+    }
+
+    // The layer stops and its share of any pooled sample voice is dropped
+    // with the next block; keep it alive until isFadeIdle().
+    void removeLayer(ClickAudioSource* src)
+    {
+        if (src == nullptr) return;
+        post([this, src]
+            {
+                live.erase(std::remove(live.begin(), live.end(), src), live.end());
+                src->releasePoolVoices(voicePool);
+            });
+    }
+
+    // Swaps a layer's sample while the pool may be playing the old one; the
+    // old buffer goes back with the change and is released on the message
+    // thread. `original` is the unpitched buffer when `data` is a repitched
+    // copy; it's message-thread state and is set here.
+    void setSample(ClickAudioSource::OneShot& shot, ClickAudioSource::SampleData data,
+                   ClickAudioSource::SampleData original = {})
+    {
+        if (data != nullptr && data->getNumSamples() <= 0) data = nullptr;
+        shot.source = data != nullptr ? (original != nullptr ? std::move(original) : data) : nullptr;
+
+        auto swapped = std::make_shared<ClickAudioSource::SampleData>(std::move(data));
+        post([this, &shot, swapped]
+            {
+                voicePool.release(shot.handle);
+                std::swap(shot.data, *swapped);
+                shot.pos = shot.end = 0; shot.active = false; shot.roundRobin = 0;
+            });
+    }
+
+    const VoicePool& getVoicePool() const { return voicePool; }
+
+    // True once every posted change has run and no switched-out layer is
+    // fading any more, so sources that were removed or switched out may be
+    // deleted.
+    bool isFadeIdle() const { return changeFifo.getNumReady() == 0 && !fading.load(); }
+
+    // The limiter's look-ahead; valid after prepareToPlay.
+    int getLatencySamples() const { return limiterEnabled.load() ? limiter.getLatencySamples() : 0; }
+
+    // ===== audio thread: host transport (plugin) =====
+    // Called before getNextAudioBlock with the host's position at the start
+    // of the block, which that block then applies after the changes. Tempo
+    // and meter follow the host; the layers are seeked onto the host grid on
+    // start, loop and relocate, or whenever they end up more than a couple
+    // of samples away from where the host says.
+    void followHost(bool hostPlaying, double hostBpm, double ppq, int beatsPerBar)
+    {
+        hostPosition = { hostPlaying, hostBpm, ppq, beatsPerBar };
+        hostPending = true;
+    }
+
+    // ===== AudioSource =====
+    void prepareToPlay(int block, double sr) override
+    {
+        {
+            const juce::ScopedLock sl(lock);
+            applyChanges();   // posted while the device was starting
+            sampleRate = sr; blockSize = juce::jmax(1, block);
+            line.setSize(2, blockSize);
+            if (renderThreads > 0) layerLines.setSize(maxLayers, blockSize);
+            ramp.resize((size_t)blockSize);
+            for (int i = 0; i < blockSize; ++i) ramp[(size_t)i] = (float)i;
+            limiter.prepare(sampleRate, blockSize, maxOutputs);
+            voicePool.stopAll();
+            limiterWasOn = false;
+
+            if (metronome) metronome->prepareToPlay(blockSize, sampleRate);
+            if (practice) practice->prepare(sampleRate, blockSize);
+            for (auto* v : live) v->prepareToPlay(blockSize, sampleRate);
+            if (RealtimeGuard::isEnabled()) lockMemory();
+            prepared = true;
+        }
+        if (bank) bank->prepare(sampleRate, blockSize);
+    }
+
+    // No block runs after this until the next prepareToPlay, so the changes
+    // still queued run here and the fade lets go of the switched-out layers.
+    void releaseResources() override
+    {
+        const juce::ScopedLock sl(lock);
+        applyChanges();
+        endFade();
+        prepared = false;
+    }
+
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
+    {
+        const RtCheck::Scope rtCheck;   // nothing below may allocate or lock
+        const RealtimeGuard::Probe rtProbe;
+        applyChanges();
+        if (hostPending) applyHost();
+        const LoadProbe probe(*this, info.numSamples);
+        if (RealtimeGuard::isEnabled() && juce::Thread::getCurrentThreadId() != promotedThread)
+        {
+            const RtCheck::Allow once;
+            promotedThread = juce::Thread::getCurrentThreadId();   // devices restart their threads
+            RealtimeGuard::promoteCurrentThread();
+        }
+        if (firstBlockTime.load(std::memory_order_relaxed) == 0.0)
+            firstBlockTime.store(juce::Time::getMillisecondCounterHiRes(), std::memory_order_relaxed);
+
+        // the device input is still in the buffer (first active input on channel 0)
+        if (practice != nullptr && info.buffer != nullptr && info.buffer->getNumChannels() > 0 && prepared)
+            practice->analyse(info.buffer->getReadPointer(0, info.startSample), info.numSamples, live);
+
+        info.clearActiveBufferRegion();
+        if (info.buffer == nullptr || line.getNumSamples() == 0) return;
+        if (midi) midi->beginBlock(info.numSamples, sampleRate);
+        recording = recorder != nullptr && recorder->beginBlock();
+        stemming = recording && recorder->wantsStems();
+
+        if (follower != nullptr && follower->isEnabled()) followExternalClock(info.numSamples);
+        else                                               extRunning = false;
+
+        int done = 0;
+        while (done < info.numSamples)
+        {
+            int chunk = juce::jmin(info.numSamples - done, line.getNumSamples());
+
+            if (bank != nullptr && bank->hasArmedSwitch())
+            {
+                const int64_t toBar = samplesToNextBar();
+                if (toBar == 0) bank->consumePending([this](const PresetBank::Slot& s) { switchTo(s); });
+                else            chunk = (int)juce::jmin<int64_t>(chunk, toBar);
+            }
+            if (fadeRemaining > 0) chunk = juce::jmin(chunk, fadeRemaining);
+            if (rendersInParallel(chunk)) chunk = juce::jmin(chunk, maxParallelChunk());
+
+            renderChunk(info, done, chunk);
+            done += chunk;
+        }
+
+        processMaster(info);
+
+        if (recording)
+        {
+            recorder->writeMix(*info.buffer, info.startSample, info.numSamples);
+            recorder->endBlock();
+            recording = stemming = false;
+        }
+    }
+
+private:
+    // ===== message thread (lock held) =====
+    // Destroys the changes that have run, oldest first, and with them
+    // whatever they swapped out.
+    void recycleChanges()
+    {
+        for (const int ready = changeFifo.getNumReady(); unrecycledChanges > ready; --unrecycledChanges)
+        {
+            changes[(size_t)recycleAt] = nullptr;
+            recycleAt = (recycleAt + 1) % maxPendingChanges;
+        }
+    }
+
+    // times one callback while measuringLoad is set
+    struct LoadProbe
+    {
+        LoadProbe(LayerEngine& e, int n)
+            : engine(e), numSamples(n),
+              start(e.measuringLoad.load(std::memory_order_relaxed) ? juce::Time::getHighResolutionTicks() : 0) {}
+
+        ~LoadProbe()
+        {
+            if (start == 0 || numSamples <= 0) return;
+            const double secs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+            const float load = (float)(secs * engine.sampleRate / (double)numSamples);
+            if (load > engine.peakLoad.load(std::memory_order_relaxed))
+                engine.peakLoad.store(load, std::memory_order_relaxed);
+        }
+
+        LayerEngine& engine;
+        const int    numSamples;
+        const juce::int64 start;
+    };
+
+    // ===== audio thread =====
+    // Runs the posted changes. The slots keep them (and what they swapped
+    // out) until the message thread recycles them.
+    void applyChanges()
+    {
+        changeFifo.read(changeFifo.getNumReady()).forEach([this](int i) { changes[(size_t)i](); });
+    }
+
+    // the position followHost stored for this block
+    void applyHost()
+    {
+        hostPending = false;
+        const auto& h = hostPosition;
+
+        if (!h.playing)
+        {
+            if (hostRunning)
+                for (auto* v : live) v->setPlaying(false);
+            hostRunning = false;
+            return;
+        }
+
+        applyTempo(h.bpm);
+
+        const int beatsPerBar = juce::jlimit(1, 64, h.beatsPerBar);
+        if (beatsPerBar != hostMeter)
+        {
+            hostMeter = beatsPerBar;
+            for (auto* v : live) v->setHostBeatsPerBar(beatsPerBar);
+            if (metronome) metronome->setBeatsPerBar(beatsPerBar);
+            hostRunning = false;
+        }
+
+        const double ticks = juce::jmax(0.0, h.ppq) * (double)MidiClockFollower::ticksPerBeat;
+        const double spb = sampleRate * 60.0 / juce::jmax(1.0, extBpm);
+        const auto expected = (int64_t)std::llround(juce::jmax(0.0, h.ppq) * spb);
+        const bool drifted = !live.empty() && std::abs(live[0]->getTransportSamples() - expected) > 2;
+
+        if (!hostRunning || drifted)
+        {
+            seekAll(ticks);
+            for (auto* v : live) v->setPlaying(true);
+            hostRunning = true;
+        }
+    }
+
+    // Samples until the first sample of the next bar, 0 when the transport is
+    // on one. Bar k starts where its downbeat fires, on sample ceil(k * spbar),
+    // so the bar is found by index; a fractional bar length never leaves the
+    // transport on an exact multiple of itself.
+    int64_t samplesToNextBar() const
+    {
+        if (live.empty() || !live[0]->isPlaying()) return 0;
+
+        const auto* ref = live[0];
+        const double spbar = ref->samplesPerBeat * (double)juce::jmax(1, ref->hostBeatsPerBar);
+        if (spbar <= 0.0) return 0;
+
+        const int64_t t = ref->getTransportSamples();
+        if (t <= 0) return 0;
+
+        auto barStart = [spbar](int64_t k) { return (int64_t)std::ceil((double)k * spbar - 1.0e-7); };
+        int64_t k = (int64_t)std::floor((double)(t - 1) / spbar) + 1;   // first bar starting at or after t
+        while (k > 1 && barStart(k - 1) >= t) --k;
+        while (barStart(k) < t) ++k;
+        return barStart(k) - t;
+    }
+
+    // ===== external clock =====
+    // The tempo follows the filtered clock period; the phase error between
+    // where the master says we are and where we actually are is pulled in by
+    // nudging the tempo (at most 2 %), so corrections are inaudible. Only a
+    // large error (> 1/4 beat) or a Start/Continue/SPP re-seeks the layers.
+    void followExternalClock(int numSamples)
+    {
+        const auto st = follower->snapshot(juce::Time::getMillisecondCounterHiRes());
+
+        if (!st.running)
+        {
+            if (extRunning)
+            {
+                for (auto* v : live) v->setPlaying(false);
+                if (metronome && metronome->isPlaying()) { metStoppedByClock = true; metronome->setPlaying(false); }
+            }
+            extRunning = false;
+            return;
+        }
+
+        if (!extRunning || st.generation != extGeneration)
+        {
+            extGeneration = st.generation;
+            extTicks = st.ticks;
+            applyTempo(st.bpm);
+            seekAll(extTicks);
+            for (auto* v : live) v->setPlaying(true);
+            if (metronome && metStoppedByClock) metronome->setPlaying(true);
+            metStoppedByClock = false;
+            extRunning = true;
+        }
+        else if (!st.stale)
+        {
+            const double err = st.ticks - extTicks;
+            if (std::abs(err) > (double)MidiClockFollower::ticksPerBeat / 4.0)
+            {
+                extTicks = st.ticks;
+                applyTempo(st.bpm);
+                seekAll(extTicks);
+            }
+            else
+            {
+                const double ticksPerSec = st.bpm / 60.0 * (double)MidiClockFollower::ticksPerBeat;
+                const double corr = juce::jlimit(-0.02, 0.02, err / (ticksPerSec * 2.0));
+                applyTempo(st.bpm * (1.0 + corr));
+            }
+        }
+
+        extTicks += (double)numSamples * extBpm / 60.0 * (double)MidiClockFollower::ticksPerBeat / sampleRate;
+    }
+
+    void applyTempo(double b)
+    {
+        if (std::abs(b - extBpm) < 1.0e-6) return;
+        extBpm = b;
+        for (auto* v : live) v->setTempo(b);
+        if (metronome) metronome->setTempo(b);
+    }
+
+    void seekAll(double ticks)
+    {
+        const double samplesPerTick = sampleRate * 60.0 / juce::jmax(1.0, extBpm) / (double)MidiClockFollower::ticksPerBeat;
+        const auto t = (int64_t)std::llround(ticks * samplesPerTick);
+        for (auto* v : live) v->seekToSample(t);
+        if (metronome) metronome->seekToSample(t);
+    }
+
+    void switchTo(const PresetBank::Slot& s)
+    {
+        const bool running = !live.empty() && live[0]->isPlaying();
+
+        fadeLength = (int)std::llround(crossfadeMs.load() * 0.001 * sampleRate);
+        endFade();
+        for (auto* v : live)
+        {
+            if (fadeLength > 0) outgoing.push_back(v);
+            else                v->releasePoolVoices(voicePool);
+        }
+        fadeRemaining = outgoing.empty() ? 0 : fadeLength;
+        fading.store(!outgoing.empty());   // before the bank reports the switch
+
+        live.clear();
+        for (auto* v : s.voices)
+        {
+            if ((int)live.size() >= maxLayers) break;
+            if (v->hostBeatsPerBar != hostMeter) v->setHostBeatsPerBar(hostMeter);
+            v->restart();
+            v->setPlaying(running);
+            live.push_back(v);
+        }
+
+        if (metronome)
+        {
+            metronome->setTempo(s.preset.bpm);
+            metronome->resetTransport();
+        }
+
+        // under external clock / host transport the next block re-seeks the
+        // new voices onto the master's grid and re-applies its tempo
+        if (extRunning || hostRunning) { extRunning = hostRunning = false; extBpm = 0.0; }
+    }
+
+    // The switched-out layers are done with: their shares of the pool go,
+    // and the message thread may delete them (isFadeIdle).
+    void endFade()
+    {
+        for (auto* v : outgoing) v->releasePoolVoices(voicePool);
+        outgoing.clear();
+        fadeRemaining = 0;
+        fading.store(false);
+    }
+
+    // The ramp a live layer's pool hits get over the next n samples, the
+    // same one mixIn puts on its own line, so a sample hit follows level and
+    // pan changes and the preset fade-in like the layer's synth does. A hit
+    // keeps the gain it started with.
+    static void rampHits(ClickAudioSource& v, float f0, float f1, int n)
+    {
+        float target[2];
+        routeGains(v.outGain, v.outPan, v.outWidth, target);
+        for (int c = 0; c < 2; ++c)
+        {
+            v.hitFrom[c] = (v.hitGain[c] < 0.0f ? target[c] : v.hitGain[c]) * f0;
+            v.hitTo[c] = target[c] * f1;
+            v.hitGain[c] = target[c];
+        }
+        v.hitLength = n;
+    }
+
+    // dst += src * (g0 -> g1): a constant gain is one vector op; a ramp adds
+    // src * i * step over the precomputed index line (two more).
+    void addRamped(float* dst, const float* src, int n, float g0, float g1)
+    {
+        juce::FloatVectorOperations::addWithMultiply(dst, src, g0, n);
+        if (g0 == g1) return;
+
+        float* tmp = line.getWritePointer(1);
+        juce::FloatVectorOperations::multiply(tmp, src, ramp.data(), n);
+        juce::FloatVectorOperations::addWithMultiply(dst, tmp, (g1 - g0) / (float)n, n);
+    }
+
+    void processMaster(const juce::AudioSourceChannelInfo& info)
+    {
+        const int numCh = juce::jmin(info.buffer->getNumChannels(), maxOutputs);
+
+        const float g = masterGain.load();
+        if (g != appliedMaster)
+        {
+            for (int ch = 0; ch < numCh; ++ch)
+                info.buffer->applyGainRamp(ch, info.startSample, info.numSamples, appliedMaster, g);
+            appliedMaster = g;
+        }
+        else if (g != 1.0f)
+        {
+            for (int ch = 0; ch < numCh; ++ch)
+                info.buffer->applyGain(ch, info.startSample, info.numSamples, g);
+        }
+
+        const bool on = limiterEnabled.load();
+        if (on && !limiterWasOn) limiter.reset();
+        limiterWasOn = on;
+        if (!on) return;
+
+        limiter.setCeiling(limiterCeiling.load());
+        limiter.process(*info.buffer, info.startSample, info.numSamples);
+    }
+
+    void renderChunk(const juce::AudioSourceChannelInfo& info, int offset, int n)
+    {
+        float* mono = line.getWritePointer(0);
+        const int numOut = info.buffer->getNumChannels();
+        const int dst = info.startSample + offset;
+
+        voicePool.beginChunk();
+
+        // f0/f1 is the fade; `in` is the line src has rendered, or null to render it into mono
+        auto mixIn = [&](auto& src, float f0, float f1, const float* in = nullptr)
+            {
+                if (in == nullptr)
+                {
+                    if (!src.render(mono, n)) return false;
+                    in = mono;
+                }
+
+                int first = src.outChannel, width = src.outWidth;
+                resolveRoute(first, width, numOut);
+
+                float target[2];
+                routeGains(src.outGain, src.outPan, width, target);
+
+                for (int c = 0; c < width; ++c)
+                {
+                    const float from = src.mixGain[c] < 0.0f ? target[c] : src.mixGain[c];
+                    addRamped(info.buffer->getWritePointer(first + c, dst), in, n, from * f0, target[c] * f1);
+                    src.mixGain[c] = target[c];
+                }
+                return true;
+            };
+
+        if (midi)
+        {
+            midi->setChunkOffset(offset);
+            if (!live.empty())
+                midi->renderClock(live[0]->getTransportSamples(), n, live[0]->samplesPerBeat, live[0]->isPlaying());
+        }
+
+        if (metronome) { metronome->sink = midi; mixIn(*metronome, 1.0f, 1.0f); }
+
+        float in0 = 1.0f, in1 = 1.0f;
+        if (fadeRemaining > 0)
+        {
+            const float len = (float)juce::jmax(1, fadeLength);
+            in0 = 1.0f - (float)fadeRemaining / len;
+            in1 = 1.0f - (float)(fadeRemaining - n) / len;
+
+            for (auto* v : outgoing) { v->sink = nullptr; v->pool = nullptr; mixIn(*v, 1.0f - in0, 1.0f - in1); }
+
+            fadeRemaining -= n;
+            if (fadeRemaining <= 0) endFade();
+        }
+
+        if (rendersInParallel(n))
+        {
+            renderLayersParallel(n, in0, in1, mixIn);
+            voicePool.render(*info.buffer, dst, n);
+            return;
+        }
+
+        for (size_t i = 0; i < live.size(); ++i)
+        {
+            live[i]->sink = midi;
+            live[i]->sinkLayer = (int)i;
+            live[i]->pool = stemming ? nullptr : &voicePool;   // stems need each layer's own samples
+            rampHits(*live[i], in0, in1, n);
+
+            if (!mixIn(*live[i], in0, in1) && stemming) juce::FloatVectorOperations::clear(mono, n);
+            if (stemming) recorder->writeStem((int)i, mono, n);   // pre-fader
+        }
+
+        voicePool.render(*info.buffer, dst, n);
+    }
+
+    // realtimeMode: everything the callback touches (prepareToPlay, under the lock)
+    void lockMemory()
+    {
+        RealtimeGuard::lockMemory(this, sizeof(*this), false);   // pool voices; other threads write the atomics
+        RealtimeGuard::lockBuffer(line);
+        RealtimeGuard::lockMemory(ramp.data(), ramp.size() * sizeof(float), true);
+        RealtimeGuard::lockBuffer(layerLines);
+        RealtimeGuard::lockMemory(layerEvents.data(), layerEvents.size() * sizeof(LayerEvents), true);
+        RealtimeGuard::lockMemory(live.data(), live.capacity() * sizeof(ClickAudioSource*), false);
+        RealtimeGuard::lockMemory(outgoing.data(), outgoing.capacity() * sizeof(ClickAudioSource*), false);
+        limiter.lockMemory();
+    }
+
+    bool rendersInParallel(int n) const
+    {
+        return renderThreads > 0 && (int)live.size() >= minParallelLayers && layerLines.getNumSamples() >= n;
+    }
+
+    // The longest chunk in which no layer can record more triggers than its
+    // LayerEvents (and pool Deferred) hold: a layer fires at most once per
+    // step, and its steps are at least floor(step length) samples apart.
+    // Short steps with long blocks (256 sides at 300 bpm, a 1-beat host bar,
+    // an offline bounce) would otherwise overflow them.
+    int maxParallelChunk() const
+    {
+        static_assert(LayerEvents::capacity <= VoicePool::Deferred::capacity, "the pool hits of a chunk must fit too");
+        double shortest = (double)layerLines.getNumSamples();
+        for (const auto* v : live) shortest = juce::jmin(shortest, v->getStepLength());
+        return juce::jmax(1, (int)std::floor(shortest) * (LayerEvents::capacity - 1));
+    }
+
+    // Renders every live layer into its own line on the workers, then
+    // replays their triggers and mixes them in layer order.
+    template <typename MixIn>
+    void renderLayersParallel(int n, float in0, float in1, MixIn& mixIn)
+    {
+        for (size_t i = 0; i < live.size(); ++i)
+        {
+            auto* v = live[i];
+            v->sink = &layerEvents[i];
+            v->sinkLayer = (int)i;
+            v->pool = stemming ? nullptr : &voicePool;
+            v->deferredPool = &layerEvents[i].pool;
+            rampHits(*v, in0, in1, n);
+        }
+
+        parallelChunk = n;
+        workers->run((int)live.size(), [](void* context, int i)
+            {
+                auto& e = *static_cast<LayerEngine*>(context);
+                e.layerEvents[(size_t)i].rendered = e.live[(size_t)i]->render(e.layerLines.getWritePointer(i), e.parallelChunk);
+            }, this);
+
+        for (size_t i = 0; i < live.size(); ++i)
+        {
+            auto& ev = layerEvents[i];
+            live[i]->deferredPool = nullptr;
+            ev.replay(midi);
+            ev.pool.replay(voicePool);
+
+            float* in = layerLines.getWritePointer((int)i);
+            if (ev.rendered)    mixIn(*live[i], in0, in1, in);
+            else if (stemming)  juce::FloatVectorOperations::clear(in, n);
+            if (stemming) recorder->writeStem((int)i, in, n);   // pre-fader
+        }
+    }
+
+    // One layer's MIDI triggers and pool triggers while it renders on a worker.
+    struct LayerEvents : public TriggerSink
+    {
+        static constexpr int capacity = 32;
+
+        void trigger(int sampleOffset, int layer, Role role, float gain) override
+        {
+            jassert(count < capacity);
+            if (count < capacity) events[(size_t)count++] = { sampleOffset, layer, role, gain };
+        }
+
+        void replay(TriggerSink* to)
+        {
+            if (to != nullptr)
+                for (int i = 0; i < count; ++i)
+                    to->trigger(events[(size_t)i].offset, events[(size_t)i].layer, events[(size_t)i].role, events[(size_t)i].gain);
+            count = 0;
+        }
+
+        struct Event { int offset, layer; Role role; float gain; };
+        std::array<Event, capacity> events;
+        int  count = 0;
+        bool rendered = false;
+        VoicePool::Deferred pool;
+    };
+
+    // What setRenderThreads swaps in (and the old set, after the swap).
+    struct RenderSetup
+    {
+        std::unique_ptr<ParallelRenderer> workers;
+        juce::AudioBuffer<float>          lines;
+        std::vector<LayerEvents>          events;
+        int threads = 0, minLayers = 32;
+    };
+
+    juce::CriticalSection lock;   // posting vs prepareToPlay/releaseResources; the callback never takes it
+    MetronomeSource* metronome = nullptr;
+    PresetBank*      bank = nullptr;
+    MidiTriggerOutput* midi = nullptr;
+    MidiClockFollower* follower = nullptr;
+    BounceRecorder*    recorder = nullptr;
+    PracticeMonitor*   practice = nullptr;
+    bool recording = false, stemming = false;   // this block
+
+    // external clock / host transport state (audio thread)
+    bool   extRunning = false, metStoppedByClock = false;
+    bool   hostRunning = false;   // followHost has seeked and started the layers
+    struct HostPosition { bool playing = false; double bpm = 120.0, ppq = 0.0; int beatsPerBar = 4; };
+    HostPosition hostPosition;    // from followHost, for the next block
+    bool   hostPending = false;
+    juce::uint32 extGeneration = 0;
+    double extTicks = 0.0, extBpm = 0.0;
+    int    hostMeter = 4;
+
+    std::vector<ClickAudioSource*> live;      // reserved to maxLayers
+    std::vector<ClickAudioSource*> outgoing;  // previous set while crossfading
+
+    juce::AudioBuffer<float> line;   // 0: mono render line reused by every source, 1: ramp scratch
+    std::vector<float>       ramp;   // 0, 1, 2, ... blockSize-1
+
+    VoicePool voicePool;
+
+    // parallel rendering
+    std::unique_ptr<ParallelRenderer> workers;
+    int                      renderThreads = 0, minParallelLayers = 32;
+    juce::AudioBuffer<float> layerLines;    // one line per layer slot (maxLayers x blockSize)
+    std::vector<LayerEvents> layerEvents;   // maxLayers
+    int                      parallelChunk = 0;
+
+    // master bus
+    MasterLimiter       limiter;
+    std::atomic<float>  masterGain{ 1.0f }, limiterCeiling{ 0.966f };  // -0.3 dBFS
+    std::atomic<bool>   limiterEnabled{ true };
+    float               appliedMaster = 1.0f;
+    bool                limiterWasOn = false;
+    double sampleRate = 48000.0;
+    int    blockSize = 512;
+    bool   prepared = false;
+
+    std::atomic<double> crossfadeMs{ 0.0 };
+    std::atomic<double> firstBlockTime{ 0.0 };
+    std::atomic<bool>   measuringLoad{ false };
+    juce::Thread::ThreadID promotedThread = nullptr;
+    std::atomic<float>  peakLoad{ 0.0f };
+    int fadeLength = 0, fadeRemaining = 0;
+    std::atomic<bool> fading{ false };   // outgoing isn't empty
+
+    // posted changes; the slots are only cleared by the message thread
+    std::array<Change, (size_t)maxPendingChanges> changes;
+    juce::AbstractFifo changeFifo{ maxPendingChanges };
+    int recycleAt = 0, unrecycledChanges = 0;   // message thread, lock held
+
+    int requestedThreads = 0, requestedMinLayers = 32;   // message thread
+
+    JUCE_DECLARE_NON_COPYABLE(LayerEngine)
+};
@@ -14,6 +14,8 @@ public:
 
     void initialise(const juce::String&) override
     {
+        StartupTrace::begin();
+
         juce::PropertiesFile::Options opts;
         opts.applicationName = "Tri-Beat";
         opts.filenameSuffix = "settings";
@@ -23,6 +25,7 @@ public:
         appProps.setStorageParameters(opts);
 
         mainWindow.reset(new MainWindow("Tri-Beat", appProps));
+        StartupTrace::mark("window shown");
 
         // --- First-run + hide flag logic ---
         auto* settings = appProps.getUserSettings();
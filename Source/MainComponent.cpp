@@ -14,8 +14,11 @@ MainComponent::MainComponent()
     bpmSlider.onValueChange = [this]
         {
             const double b = bpmSlider.getValue();
-            metronome.setTempo(b);
-            for (auto& src : layersAudio) src->setTempo(b);
+            engine.post([this, b]
+                {
+                    metronome.setTempo(b);
+                    engine.forEachLayer([b](ClickAudioSource& src) { src.setTempo(b); });
+                });
         };
 
 
@@ -29,14 +32,17 @@ MainComponent::MainComponent()
     modeToggle.onClick = [this]
         {
             const bool isPoly = modeToggle.getToggleState();
-            for (auto& src : layersAudio)
-            {
-                src->setPolyrhythm(isPoly);
-                // sides 
-                const int n = getActiveLayer().sides;
-                if (isPoly) src->setSubdivisions(n);
-                else        src->setBeatsPerBar(n);
-            }
+            // sides 
+            const int n = getActiveLayer().sides;
+            engine.post([this, isPoly, n]
+                {
+                    engine.forEachLayer([isPoly, n](ClickAudioSource& src)
+                        {
+                            src.setPolyrhythm(isPoly);
+                            if (isPoly) src.setSubdivisions(n);
+                            else        src.setBeatsPerBar(n);
+                        });
+                });
             repaint();
         };
 
@@ -45,16 +51,19 @@ MainComponent::MainComponent()
     metToggle.onClick = [this]
         {
             const bool on = metToggle.getToggleState();
-            if (on)
-            {
-                metronome.resetTransport(); 
-                metronome.setPlaying(true);  
-            }
-            else
-            {
-                metronome.setPlaying(false); 
-                
-            }
+            engine.post([this, on]
+                {
+                    if (on)
+                    {
+                        metronome.resetTransport(); 
+                        metronome.setPlaying(true);  
+                    }
+                    else
+                    {
+                        metronome.setPlaying(false); 
+                        
+                    }
+                });
         };
 
 
@@ -71,6 +80,33 @@ MainComponent::MainComponent()
     downNoteLabel.setText("Down Note", juce::dontSendNotification);
     downNoteLabel.attachToComponent(&downNoteBox, true);
 
+    // ==== Output routing ====
+    addAndMakeVisible(outputBox);
+    addAndMakeVisible(outputLabel);
+    outputLabel.setText("Output", juce::dontSendNotification);
+    outputLabel.attachToComponent(&outputBox, true);
+
+    // ==== Level / pan ====
+    addAndMakeVisible(gainSlider);
+    gainSlider.setSliderStyle(juce::Slider::LinearHorizontal);
+    gainSlider.setTextBoxStyle(juce::Slider::TextBoxRight, false, 64, 20);
+    gainSlider.setRange(-60.0, 6.0, 0.1);
+    gainSlider.setTextValueSuffix(" dB");
+    gainSlider.setValue(0.0, juce::dontSendNotification);
+    addAndMakeVisible(gainLabel);
+    gainLabel.setText("Level", juce::dontSendNotification);
+    gainLabel.attachToComponent(&gainSlider, true);
+
+    addAndMakeVisible(panSlider);
+    panSlider.setSliderStyle(juce::Slider::LinearHorizontal);
+    panSlider.setTextBoxStyle(juce::Slider::TextBoxRight, false, 64, 20);
+    panSlider.setRange(-1.0, 1.0, 0.01);
+    panSlider.setValue(0.0, juce::dontSendNotification);
+    panSlider.setDoubleClickReturnValue(true, 0.0);
+    addAndMakeVisible(panLabel);
+    panLabel.setText("Pan", juce::dontSendNotification);
+    panLabel.attachToComponent(&panSlider, true);
+
     sidesUp.onClick = [this] { setSidesForActive(getActiveLayer().sides + 1); };
     sidesDown.onClick = [this] { setSidesForActive(getActiveLayer().sides - 1); };
 
@@ -79,14 +115,36 @@ MainComponent::MainComponent()
         {
             int id = upNoteBox.getSelectedId(); if (id <= 0) return;
             int midi = 60 + (id - 1);
-            layersAudio[(size_t)activeLayer]->setUpbeatFreqHz(440.0 * std::pow(2.0, (midi - 69) / 12.0));
+            auto* a = layersAudio[(size_t)activeLayer].get();
+            a->setUpbeatFreqHz(440.0 * std::pow(2.0, (midi - 69) / 12.0));
+            applySample(a, 0, a->kick.source);
         };
 
     downNoteBox.onChange = [this]
         {
             int id = downNoteBox.getSelectedId(); if (id <= 0) return;
             int midi = 60 + (id - 1);
-            layersAudio[(size_t)activeLayer]->setDownbeatFreqHz(440.0 * std::pow(2.0, (midi - 69) / 12.0));
+            auto* a = layersAudio[(size_t)activeLayer].get();
+            a->setDownbeatFreqHz(440.0 * std::pow(2.0, (midi - 69) / 12.0));
+            applySample(a, 1, a->snare.source);
+        };
+
+    outputBox.onChange = [this]
+        {
+            const int id = outputBox.getSelectedId(); if (id <= 0) return;
+            auto* a = getActiveAudio();
+            a->outChannel = (id > 1000 ? id - 1001 : id - 1);
+            a->outWidth = (id > 1000 ? 1 : 2);
+        };
+
+    gainSlider.onValueChange = [this]
+        {
+            getActiveAudio()->outGain = juce::Decibels::decibelsToGain((float)gainSlider.getValue(), -60.0f);
+        };
+
+    panSlider.onValueChange = [this]
+        {
+            getActiveAudio()->outPan = (float)panSlider.getValue();
         };
 
 
@@ -117,10 +175,16 @@ MainComponent::MainComponent()
 
     sidesLabel.setText("Sides", juce::dontSendNotification);
     sidesValue.setJustificationType(juce::Justification::centred);
-    sidesValue.setInterceptsMouseClicks(false, false); 
+    sidesValue.setEditable(false, true);
+    sidesValue.onTextChange = [this]
+        {
+            setSidesForActive(sidesValue.getText().getIntValue());
+            sidesValue.setText(juce::String(getActiveLayer().sides), juce::dontSendNotification);
+        };
 
     sidesUp.setTooltip("Increase sides");
     sidesDown.setTooltip("Decrease sides");
+    sidesValue.setTooltip("Double-click to type the number of sides (3-" + juce::String(ClickAudioSource::maxSteps) + ")");
 
     // ==== Play / Stop ====
     addAndMakeVisible(playButton);
@@ -128,29 +192,43 @@ MainComponent::MainComponent()
 
     playButton.onClick = [this]
         {
-           
-            metronome.resetTransport();
-            metronome.setPlaying(metToggle.getToggleState());
-
-            
-            for (auto& src : layersAudio)
-            {
-                src->resetTransport();
-                src->setPlaying(true);
-            }
+            engine.post([this, met = metToggle.getToggleState()]
+                {
+                    metronome.resetTransport();
+                    metronome.setPlaying(met);
+
+                    
+                    engine.forEachLayer([](ClickAudioSource& src)
+                        {
+                            src.resetTransport();
+                            src.setPlaying(true);
+                        });
+                });
         };
 
     stopButton.onClick = [this]
         {
-            
-            for (auto& src : layersAudio)
-            {
-                src->setPlaying(false);
-                src->resetTransport();
-            }
-            
-            metronome.setPlaying(false);
-            metronome.resetTransport();
+            engine.post([this]
+                {
+                    engine.forEachLayer([](ClickAudioSource& src)
+                        {
+                            src.setPlaying(false);
+                            src.resetTransport();
+                        });
+                    
+                    metronome.setPlaying(false);
+                    metronome.resetTransport();
+                });
+        };
+
+    addAndMakeVisible(recButton);
+    recButton.setTooltip("Record the output to disk (WAV/FLAC)");
+    recButton.setClickingTogglesState(true);
+    recButton.setColour(juce::TextButton::buttonOnColourId, juce::Colours::darkred);
+    recButton.onClick = [this]
+        {
+            if (recButton.getToggleState()) startRecording();
+            else                            stopRecording();
         };
 
     addAndMakeVisible(muteSubsToggle);
@@ -163,6 +241,20 @@ MainComponent::MainComponent()
                 src->setMuteSubdivisions(m);
         };
 
+    addAndMakeVisible(extClockToggle);
+    extClockToggle.setTooltip("Follow tempo, start/stop and song position from incoming MIDI clock");
+    extClockToggle.onClick = [this]
+        {
+            const bool ext = extClockToggle.getToggleState();
+            clockFollower.setEnabled(ext);
+            bpmSlider.setEnabled(!ext);
+            if (!ext && bpmSlider.onValueChange) bpmSlider.onValueChange();
+        };
+
+    addAndMakeVisible(listenToggle);
+    listenToggle.setTooltip("Listen to your playing on an audio input and show the timing at each vertex");
+    listenToggle.onClick = [this] { setListening(listenToggle.getToggleState()); };
+
 
     addAndMakeVisible(loadKickBtn);
     addAndMakeVisible(loadSnareBtn);
@@ -179,23 +271,39 @@ MainComponent::MainComponent()
     loadHihatBtn.setLookAndFeel(&uniformBtnLNF);
 
     
-    auto makeLoadHandler = [this](ClickAudioSource::OneShot& target)
+    // role: 0 = kick (upbeat), 1 = snare (downbeat), 2 = hihat (subdivision)
+    auto makeLoadHandler = [this](int role)
         {
+            // several files = velocity layers / round-robin takes (see SampleLoader)
             auto chooser = std::make_shared<juce::FileChooser>(
-                "Choose a sample...", juce::File(), "*.wav;*.aiff;*.mp3");
+                "Choose a sample (or several takes)...", juce::File(), "*.wav;*.aiff;*.flac;*.mp3");
 
-            chooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
-                [this, chooser, &target](const juce::FileChooser& fc)
+            auto* target = layersAudio[(size_t)activeLayer].get();
+            chooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles
+                                 | juce::FileBrowserComponent::canSelectMultipleItems,
+                [this, chooser, target, role](const juce::FileChooser& fc)
                 {
-                    auto f = fc.getResult();
-                    if (f.existsAsFile())
-                        loadOneShotFromFile(target, f);
+                    juce::StringArray paths;
+                    for (const auto& f : fc.getResults())
+                        if (f.existsAsFile()) paths.add(f.getFullPathName());
+                    if (paths.isEmpty()) return;
+
+                    const auto spec = paths.joinIntoString("|");
+
+                    // the layer may have been removed while the chooser was open
+                    for (size_t i = 0; i < layersAudio.size(); ++i)
+                    {
+                        if (layersAudio[i].get() != target) continue;
+                        auto& L = layers[i];
+                        (role == 0 ? L.kickPath : role == 1 ? L.snarePath : L.hihatPath) = spec;
+                        loadSample(target, role, spec);
+                    }
                 });
         };
 
-    loadKickBtn.onClick = [this, makeLoadHandler]() { if (!layersAudio.empty()) makeLoadHandler(layersAudio[activeLayer]->kick);  };
-    loadSnareBtn.onClick = [this, makeLoadHandler]() { if (!layersAudio.empty()) makeLoadHandler(layersAudio[activeLayer]->snare); };
-    loadHihatBtn.onClick = [this, makeLoadHandler]() { if (!layersAudio.empty()) makeLoadHandler(layersAudio[activeLayer]->hihat); };
+    loadKickBtn.onClick = [this, makeLoadHandler]() { if (!layersAudio.empty()) makeLoadHandler(0); };
+    loadSnareBtn.onClick = [this, makeLoadHandler]() { if (!layersAudio.empty()) makeLoadHandler(1); };
+    loadHihatBtn.onClick = [this, makeLoadHandler]() { if (!layersAudio.empty()) makeLoadHandler(2); };
 
 
     addAndMakeVisible(helpBtn);
@@ -231,65 +339,23 @@ MainComponent::MainComponent()
 
     setSize(800, 450);
 
-    // ======================= Safe boot ???? ??? =======================
-    {
-        audioSourcePlayer.setSource(nullptr);
-        deviceManager.removeAudioCallback(&audioSourcePlayer);
-        deviceManager.closeAudioDevice();
-
-        auto& types = deviceManager.getAvailableDeviceTypes();
-        juce::String chosenType;
-
-        if (types.size() > 0)
-        {
-            for (auto* t : types)
-                if (t && t->getTypeName().isNotEmpty()
-                    && t->getTypeName().containsIgnoreCase("Windows")) // WASAPI
-                {
-                    chosenType = t->getTypeName(); break;
-                }
-
-            if (chosenType.isEmpty())
-                for (auto* t : types)
-                    if (t && t->getTypeName().isNotEmpty())
-                    {
-                        chosenType = t->getTypeName(); break;
-                    }
-        }
-
-        if (chosenType.isNotEmpty())
-            deviceManager.setCurrentAudioDeviceType(chosenType, true);
-        else
-            DBG("[Audio] No device types found!");
-
-        auto err = deviceManager.initialise(0, 2, nullptr, true, {}, nullptr);
-        if (err.isNotEmpty())
-            DBG("[Audio] init error: " << err);
-
-        if (deviceManager.getCurrentAudioDevice() == nullptr)
-        {
-            DBG("[Audio] Fallback to DirectSound / Windows Audio");
-
-            deviceManager.setCurrentAudioDeviceType("DirectSound", true);
-            err = deviceManager.initialise(0, 2, nullptr, true, {}, nullptr);
-
-            if (deviceManager.getCurrentAudioDevice() == nullptr)
-            {
-                deviceManager.setCurrentAudioDeviceType("Windows Audio", true);
-                err = deviceManager.initialise(0, 2, nullptr, true, {}, nullptr);
-            }
-        }
-
-        
-
-        if (auto* dev = deviceManager.getCurrentAudioDevice())
-            DBG("[Audio] Device: " << dev->getName() << "  SR=" << dev->getCurrentSampleRate());
-    }
-    //==================================================================
+    // The audio device is opened in the background once the settings are in
+    // (setAppProperties -> startAudio), so the window doesn't wait for it.
     
     metronome.setTempo(bpmSlider.getValue());
     metronome.setBeatsPerBar(4);
-    mixer.addInputSource(&metronome, false); 
+    engine.setMetronome(&metronome);
+    engine.setPresetBank(&presetBank);
+    presetBank.setSampleSource([this](const juce::String& path, double sr) -> ClickAudioSource::SampleData
+        {
+            const juce::ScopedLock sl(loadedSamplesLock);
+            const auto it = loadedSamples.find(path + "@" + juce::String(sr));
+            return it != loadedSamples.end() ? it->second.lock() : nullptr;
+        });
+    engine.setMidiOutput(&midiOut);
+    engine.setClockFollower(&clockFollower);
+    engine.setRecorder(&recorder);
+    engine.setPracticeMonitor(&practice);
 
     layers.emplace_back();
     layersAudio.emplace_back(std::make_unique<ClickAudioSource>());
@@ -307,16 +373,15 @@ MainComponent::MainComponent()
     layersAudio[0]->setUpbeatFreqHz(440.0); 
     layersAudio[0]->setDownbeatFreqHz(220.0); 
 
-    // mixer
-    mixer.addInputSource(layersAudio[0].get(), false);
+    // engine
+    engine.addLayer(layersAudio[0].get());
 
 
     
-    audioSourcePlayer.setSource(&mixer);
-    deviceManager.addAudioCallback(&audioSourcePlayer);
-
+    audioSourcePlayer.setSource(&engine);
 
-    formatManager.registerBasicFormats();
+    // only the loader thread decodes
+    sampleLoadPool.addJob([this] { formatManager.registerBasicFormats(); });
 
 
 
@@ -328,22 +393,14 @@ MainComponent::MainComponent()
     layerLabel.setText("Layer", juce::dontSendNotification);
     layerLabel.attachToComponent(&layerSelect, true);
 
-    auto refreshLayerCombo = [this]
-        {
-            layerSelect.clear();
-            for (int i = 0; i < (int)layers.size(); ++i)
-                layerSelect.addItem("Layer " + juce::String(i + 1), i + 1);
-            layerSelect.setSelectedId(activeLayer + 1, juce::dontSendNotification);
-        };
-
-    addLayerBtn.onClick = [this, refreshLayerCombo]
+    addLayerBtn.onClick = [this]
         {
             addNewLayer();
             refreshLayerCombo();
             repaint();
         };
 
-        removeLayerBtn.onClick = [this, refreshLayerCombo]
+        removeLayerBtn.onClick = [this]
             {
                 removeActiveLayer();
                 refreshLayerCombo();
@@ -355,6 +412,8 @@ MainComponent::MainComponent()
                     const int id = layerSelect.getSelectedId();
                     if (id > 0 && id - 1 < (int)layers.size())
                         activeLayer = id - 1;
+                    sidesValue.setText(juce::String(getActiveLayer().sides), juce::dontSendNotification);
+                    refreshMixControls();
                     repaint();
                 };
 
@@ -371,8 +430,19 @@ MainComponent::MainComponent()
 
 MainComponent::~MainComponent()
 {
+    audioStartup.waitUntilDone();
+
+    // the working state comes back on the next launch (setting restoreSession)
+    if (appProps != nullptr && appProps->getUserSettings()->getBoolValue("restoreSession", true))
+        autosaveSession();
+
+    presetBank.setSampleSource(nullptr);   // the map it reads goes before the bank
+    sampleLoadPool.removeAllJobs(true, -1);   // a running decode finishes; it holds no lock the message thread needs
+    if (clockInPort != nullptr) clockInPort->stop();
+    deviceManager.removeMidiInputDeviceCallback({}, this);
     deviceManager.removeAudioCallback(&audioSourcePlayer);
     audioSourcePlayer.setSource(nullptr);
+    recorder.stop();
 
     // detach L&F from buttons before destruction
     loadKickBtn.setLookAndFeel(nullptr);
@@ -389,6 +459,7 @@ MainComponent::~MainComponent()
 
 void MainComponent::paint(juce::Graphics& g)
 {
+    if (!firstFrameTraced) { firstFrameTraced = true; StartupTrace::mark("first frame"); }
     
     g.fillAll(juce::Colours::black);
 
@@ -443,16 +514,11 @@ void MainComponent::paint(juce::Graphics& g)
             if (N < 3) continue;
             if (li >= audioCount) continue;
 
-            // 
+            // outline and vertex dots, prebuilt in rebuildLayerVerts
             g.setColour(juce::Colours::white.withAlpha(0.9f));
-            juce::Path p; p.startNewSubPath(L.verts[0]);
-            for (int i = 1; i < N; ++i) p.lineTo(L.verts[(size_t)i]);
-            p.closeSubPath();
-            g.strokePath(p, juce::PathStrokeType(2.0f));
-
-            // 
+            g.fillPath(L.outline);
             g.setColour(juce::Colours::darkgrey);
-            for (const auto& v : L.verts) g.fillEllipse(v.x - 3, v.y - 3, 6, 6);
+            g.fillPath(L.dots);
 
             // 
             const float R1 = 12.0f, R2 = 16.0f, T = 2.0f;
@@ -485,6 +551,40 @@ void MainComponent::paint(juce::Graphics& g)
                 g.setColour(juce::Colours::orange);
                 g.fillEllipse(P.x - 5, P.y - 5, 10, 10);
             }
+
+            // practice: mean timing per vertex of the active shape
+            // (labels where there's room, otherwise one dot per vertex, batched by colour)
+            if (practice.isEnabled() && li == activeLayer)
+            {
+                const bool asText = L.spacing >= practiceTextSpacing;
+                const juce::Colour colours[] = { juce::Colours::lightgreen, juce::Colours::orange, juce::Colours::red };
+                juce::Path marks[3];
+                g.setFont(juce::Font(12.0f));
+                for (int i = 0; i < N; ++i)
+                    if (const auto* st = practice.getStats(li, i))
+                    {
+                        const double ms = st->meanMs();
+                        const int band = std::abs(ms) < 10.0 ? 0 : std::abs(ms) < 25.0 ? 1 : 2;
+                        const auto v = L.verts[(size_t)i];
+                        if (!asText) { marks[band].addEllipse(v.x - 2.5f, v.y - 2.5f, 5.0f, 5.0f); continue; }
+
+                        g.setColour(colours[band]);
+                        g.drawText(juce::String(ms >= 0.0 ? "+" : "") + juce::String(ms, 0) + " ms (" + juce::String(st->hits) + ")",
+                                   juce::Rectangle<float>(v.x - 50.0f, v.y + 18.0f, 100.0f, 14.0f),
+                                   juce::Justification::centred, false);
+                    }
+                for (int b = 0; b < 3; ++b)
+                    if (!marks[b].isEmpty()) { g.setColour(colours[b]); g.fillPath(marks[b]); }
+            }
+        }
+
+        // vertex under the pointer (any shape)
+        if (hoverVertex.isValid() && hoverVertex.layer < layerCount
+            && hoverVertex.vertex < (int)layers[(size_t)hoverVertex.layer].verts.size())
+        {
+            const auto v = layers[(size_t)hoverVertex.layer].verts[(size_t)hoverVertex.vertex];
+            g.setColour(juce::Colours::white.withAlpha(hoverVertex.layer == activeLayer ? 0.8f : 0.5f));
+            g.drawEllipse(v.x - 8.0f, v.y - 8.0f, 16.0f, 16.0f, 1.5f);
         }
     }
     // (ASCII)
@@ -493,6 +593,27 @@ void MainComponent::paint(juce::Graphics& g)
     g.drawText("PolyRhythm - Multiple Concentric Shapes",
         getLocalBounds().reduced(10, 20),
         juce::Justification::centredTop , false);
+
+    if (bufferTuner.isRunning())
+    {
+        g.setColour(juce::Colours::grey);
+        g.setFont(juce::Font(13.0f));
+        g.drawText(bufferTuner.getStatus(), panelCenter.reduced(12, 8), juce::Justification::bottomLeft, true);
+    }
+    else if (!audioStartup.isOpen())
+    {
+        const bool failed = audioStartup.getState() == AudioStartup::State::failed;
+        g.setColour(failed ? juce::Colours::orange : juce::Colours::grey);
+        g.setFont(juce::Font(13.0f));
+        g.drawText(failed ? "No audio: " + audioStartup.getError() : juce::String("Opening audio device..."),
+                   panelCenter.reduced(12, 8), juce::Justification::bottomLeft, true);
+    }
+    else if (RealtimeGuard::isEnabled())
+    {
+        g.setColour(juce::Colours::grey);
+        g.setFont(juce::Font(13.0f));
+        g.drawText(RealtimeGuard::describe(), panelCenter.reduced(12, 8), juce::Justification::bottomLeft, true);
+    }
 }
 
 void MainComponent::resized()
@@ -533,6 +654,8 @@ void MainComponent::resized()
         fb.items.add(juce::FlexItem(modeToggle).withMinWidth(160).withMaxWidth(260).withHeight(ctlH).withFlex(1.0f));
         fb.items.add(juce::FlexItem(metToggle).withMinWidth(120).withMaxWidth(200).withHeight(ctlH));
         fb.items.add(juce::FlexItem(muteSubsToggle).withMinWidth(160).withMaxWidth(240).withHeight(ctlH));
+        fb.items.add(juce::FlexItem(extClockToggle).withMinWidth(140).withMaxWidth(200).withHeight(ctlH));
+        fb.items.add(juce::FlexItem(listenToggle).withMinWidth(80).withMaxWidth(120).withHeight(ctlH));
 
         fb.performLayout(top);
     }
@@ -571,6 +694,16 @@ void MainComponent::resized()
         downNoteLabel.setBounds(left.getX(), y, left.getWidth(), rowH); y += rowH + 2;
         downNoteBox.setBounds(left.getX(), y, left.getWidth(), rowH); y += rowH + gapY;
 
+        // routing
+        outputLabel.setBounds(left.getX(), y, left.getWidth(), rowH); y += rowH + 2;
+        outputBox.setBounds(left.getX(), y, left.getWidth(), rowH); y += rowH + gapY;
+
+        gainLabel.setBounds(left.getX(), y, left.getWidth(), rowH); y += rowH + 2;
+        gainSlider.setBounds(left.getX(), y, left.getWidth(), rowH); y += rowH + gapY;
+
+        panLabel.setBounds(left.getX(), y, left.getWidth(), rowH); y += rowH + 2;
+        panSlider.setBounds(left.getX(), y, left.getWidth(), rowH); y += rowH + gapY;
+
   
 
     }
@@ -606,11 +739,13 @@ void MainComponent::resized()
             bottom.getCentreY() - btnH / 2,
             bottom.getWidth(), btnH);
 
-        // Play / Stop (left)
-        auto leftRow = row.removeFromLeft(2 * btnW + gapX);
+        // Play / Stop / Record (left)
+        auto leftRow = row.removeFromLeft(3 * btnW + 2 * gapX);
         playButton.setBounds(leftRow.removeFromLeft(btnW));
         leftRow.removeFromLeft(gapX);
         stopButton.setBounds(leftRow.removeFromLeft(btnW));
+        leftRow.removeFromLeft(gapX);
+        recButton.setBounds(leftRow.removeFromLeft(btnW));
 
         // Sample loaders (right)
         auto rightRow = row.removeFromRight(4 * btnW + 3 * gapX);
@@ -669,17 +804,11 @@ void MainComponent::addNewLayer()
     src->setHostBeatsPerBar(4); 
 
 
-    // 3) 
-    if (!layersAudio.empty())
-        src->setTransportSamples(layersAudio[0]->getTransportSamples());
-   
-
-
-    // 4) 
-    mixer.addInputSource(src.get(), false);
+    // 3) join on the running grid of the first layer
+    engine.addLayer(src.get(), layersAudio.empty() ? nullptr : layersAudio[0].get());
     layersAudio.emplace_back(std::move(src));
 
-    // 5) 
+    // 4) 
     activeLayer = (int)layers.size() - 1;
 
     rebuildLayerVerts();
@@ -690,8 +819,9 @@ void MainComponent::removeActiveLayer()
     if (layers.size() <= 1)
         return; 
 
-    // 
-    mixer.removeInputSource(layersAudio[(size_t)activeLayer].get());
+    // the engine lets go of it with the next block
+    engine.removeLayer(layersAudio[(size_t)activeLayer].get());
+    retiredAudio.push_back(std::move(layersAudio[(size_t)activeLayer]));
 
     // 
     layersAudio.erase(layersAudio.begin() + activeLayer);
@@ -704,45 +834,704 @@ void MainComponent::removeActiveLayer()
     rebuildLayerVerts();
 }
 
-void MainComponent::mouseDown(const juce::MouseEvent& e)
+void MainComponent::refreshLayerCombo()
 {
-    if (layers.empty()) return;
-    auto& L = getActiveLayer();
-    auto* A = getActiveAudio();
-    if (L.verts.size() < 3) return;
+    layerSelect.clear();
+    for (int i = 0; i < (int)layers.size(); ++i)
+        layerSelect.addItem("Layer " + juce::String(i + 1), i + 1);
+    layerSelect.setSelectedId(activeLayer + 1, juce::dontSendNotification);
+    refreshMixControls();
+}
+
+void MainComponent::refreshMixControls()
+{
+    int numOut = 2;
+    if (auto* dev = getOpenDevice())
+        numOut = juce::jmax(1, dev->getActiveOutputChannels().countNumberOfSetBits());
+
+    outputBox.clear(juce::dontSendNotification);
+    for (int ch = 0; ch + 1 < numOut; ch += 2)
+        outputBox.addItem("Out " + juce::String(ch + 1) + "-" + juce::String(ch + 2), routeId(ch, 2));
+    for (int ch = 0; ch < numOut; ++ch)
+        outputBox.addItem("Out " + juce::String(ch + 1) + " (mono)", routeId(ch, 1));
+
+    if (layersAudio.empty()) return;
+
+    const auto* a = getActiveAudio();
+    outputBox.setSelectedId(routeId(a->outChannel, a->outWidth), juce::dontSendNotification);
+    gainSlider.setValue(juce::Decibels::gainToDecibels(a->outGain.load(), -60.0f), juce::dontSendNotification);
+    panSlider.setValue(a->outPan, juce::dontSendNotification);
+}
+
+// Message thread. Records whatever the device plays from now on, on all of
+// its active outputs, plus one mono file per layer if recordStems is set.
+void MainComponent::startRecording()
+{
+    auto* dev = getOpenDevice();
+    if (dev == nullptr) { recButton.setToggleState(false, juce::dontSendNotification); return; }
+
+    juce::File folder = juce::File::getSpecialLocation(juce::File::userMusicDirectory).getChildFile("Tri-Beat");
+    auto format = BounceRecorder::Format::wav;
+    bool stems = false;
+    if (appProps != nullptr)
+    {
+        auto* settings = appProps->getUserSettings();
+        folder = juce::File(settings->getValue("recordFolder", folder.getFullPathName()));
+        if (settings->getValue("recordFormat", "wav").equalsIgnoreCase("flac")) format = BounceRecorder::Format::flac;
+        stems = settings->getBoolValue("recordStems", false);
+    }
+    folder.createDirectory();
+
+    const auto name = "Tri-Beat " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S");
+    const int numOut = juce::jmax(1, dev->getActiveOutputChannels().countNumberOfSetBits());
+
+    if (!recorder.start(folder.getChildFile(name), format, dev->getCurrentSampleRate(), numOut,
+                        stems ? (int)layersAudio.size() : 0))
+    {
+        recButton.setToggleState(false, juce::dontSendNotification);
+        juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Record",
+            "Could not create a file in " + folder.getFullPathName());
+        return;
+    }
+    DBG("[Record] " << folder.getChildFile(name).getFullPathName());
+}
 
-    const auto pos = e.position;
-    int best = -1; float bestDist2 = std::numeric_limits<float>::max();
+void MainComponent::stopRecording()
+{
+    recorder.stop();   // flushes the queue to disk
+    recButton.setButtonText("Record");
+    recButton.setToggleState(false, juce::dontSendNotification);
+
+    if (const auto overruns = recorder.getOverruns(); overruns > 0)
+        juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Record",
+            "The disk could not keep up: " + juce::String(overruns)
+            + " block(s) were dropped from the recording. Playback was not affected.");
+}
 
-    for (int i = 0; i < (int)L.verts.size(); ++i)
+// Opens the practice input on the current device (or closes it again) and
+// compensates the round trip, so a hit in time with the click scores 0 ms.
+void MainComponent::setListening(bool on)
+{
+    int inputCh = 0;
+    double offsetMs = 0.0;
+    float thresholdDb = -30.0f;
+    if (appProps != nullptr)
     {
-        const float dx = pos.x - L.verts[(size_t)i].x;
-        const float dy = pos.y - L.verts[(size_t)i].y;
-        const float d2 = dx * dx + dy * dy;
-        if (d2 < bestDist2) { bestDist2 = d2; best = i; }
+        auto* settings = appProps->getUserSettings();
+        inputCh = juce::jmax(0, settings->getIntValue("practiceInput", 1) - 1);
+        offsetMs = settings->getDoubleValue("practiceLatencyMs", 0.0);
+        thresholdDb = (float)settings->getDoubleValue("practiceThresholdDb", -30.0);
     }
 
-    const float threshold2 = 14.0f * 14.0f;
-    if (best >= 0 && bestDist2 <= threshold2)
+    if (!audioStartup.isOpen())
+    {
+        listenToggle.setToggleState(false, juce::dontSendNotification);
+        return;
+    }
+
+    auto setup = deviceManager.getAudioDeviceSetup();
+    setup.useDefaultInputChannels = false;
+    setup.inputChannels.clear();
+    if (on) setup.inputChannels.setBit(inputCh);
+
+    const auto err = deviceManager.setAudioDeviceSetup(setup, true);
+    auto* dev = getOpenDevice();
+    if (on && (err.isNotEmpty() || dev == nullptr || dev->getActiveInputChannels().isZero()))
+    {
+        DBG("[Practice] no input: " << err);
+        listenToggle.setToggleState(false, juce::dontSendNotification);
+        practice.setEnabled(false);
+        return;
+    }
+
+    if (on && dev != nullptr)
+    {
+        const double sr = dev->getCurrentSampleRate();
+        practice.getDetector().setThresholdDb(thresholdDb);
+        practice.setLatencySamples(dev->getInputLatencyInSamples() + dev->getOutputLatencyInSamples()
+                                   + (int)std::lround(offsetMs * 0.001 * sr));
+        practice.resetStats();
+    }
+    practice.setEnabled(on);
+    repaint();
+}
+
+void MainComponent::loadOutputSettings()
+{
+    if (appProps == nullptr) return;
+    auto* settings = appProps->getUserSettings();
+
+    // 1-based, like the channel names in the Output box
+    metronome.outChannel = juce::jmax(0, settings->getIntValue("metronomeOutput", 1) - 1);
+    metronome.outWidth = juce::jlimit(1, 2, settings->getIntValue("metronomeOutputWidth", 2));
+
+    // master bus
+    engine.setMasterGainDb((float)settings->getDoubleValue("masterGainDb", 0.0));
+    engine.setLimiterEnabled(settings->getBoolValue("limiter", true));
+    engine.setLimiterCeilingDb((float)settings->getDoubleValue("limiterCeilingDb", -0.3));
+
+    // layers render on this many extra threads once there are parallelMinLayers
+    // of them; -1 = one per spare core, 0 = off
+    int threads = settings->getIntValue("renderThreads", 0);
+    if (threads < 0) threads = juce::SystemStats::getNumPhysicalCpus() - 1;
+    engine.setRenderThreads(threads, settings->getIntValue("parallelMinLayers", 32));
+}
+
+// ================= audio device =================
+
+void MainComponent::startAudio()
+{
+    std::unique_ptr<juce::XmlElement> cached;
+    juce::String backend;   // setting audioBackend: e.g. "JACK", "ALSA", "Windows Audio"
+    if (appProps != nullptr)
     {
-        if (e.mods.isShiftDown())
+        auto* settings = appProps->getUserSettings();
+        cached = settings->getXmlValue("audioDeviceState");
+        backend = settings->getValue("audioBackend");
+        if (cached != nullptr && backend.isNotEmpty() && !cached->getStringAttribute("deviceType").equalsIgnoreCase(backend))
+            cached.reset();
+
+        // headless runs and timing tests: no hardware, output to a WAV file
+        // (virtualAudioOutput) or nowhere, timing in the log on close
+        if (backend.equalsIgnoreCase(VirtualAudioDeviceType::typeName))
         {
-            L.downIndex = best;
-            L.downPhase01 = (double)best / (double)L.sides;
-            A->setDownbeatIndex(best);
+            VirtualAudioDevice::Options options;
+            options.memorySeconds = 0.0;   // nothing here reads a capture
+            if (const auto path = settings->getValue("virtualAudioOutput"); juce::File::isAbsolutePath(path))
+                options.outputFile = juce::File(path);
+            audioStartup.addDeviceType(std::make_unique<VirtualAudioDeviceType>(options));
+            cached = VirtualAudioDeviceType::createSetup(settings->getValue("virtualAudioPacing").equalsIgnoreCase("free"),
+                                                         settings->getDoubleValue("virtualAudioRate", 48000.0),
+                                                         settings->getIntValue("virtualAudioBufferSize", 256));
         }
-        else
+    }
+
+    juce::Component::SafePointer<MainComponent> safe(this);
+    audioStartup.start(deviceManager, LayerEngine::maxOutputs, std::move(cached), backend,
+                       [safe] { if (safe != nullptr) safe->audioOpened(); });
+}
+
+// Message thread, once the startup thread is done (device open or not).
+void MainComponent::audioOpened()
+{
+    StartupTrace::mark(audioStartup.isOpen() ? "audio device open" : "audio device failed");
+
+    deviceManager.addAudioCallback(&audioSourcePlayer);
+    // MIDI program change -> preset slot
+    deviceManager.addMidiInputDeviceCallback({}, this);
+
+    if (audioStartup.isOpen() && appProps != nullptr)
+    {
+        auto* settings = appProps->getUserSettings();
+        const auto tuned = BufferTuner::load(*settings, BufferTuner::deviceKey(deviceManager));
+        if (tuned.bufferSize > 0)
+        {
+            auto setup = deviceManager.getAudioDeviceSetup();
+            if (setup.bufferSize != tuned.bufferSize)
+            {
+                setup.bufferSize = tuned.bufferSize;
+                deviceManager.setAudioDeviceSetup(setup, true);
+            }
+            if ((int)layers.size() > tuned.layers)
+                DBG("[Tune] buffer was tuned for " << tuned.layers << " layer(s); press Ctrl+T to tune again");
+        }
+        else if (settings->getBoolValue("autoTuneBuffer", false))
+        {
+            startBufferTune();
+        }
+
+        // next launch opens this device directly
+        if (auto xml = AudioStartup::createCachedState(deviceManager))
+            settings->setValue("audioDeviceState", xml.get());
+    }
+
+    loadMidiOutputSettings();   // latency depends on the device
+    refreshMixControls();
+    restoreLastSession();       // samples need the device rate
+    repaint();
+}
+
+// Ctrl+T: steps the buffer size down while the pattern plays and keeps the
+// smallest one without dropouts for this device (see BufferTuner).
+void MainComponent::startBufferTune()
+{
+    if (!audioStartup.isOpen()) return;
+    if (bufferTuner.isRunning()) { bufferTuner.cancel(); repaint(); return; }
+
+    juce::Component::SafePointer<MainComponent> safe(this);
+    bufferTuner.start(deviceManager, engine, (int)layers.size(), [safe](const BufferTuner::Result& r)
+        {
+            if (safe == nullptr) return;
+            DBG("[Tune] settled on " << r.bufferSize << " samples for " << r.layers << " layer(s)");
+            if (safe->appProps != nullptr)
+            {
+                auto* settings = safe->appProps->getUserSettings();
+                BufferTuner::save(*settings, BufferTuner::deviceKey(safe->deviceManager), r);
+                if (auto xml = AudioStartup::createCachedState(safe->deviceManager))
+                    settings->setValue("audioDeviceState", xml.get());
+                settings->saveIfNeeded();
+            }
+            safe->applyMidiLatency();   // output latency changed; the port stays open
+            safe->repaint();
+        });
+}
+
+// ================= presets =================
+
+PatternPreset MainComponent::captureCurrentPattern() const
+{
+    PatternPreset p;
+    p.bpm = bpmSlider.getValue();
+    p.polyrhythm = modeToggle.getToggleState();
+    p.muteSubdivisions = muteSubsToggle.getToggleState();
+
+    for (size_t i = 0; i < layers.size() && i < layersAudio.size(); ++i)
+    {
+        const auto& L = layers[i];
+        const auto& A = *layersAudio[i];
+
+        LayerPreset l;
+        l.sides = L.sides;
+        l.upIndex = L.upIndex;
+        l.downIndex = L.downIndex;
+        l.upFreqHz = A.upFreqHz;
+        l.downFreqHz = A.downFreqHz;
+        l.kickPath = L.kickPath;
+        l.snarePath = L.snarePath;
+        l.hihatPath = L.hihatPath;
+        l.outChannel = A.outChannel;
+        l.outWidth = A.outWidth;
+        l.gainDb = juce::Decibels::gainToDecibels(A.outGain.load(), -60.0f);
+        l.pan = A.outPan;
+        p.layers.push_back(std::move(l));
+    }
+    return p;
+}
+
+void MainComponent::storePreset(int slot)
+{
+    presetBank.setPreset(slot, captureCurrentPattern());
+    savePresetBank();
+}
+
+void MainComponent::adoptSwitchedSlot(int slot)
+{
+    PatternPreset p;
+    auto voices = presetBank.takeVoices(slot, p);
+    if (voices.empty()) return;
+
+    // The engine already renders the new voices; the old ones may still be
+    // fading out, so keep them alive until the engine lets go of them.
+    for (auto& a : layersAudio) retiredAudio.push_back(std::move(a));
+    layersAudio = std::move(voices);
+
+    showPattern(p);
+
+    // make the slot recallable again
+    presetBank.reload(slot);
+}
+
+// Rebuilds the per-layer UI state and the transport controls from `p`,
+// whose voices are already in layersAudio.
+void MainComponent::showPattern(const PatternPreset& p)
+{
+    layers.clear();
+    for (const auto& l : p.layers)
+    {
+        LayerState st;
+        st.sides = l.sides;
+        st.upIndex = l.upIndex;
+        st.downIndex = l.downIndex;
+        st.upPhase01 = (l.upIndex >= 0 ? (double)l.upIndex / (double)l.sides : -1.0);
+        st.downPhase01 = (l.downIndex >= 0 ? (double)l.downIndex / (double)l.sides : -1.0);
+        st.kickPath = l.kickPath;
+        st.snarePath = l.snarePath;
+        st.hihatPath = l.hihatPath;
+        layers.push_back(std::move(st));
+    }
+    activeLayer = 0;
+
+    bpmSlider.setValue(p.bpm, juce::dontSendNotification);
+    modeToggle.setToggleState(p.polyrhythm, juce::dontSendNotification);
+    muteSubsToggle.setToggleState(p.muteSubdivisions, juce::dontSendNotification);
+    if (!layers.empty())
+        sidesValue.setText(juce::String(layers[0].sides), juce::dontSendNotification);
+
+    refreshLayerCombo();
+    rebuildLayerVerts();
+    repaint();
+}
+
+// ================= sessions =================
+
+juce::File MainComponent::getAutosaveFile() const
+{
+    if (appProps == nullptr) return {};
+    return appProps->getUserSettings()->getFile().getSiblingFile(juce::String("Last Session") + SessionFile::extension);
+}
+
+Session MainComponent::captureSession(bool withSamples) const
+{
+    Session s;
+    s.pattern = captureCurrentPattern();
+    s.presetBank = presetBank.toValueTree();
+    s.activeLayer = activeLayer;
+
+    if (withSamples)
+    {
+        s.sampleRate = presetBank.getSampleRate();
+        for (size_t i = 0; i < layers.size() && i < layersAudio.size(); ++i)
         {
-            L.upIndex = best;
-            L.upPhase01 = (double)best / (double)L.sides;
-            A->setUpbeatIndex(best);
+            const juce::String* paths[] = { &layers[i].kickPath, &layers[i].snarePath, &layers[i].hihatPath };
+            for (int role = 0; role < 3; ++role)
+                if (auto& src = layersAudio[i]->getOneShot(role).source; src != nullptr && paths[role]->isNotEmpty())
+                    s.samples[*paths[role]] = src;
         }
-        repaint();
     }
+    return s;
+}
+
+bool MainComponent::saveSession(const juce::File& file, bool bundle)
+{
+    const auto s = captureSession(bundle);
+
+    const auto t0 = juce::Time::getMillisecondCounterHiRes();
+    const bool ok = SessionFile::save(file, s);
+    DBG("[Session] saved " << file.getFullPathName() << ", " << (int)s.samples.size() << " sample(s) bundled, "
+        << juce::String(juce::Time::getMillisecondCounterHiRes() - t0, 1) << " ms");
+    return ok;
+}
+
+juce::File MainComponent::getAutosaveBundleFile() const
+{
+    const auto f = getAutosaveFile();
+    return f == juce::File() ? f : f.getSiblingFile(f.getFileNameWithoutExtension() + " Samples" + SessionFile::extension);
+}
+
+// On quit. The samples (unless the setting sessionBundle is off) live in a
+// sibling bundle that is only rewritten when the set of loaded samples has
+// changed since it was last written or read.
+void MainComponent::autosaveSession()
+{
+    const auto file = getAutosaveFile(), bundleFile = getAutosaveBundleFile();
+    if (file == juce::File()) return;
+
+    auto s = captureSession(appProps->getUserSettings()->getBoolValue("sessionBundle", true));
+    const auto t0 = juce::Time::getMillisecondCounterHiRes();
+
+    const bool unchanged = bundleFile.existsAsFile() && s.samples.size() == autosavedSamples.size()
+        && std::all_of(s.samples.begin(), s.samples.end(), [this](const auto& e)
+            {
+                const auto it = autosavedSamples.find(e.first);
+                return it != autosavedSamples.end() && it->second.lock() == e.second;
+            });
+
+    bool rewritten = false;
+    if (s.samples.empty())
+    {
+        bundleFile.deleteFile();
+        autosavedSamples.clear();
+    }
+    else if (!unchanged)
+    {
+        Session samplesOnly;
+        samplesOnly.samples = s.samples;
+        samplesOnly.sampleRate = s.sampleRate;
+        rewritten = SessionFile::save(bundleFile, samplesOnly);
+        autosavedSamples.clear();
+        if (rewritten)
+            for (const auto& [spec, buf] : s.samples) autosavedSamples[spec] = buf;
+    }
+
+    // if the bundle couldn't be written the samples go into the autosave itself
+    if (!s.samples.empty() && (unchanged || rewritten))
+        s.sampleBundle = bundleFile.getFileName();
+
+    SessionFile::save(file, s);
+    DBG("[Session] autosaved, " << (int)s.samples.size() << " sample(s) "
+        << (s.sampleBundle.isEmpty() ? "bundled" : rewritten ? "in a new bundle" : "in the unchanged bundle") << ", "
+        << juce::String(juce::Time::getMillisecondCounterHiRes() - t0, 1) << " ms");
+}
+
+bool MainComponent::openSession(const juce::File& file)
+{
+    const double sr = presetBank.getSampleRate();
+    const auto t0 = juce::Time::getMillisecondCounterHiRes();
+
+    Session s;
+    if (!SessionFile::load(file, s, sr) || s.pattern.isEmpty()) return false;
+    const auto& p = s.pattern;
+
+    // keep the transport running where it is: the old first layer stays
+    // alive in retiredAudio, and once removed its transport no longer moves
+    const ClickAudioSource* previous = layersAudio.empty() ? nullptr : layersAudio[0].get();
+    const bool wasPlaying = previous != nullptr && previous->isPlaying();
+
+    for (auto& a : layersAudio)
+    {
+        engine.removeLayer(a.get());
+        retiredAudio.push_back(std::move(a));
+    }
+    layersAudio.clear();
+
+    for (const auto& l : p.layers)
+    {
+        if ((int)layersAudio.size() == LayerEngine::maxLayers) break;
+        auto v = PresetBank::createVoice(p, l);
+        v->setPlaying(wasPlaying);
+        engine.addLayer(v.get(), previous);
+        layersAudio.push_back(std::move(v));
+    }
+    engine.post([this, bpm = p.bpm] { metronome.setTempo(bpm); });
+    showPattern(p);
+
+    // bundled samples apply at once, to the layers and to the preset slots
+    // (through the bank's sample source); anything else is decoded in the
+    // background
+    {
+        const juce::ScopedLock sl(loadedSamplesLock);
+        for (const auto& [spec, buf] : s.samples)
+            loadedSamples[spec + "@" + juce::String(sr)] = buf;
+    }
+    if (file == getAutosaveFile())
+    {
+        autosavedSamples.clear();
+        if (s.sampleBundle.isNotEmpty())
+            for (const auto& [spec, buf] : s.samples) autosavedSamples[spec] = buf;
+    }
+
+    if (s.presetBank.isValid())
+    {
+        presetBank.setFromValueTree(s.presetBank);
+        savePresetBank();
+    }
+
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        const juce::String* paths[] = { &layers[i].kickPath, &layers[i].snarePath, &layers[i].hihatPath };
+        for (int role = 0; role < 3; ++role)
+            if (paths[role]->isNotEmpty())
+                loadSample(layersAudio[i].get(), role, *paths[role]);
+    }
+
+    activeLayer = juce::jlimit(0, (int)layers.size() - 1, s.activeLayer);
+    refreshLayerCombo();
+    repaint();
+
+    DBG("[Session] opened " << file.getFullPathName() << ": " << (int)layers.size() << " layer(s), "
+        << (int)s.samples.size() << " bundled sample(s), "
+        << juce::String(juce::Time::getMillisecondCounterHiRes() - t0, 1) << " ms");
+    return true;
+}
+
+// Ctrl+S / Ctrl+O. Samples are bundled unless the setting sessionBundle is off.
+void MainComponent::chooseSessionFile(bool forSaving)
+{
+    auto chooser = std::make_shared<juce::FileChooser>(forSaving ? "Save session..." : "Open session...",
+        juce::File::getSpecialLocation(juce::File::userDocumentsDirectory), juce::String("*") + SessionFile::extension);
+
+    const int flags = forSaving ? juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::warnAboutOverwriting
+                                : juce::FileBrowserComponent::openMode;
+    chooser->launchAsync(flags | juce::FileBrowserComponent::canSelectFiles, [this, chooser, forSaving](const juce::FileChooser& fc)
+        {
+            auto file = fc.getResult();
+            if (file == juce::File()) return;
+
+            if (forSaving)
+            {
+                const bool bundle = appProps == nullptr || appProps->getUserSettings()->getBoolValue("sessionBundle", true);
+                if (!saveSession(file.withFileExtension(SessionFile::extension), bundle))
+                    juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Session",
+                        "Could not write " + file.getFullPathName());
+            }
+            else if (!openSession(file))
+            {
+                juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Session",
+                    file.getFileName() + " is not a Tri-Beat session or is damaged.");
+            }
+        });
+}
+
+void MainComponent::loadPresetBank()
+{
+    if (appProps == nullptr) return;
+    auto* settings = appProps->getUserSettings();
+
+    engine.setCrossfadeMs(settings->getDoubleValue("presetCrossfadeMs", 0.0));
+
+    sampleOptions = SampleLoader::optionsFrom(*settings);
+    presetBank.setSampleOptions(sampleOptions);
+
+    if (auto xml = settings->getXmlValue("presetBank"))
+        presetBank.setFromValueTree(juce::ValueTree::fromXml(*xml));
+}
+
+void MainComponent::loadMidiOutputSettings()
+{
+    if (appProps == nullptr) return;
+    auto* settings = appProps->getUserSettings();
+
+    applyMidiLatency();
+    midiOut.setClockEnabled(settings->getBoolValue("midiClock", false));
+    midiOut.open(settings->getValue("midiOutput"));
+
+   #if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+    if (settings->getValue("midiClockInput") == "virtual" && clockInPort == nullptr)
+    {
+        clockInPort = juce::MidiInput::createNewDevice("Tri-Beat Clock In", this);
+        if (clockInPort != nullptr) clockInPort->start();
+    }
+   #endif
+}
+
+// Device output latency + engine look-ahead + the user's offset, for the
+// notes going out and the clock coming in. Safe while the port is open.
+void MainComponent::applyMidiLatency()
+{
+    if (appProps == nullptr) return;
+
+    double latencyMs = appProps->getUserSettings()->getDoubleValue("midiOffsetMs", 0.0);
+    if (auto* dev = getOpenDevice())
+        if (dev->getCurrentSampleRate() > 0.0)
+            latencyMs += 1000.0 * (double)(dev->getOutputLatencyInSamples() + engine.getLatencySamples()) / dev->getCurrentSampleRate();
+
+    midiOut.setLatencyMs(latencyMs);
+    clockFollower.setLatencyMs(latencyMs);
+}
+
+void MainComponent::savePresetBank()
+{
+    if (appProps == nullptr) return;
+
+    auto* settings = appProps->getUserSettings();
+    if (auto xml = presetBank.toValueTree().createXml())
+        settings->setValue("presetBank", xml.get());
+    settings->saveIfNeeded();
+}
+
+void MainComponent::mouseDown(const juce::MouseEvent& e)
+{
+    dragLayer = -1;
+    const auto hit = vertexGrid.find(e.position, hitRadius, -1, activeLayer);
+    if (!hit.isValid() || hit.layer >= (int)layersAudio.size()) return;
+
+    if (hit.layer != activeLayer)
+        layerSelect.setSelectedId(hit.layer + 1, juce::sendNotificationSync);
+
+    dragLayer = hit.layer;
+    dragDownbeat = e.mods.isShiftDown();
+    setAccent(hit.layer, dragDownbeat, hit.vertex);
+    setHover(hit);
+}
+
+void MainComponent::mouseDrag(const juce::MouseEvent& e)
+{
+    if (!juce::isPositiveAndBelow(dragLayer, (int)layers.size())) return;
+
+    // follow the pointer round the shape, snapping to its nearest vertex
+    const auto& L = layers[(size_t)dragLayer];
+    const float reach = juce::jmax(hitRadius, L.spacing);
+    const auto hit = vertexGrid.find(e.position, reach, dragLayer);
+    if (!hit.isValid()) return;
+
+    const int current = dragDownbeat ? L.downIndex : L.upIndex;
+    if (hit.vertex != current) setAccent(dragLayer, dragDownbeat, hit.vertex);
+    setHover(hit);
+}
+
+void MainComponent::mouseUp(const juce::MouseEvent& e)
+{
+    dragLayer = -1;
+    setHover(vertexGrid.find(e.position, hitRadius, -1, activeLayer));
+}
+
+void MainComponent::mouseMove(const juce::MouseEvent& e)
+{
+    setHover(vertexGrid.find(e.position, hitRadius, -1, activeLayer));
+}
+
+void MainComponent::mouseExit(const juce::MouseEvent&)
+{
+    setHover({});
+}
+
+void MainComponent::setHover(const VertexGrid::Hit& h)
+{
+    if (h == hoverVertex) return;
+    hoverVertex = h;
+    setMouseCursor(h.isValid() ? juce::MouseCursor::PointingHandCursor : juce::MouseCursor::NormalCursor);
+    repaint(panelCenter);
+}
+
+void MainComponent::setAccent(int layer, bool downbeat, int vertex)
+{
+    auto& L = layers[(size_t)layer];
+    auto* A = layersAudio[(size_t)layer].get();
+
+    if (downbeat)
+    {
+        L.downIndex = vertex;
+        L.downPhase01 = (double)vertex / (double)L.sides;
+    }
+    else
+    {
+        L.upIndex = vertex;
+        L.upPhase01 = (double)vertex / (double)L.sides;
+    }
+    engine.post([A, downbeat, vertex]
+        {
+            if (downbeat) A->setDownbeatIndex(vertex);
+            else          A->setUpbeatIndex(vertex);
+        });
+    repaint();
 }
 
 void MainComponent::timerCallback()
 {
+    if (!firstCallbackTraced && engine.getFirstBlockTime() > 0.0)
+    {
+        firstCallbackTraced = true;
+        StartupTrace::mark("first audio callback", engine.getFirstBlockTime());
+    }
+
+    const int switched = presetBank.takeCompletedSwitch();
+    if (switched >= 0)
+        adoptSwitchedSlot(switched);
+
+    if (!retiredAudio.empty() && engine.isFadeIdle())
+        retiredAudio.clear();
+
+    if (clockFollower.isEnabled())
+        bpmSlider.setValue(clockFollower.getBpm(), juce::dontSendNotification);
+
+    if (practice.isEnabled() && practice.collect() > 0)
+    {
+        const auto h = practice.getLastHit();
+        DBG("[Practice] layer " << (h.layer + 1) << " vertex " << (h.vertex + 1) << ": " << h.errorMs << " ms");
+    }
+
+    if (recorder.isRecording())
+    {
+        double sr = 0.0;
+        if (auto* dev = getOpenDevice()) sr = dev->getCurrentSampleRate();
+        const int secs = (int)recorder.getSecondsWritten(sr);
+        recButton.setButtonText(juce::String::formatted("Rec %d:%02d", secs / 60, secs % 60));
+    }
+
+    if (++statsTicks >= 60 * 5)
+    {
+        statsTicks = 0;
+        const auto& vp = engine.getVoicePool();
+        DBG("[Voices] started=" << vp.getStartedCount() << " merged=" << vp.getMergedCount()
+            << " peak=" << vp.getPeakVoices());
+
+        if (midiOut.isOpen())
+        {
+            const auto js = midiOut.getJitterStats();
+            DBG("[MIDI] sent=" << js.count << " dropped=" << js.dropped
+                << " jitter mean=" << js.meanMs << "ms max=" << js.maxMs << "ms");
+        }
+    }
 
    // const double barPhase = clickSource.getBarPhase01();
    // updateMovingDot(barPhase);
@@ -750,7 +1539,7 @@ void MainComponent::timerCallback()
 }
 void MainComponent::setSides(int n)
 {
-    n = juce::jlimit(3, 16, n);
+    n = juce::jlimit(3, ClickAudioSource::maxSteps, n);
     if (n == sides) return;
 
     bool hadUp = (upPhase01 >= 0.0);
@@ -784,37 +1573,41 @@ void MainComponent::setSides(int n)
 }
 void MainComponent::setSidesForActive(int n)
 {
-    n = juce::jlimit(3, 16, n);
+    n = juce::jlimit(3, ClickAudioSource::maxSteps, n);
     auto& L = getActiveLayer();
     auto* A = getActiveAudio();
 
     if (n == L.sides) return;   
 
    
-    if (L.upPhase01 >= 0.0) {
+    const bool mapUp = L.upPhase01 >= 0.0, mapDown = L.downPhase01 >= 0.0;
+    if (mapUp) {
         int mapped = (int)std::round(L.upPhase01 * n);
         if (mapped == n) mapped = 0;
         L.upIndex = juce::jlimit(0, n - 1, mapped);
-        A->setUpbeatIndex(L.upIndex);
     }
-    if (L.downPhase01 >= 0.0) {
+    if (mapDown) {
         int mapped = (int)std::round(L.downPhase01 * n);
         if (mapped == n) mapped = 0;
         L.downIndex = juce::jlimit(0, n - 1, mapped);
-        A->setDownbeatIndex(L.downIndex);
     }
 
     L.sides = n;
 
-    
-    const bool isPoly = modeToggle.getToggleState();
-    if (isPoly) A->setSubdivisions(n);
-    else        A->setBeatsPerBar(n);
+    // the layer takes its new shape in one block
+    engine.post([A, n, mapUp, mapDown, up = L.upIndex, down = L.downIndex, isPoly = modeToggle.getToggleState()]
+        {
+            if (mapUp)   A->setUpbeatIndex(up);
+            if (mapDown) A->setDownbeatIndex(down);
 
-    if (layersAudio[activeLayer]->isPlaying())
-    {
-        layersAudio[activeLayer]->restart();
-    }
+            if (isPoly) A->setSubdivisions(n);
+            else        A->setBeatsPerBar(n);
+
+            if (A->isPlaying())
+            {
+                A->restart();
+            }
+        });
 
     sidesValue.setText(juce::String(n), juce::dontSendNotification);
 
@@ -834,19 +1627,34 @@ void MainComponent::rebuildLayerVerts()
     for (int li = 0; li < (int)layers.size(); ++li)
     {
         auto& L = layers[(size_t)li];
-        L.verts.clear();
         const int N = juce::jmax(3, L.sides);
-
         const float R = baseR + li * stepR;
-        const float start = -juce::MathConstants<float>::halfPi; 
-
-        L.verts.reserve((size_t)N);
-        for (int k = 0; k < N; ++k)
-        {
-            const float ang = start + juce::MathConstants<float>::twoPi * (float)k / (float)N;
-            L.verts.push_back(c + juce::Point<float>(std::cos(ang), std::sin(ang)) * R);
-        }
+        if (N == L.placedSides && R == L.placedRadius && c == L.placedCentre) continue;
+
+        unitPolygons.place(N, c, R, L.verts);
+        L.placedSides = N;
+        L.placedRadius = R;
+        L.placedCentre = c;
+
+        juce::Path poly;
+        poly.startNewSubPath(L.verts[0]);
+        for (int k = 1; k < N; ++k) poly.lineTo(L.verts[(size_t)k]);
+        poly.closeSubPath();
+        L.outline.clear();
+        juce::PathStrokeType(2.0f).createStrokedPath(L.outline, poly);
+
+        L.spacing = L.verts[0].getDistanceFrom(L.verts[1]);
+        const float dot = L.spacing >= fullDotSpacing ? 3.0f : L.spacing >= smallDotSpacing ? 1.5f : 0.0f;
+        L.dots.clear();
+        if (dot > 0.0f)
+            for (const auto& v : L.verts) L.dots.addEllipse(v.x - dot, v.y - dot, 2.0f * dot, 2.0f * dot);
     }
+
+    vertexGrid.begin(panelCenter.toFloat(), hitRadius);
+    for (int li = 0; li < (int)layers.size(); ++li)
+        vertexGrid.add(li, layers[(size_t)li].verts);
+    vertexGrid.end();
+    setHover({});
 }
 
 double MainComponent::getLayerBarPhase01(int li) const
@@ -855,20 +1663,67 @@ double MainComponent::getLayerBarPhase01(int li) const
     return layersAudio[(size_t)li]->getPhase01();
 }
 
-void MainComponent::loadOneShotFromFile(ClickAudioSource::OneShot& dst, const juce::File& file)
+void MainComponent::loadSample(ClickAudioSource* target, int role, const juce::String& spec)
 {
-    if (!file.existsAsFile()) return;
+    auto apply = [this, target, role](ClickAudioSource::SampleData data) { applySample(target, role, std::move(data)); };
 
-    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
-    if (!reader) return;
+    // layers loading the same file(s) share the buffer, so their hits can merge
+    const double sr = presetBank.getSampleRate();
+    const auto key = spec + "@" + juce::String(sr);
+    if (const auto it = loadedSamples.find(key); it != loadedSamples.end())
+        if (auto data = it->second.lock()) { apply(std::move(data)); return; }
 
-    const int numSamples = (int)reader->lengthInSamples;
-    const int numCh = juce::jlimit(1, (int)reader->numChannels, 2);
+    juce::Component::SafePointer<MainComponent> safe(this);
+    const auto opts = sampleOptions;
+    sampleLoadPool.addJob([this, safe, apply, spec, key, sr, opts]
+        {
+            auto data = SampleLoader::load(formatManager, spec, sr, opts);
+            if (data == nullptr) return;
 
-    juce::AudioBuffer<float> temp(numCh, numSamples);
-    reader->read(&temp, 0, numSamples, 0, true, true);
+            juce::MessageManager::callAsync([safe, apply, key, data]
+                {
+                    if (safe == nullptr) return;
+                    {
+                        const juce::ScopedLock sl(safe->loadedSamplesLock);
+                        safe->loadedSamples[key] = data;
+                    }
+                    apply(data);
+                });
+        });
+}
+
+// Plays `original` on the layer at the pitch its note selectors ask for. A
+// copy that isn't cached yet is rendered in the background; the layer keeps
+// its current sound until then.
+void MainComponent::applySample(ClickAudioSource* target, int role, ClickAudioSource::SampleData original)
+{
+    if (std::none_of(layersAudio.begin(), layersAudio.end(), [target](const auto& a) { return a.get() == target; }))
+        return;
 
-    dst.setSample(std::move(temp));
+    const auto slot = std::make_pair(target, role);
+    const int request = ++sampleRequests[slot];   // a later note or sample supersedes this one
+    auto& shot = target->getOneShot(role);
+    const double semis = target->getSampleSemitones(role);
+
+    if (original == nullptr) { engine.setSample(shot, nullptr); return; }
+    if (auto data = pitchCache.get(original, semis, false))
+    {
+        engine.setSample(shot, std::move(data), std::move(original));
+        return;
+    }
+
+    juce::Component::SafePointer<MainComponent> safe(this);
+    sampleLoadPool.addJob([this, safe, slot, request, original, semis]
+        {
+            auto data = pitchCache.get(original, semis);
+            juce::MessageManager::callAsync([safe, slot, request, original, data]
+                {
+                    if (safe == nullptr || safe->sampleRequests[slot] != request) return;
+                    for (auto& a : safe->layersAudio)
+                        if (a.get() == slot.first)
+                            safe->engine.setSample(a->getOneShot(slot.second), data, original);
+                });
+        });
 }
 
 void MainComponent::updatePolygon()
@@ -877,18 +1732,7 @@ void MainComponent::updatePolygon()
     const auto c = drawArea.getCentre();
     const float radius = std::min(drawArea.getWidth(), drawArea.getHeight()) * 0.38f;
 
-    verts.clear();
-    verts.reserve((size_t)sides);
-
-    const float startRot = -juce::MathConstants<float>::halfPi; 
-
-    for (int k = 0; k < sides; ++k)
-    {
-        const float angle = startRot + juce::MathConstants<float>::twoPi * (float)k / (float)sides;
-        verts.push_back(c + juce::Point<float>(std::cos(angle), std::sin(angle)) * radius);
-    }
-
-    
+    unitPolygons.place(sides, c, radius, verts);
     if (!verts.empty())
         movingDot = verts[0];
 }
@@ -938,9 +1782,39 @@ bool MainComponent::keyPressed(const juce::KeyPress& key)
         showQuickTour(true);  // reset flag and open tour
         return true;
     }
+
+    // 1-8 recall a preset at the next bar, Ctrl/Cmd+1-8 stores the current groove
+    const int code = key.getKeyCode();
+    if (code >= '1' && code < '1' + PresetBank::numSlots)
+    {
+        const int slot = code - '1';
+        if (key.getModifiers().isCommandDown()) storePreset(slot);
+        else                                    presetBank.requestSlot(slot);
+        return true;
+    }
+
+    const auto letter = juce::CharacterFunctions::toUpperCase((juce::juce_wchar)code);
+    if (key.getModifiers().isCommandDown() && (letter == 'S' || letter == 'O'))
+    {
+        chooseSessionFile(letter == 'S');
+        return true;
+    }
+    if (key.getModifiers().isCommandDown() && letter == 'T')
+    {
+        startBufferTune();
+        return true;
+    }
     return false;
 }
 
+void MainComponent::handleIncomingMidiMessage(juce::MidiInput*, const juce::MidiMessage& m)
+{
+    clockFollower.handleMessage(m);
+
+    if (m.isProgramChange())
+        presetBank.requestSlot(m.getProgramChangeNumber());
+}
+
 void MainComponent::showQuickTour(bool resetFlag)
 {
     if (appProps && resetFlag)
@@ -958,9 +1832,11 @@ void MainComponent::updateTriangle()
     const auto c = drawArea.getCentre();
     const float radius = std::min(drawArea.getWidth(), drawArea.getHeight()) * 0.38f;
 
-    tri[0] = { c.x,                 c.y - radius };
-    tri[1] = { c.x - radius * 0.866f, c.y + radius * 0.5f };
-    tri[2] = { c.x + radius * 0.866f, c.y + radius * 0.5f };
+    // the same table as a 3-sided polygon, listed counterclockwise
+    const auto& unit = unitPolygons.get(3);
+    tri[0] = c + unit[0] * radius;
+    tri[1] = c + unit[2] * radius;
+    tri[2] = c + unit[1] * radius;
 
     movingDot = tri[0];
 }
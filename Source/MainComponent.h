@@ -1,355 +1,22 @@
 ﻿#pragma once
 #include <JuceHeader.h>
 #include <juce_audio_formats/juce_audio_formats.h>
+#include "ClickAudioSource.h"
+#include "LayerEngine.h"
+#include "PresetBank.h"
+#include "MidiTriggerOutput.h"
+#include "MidiClockFollower.h"
+#include "BounceRecorder.h"
+#include "PracticeMonitor.h"
+#include "PitchCache.h"
+#include "SessionFile.h"
+#include "AudioStartup.h"
+#include "BufferTuner.h"
+#include "RealtimeGuard.h"
+#include "VertexGrid.h"
+#include "UnitPolygons.h"
 
 
-// --- MetronomeSource: 4/4  play/stop/seek ---
-struct MetronomeSource : public juce::AudioSource
-{
-    // timing
-    double  sampleRate = 48000.0;
-    double  bpm = 120.0;
-    double  samplesPerBeat = 48000.0 * 60.0 / 120.0;
-    int     beatsPerBar = 4;
-
-    // transport
-    int64_t transportSamples = 0;
-    int64_t lastBeatIndex = -1;
-    bool    playing = true;
-
-    // tiny click synth
-    struct ClickSynth {
-        double sr = 48000.0, freq = 1200.0, phase = 0.0, inc = 0.0, env = 0.0, decay = 0.995;
-        float  gain = 1.0f;
-        void prepare(double s) { sr = s; setFreq(freq); env = 0.0; }
-        void setFreq(double f) { freq = f; inc = juce::MathConstants<double>::twoPi * freq / sr; }
-        void trigger(float g) { env = 1.0; gain = g; }
-        float next() {
-            float s = (float)std::sin(phase) * (float)env * gain;
-            phase += inc; if (phase >= juce::MathConstants<double>::twoPi) phase -= juce::MathConstants<double>::twoPi;
-            env *= decay; if (env < 1.0e-4) env = 0.0; return s;
-        }
-    } click;
-
-    // tones
-    double downHz = 1000.0, upHz = 1500.0;
-    float  downGain = 1.0f, upGain = 0.9f;
-
-    // API
-    void setTempo(double b) { bpm = b; samplesPerBeat = sampleRate * 60.0 / juce::jmax(1.0, b); }
-    void setBeatsPerBar(int n) { beatsPerBar = juce::jlimit(1, 64, n); }
-    void setPlaying(bool b) { playing = b; }
-    bool isPlaying() const { return playing; }
-    void resetTransport() { transportSamples = 0; lastBeatIndex = -1; }
-
-    // AudioSource
-    void prepareToPlay(int /*block*/, double sr) override
-    {
-        sampleRate = sr; setTempo(bpm); click.prepare(sr); lastBeatIndex = -1;
-    }
-
-    void releaseResources() override {}
-
-    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
-    {
-        auto* buffer = info.buffer; if (!buffer) return;
-
-        buffer->clear(info.startSample, info.numSamples);
-        if (!playing) return;
-
-        auto* L = buffer->getWritePointer(0, info.startSample);
-        auto* R = (buffer->getNumChannels() > 1 ? buffer->getWritePointer(1, info.startSample) : nullptr);
-
-        for (int i = 0;i < info.numSamples;++i)
-        {
-            const int64_t beatIdx = (samplesPerBeat > 0.0 ? (int64_t)std::floor((double)transportSamples / samplesPerBeat) : 0);
-            if (beatIdx != lastBeatIndex)
-            {
-                lastBeatIndex = beatIdx;
-                const int which = (int)(beatIdx % (int64_t)juce::jmax(1, beatsPerBar));
-                const bool isDown = (which == 0);
-                click.setFreq(isDown ? downHz : upHz);
-                click.trigger(isDown ? downGain : upGain);
-            }
-            const float s = click.next();
-            L[i] = s; if (R) R[i] = s;
-            ++transportSamples;
-        }
-    }
-};
-
-
-
-struct ClickSynth
-{
-    void prepare (double sr)
-    {
-        sampleRate = sr;
-        phase = 0.0;
-        env = 0.0;
-        setFrequency (clickFreqHz);
-    }
-
-    void setFrequency (double hz)
-    {
-        clickFreqHz = hz;
-        phaseInc = juce::MathConstants<double>::twoPi * clickFreqHz / sampleRate;
-    }
-
-    void trigger (float gain = 1.0f)   
-    {
-        env = 1.0;
-        hitGain = juce::jlimit (0.0f, 4.0f, gain);
-    }
-
-    inline float getNextSample()
-    {
-        float s = (float) std::sin (phase) * (float) env;
-        phase += phaseInc;
-        if (phase >= juce::MathConstants<double>::twoPi)
-            phase -= juce::MathConstants<double>::twoPi;
-
-        env *= envDecay;
-        if (env < 1.0e-4) env = 0.0;
-
-        return s * baseGain * hitGain;  
-    }
-
-    double sampleRate = 48000.0;
-    double clickFreqHz = 1400.0;
-    double phase = 0.0, phaseInc = 0.0;
-    double env = 0.0, envDecay = 0.995;
-    float  baseGain = 0.25f;      
-    float  hitGain  = 1.0f;      
-};
-
-
-
-// =========== ClickAudioSource.h ===========
-struct ClickAudioSource : public juce::AudioSource
-{
-    // ===== timing & mode =====
-    double sampleRate = 48000.0, bpm = 120.0, samplesPerBeat = 48000.0 * 60.0 / 120.0;
-    int64_t transportSamples = 0;
-    bool    polyrhythm = true;
-    int     subdivisions = 3;     
-    int     beatsPerBar = 3;       
-    int     hostBeatsPerBar = 4;   
-
-    // ===== state =====
-    int64_t stepSamps = 1, stepCountdown = 1;
-    int     stepIndex = -1;
-    int64_t lastBeatIndex = -1;
-    bool    playing = true;
-
-    // ===== accents =====
-    int upIndex = -1, downIndex = -1;
-
-    // ===== tiny click synth (fallback) =====
-    struct ClickSynth {
-        double sr = 48000.0, freq = 1200.0, phase = 0.0, inc = 0.0, env = 0.0, decay = 0.995;
-        float  outGain = 1.0f;
-        void prepare(double s) { sr = s; setFreq(freq); env = 0.0; }
-        void setFreq(double f) { freq = f; inc = juce::MathConstants<double>::twoPi * freq / sr; }
-        void trigger(float g) { env = 1.0; outGain = g; }
-        float next() {
-            float s = (float)std::sin(phase) * (float)env * outGain;
-            phase += inc; if (phase >= juce::MathConstants<double>::twoPi) phase -= juce::MathConstants<double>::twoPi;
-            env *= decay; if (env < 1.0e-4) env = 0.0; return s;
-        }
-    } click;
-
-    // ===== one-shot drum =====
-    struct OneShot
-    {
-        juce::AudioBuffer<float> data;
-        int   pos = 0;
-        float gain = 1.0f;
-        bool  active = false;
-
-        void setSample(juce::AudioBuffer<float>&& buf)
-        {
-            data = std::move(buf);
-            pos = 0; active = false;
-        }
-        void clear() { data.setSize(0, 0); pos = 0; active = false; }
-
-        void trigger(float g)
-        {
-            if (data.getNumSamples() > 0) { gain = g; pos = 0; active = true; }
-        }
-        float next()
-        {
-            if (!active || data.getNumSamples() == 0) return 0.0f;
-            if (pos >= data.getNumSamples()) { active = false; return 0.0f; }
-            float s = data.getSample(0, pos);
-            if (data.getNumChannels() > 1) s = 0.5f * (s + data.getSample(1, pos));
-            ++pos;
-            return s * gain;
-        }
-        bool isActive() const { return active; }
-    };
-
-    OneShot kick, snare, hihat;
-    bool    muteSubdivisions = false;
-
-    // ===== tones =====
-    double normalFreqHz = 1200.0, upFreqHz = 880.0, downFreqHz = 440.0;
-    float  normalGain = 0.7f, upGain = 1.0f, downGain = 1.2f;
-
-    // ===== API =====
-    void  setTempo(double newBpm) { bpm = newBpm; samplesPerBeat = sampleRate * 60.0 / juce::jmax(1.0, newBpm); recalcStep(); }
-    void  setPolyrhythm(bool b) { polyrhythm = b; recalcStep(); }
-    void  setSubdivisions(int n) { subdivisions = juce::jlimit(1, 64, n); recalcStep(); }
-    void  setBeatsPerBar(int n) { beatsPerBar = juce::jlimit(1, 64, n); }
-    void  setHostBeatsPerBar(int n) { hostBeatsPerBar = juce::jlimit(1, 64, n); recalcStep(); }
-    void  setUpbeatIndex(int idx) { upIndex = (idx >= 0 ? idx % juce::jmax(1, currentCount()) : -1); }
-    void  setDownbeatIndex(int idx) { downIndex = (idx >= 0 ? idx % juce::jmax(1, currentCount()) : -1); }
-    void  setUpbeatFreqHz(double f) { upFreqHz = f; }
-    void  setDownbeatFreqHz(double f) { downFreqHz = f; }
-    void  setNormalFreqHz(double f) { normalFreqHz = f; }
-    void  setMuteSubdivisions(bool m) { muteSubdivisions = m; }
-
-    void  setPlaying(bool b) { playing = b; }
-    bool  isPlaying() const { return playing; }
-
-    void restart() { transportSamples = 0; stepIndex = -1; lastBeatIndex = -1; recalcStep(); stepCountdown = 1; }
-    void resetTransport() { restart(); }
-    void setTransportSamples(int64_t s) { transportSamples = s; if (s == 0) { stepIndex = -1; lastBeatIndex = -1; recalcStep(); stepCountdown = 1; } }
-    int64_t getTransportSamples() const { return transportSamples; }
-
-    double getPhase01() const
-    {
-        if (sampleRate <= 0.0 || bpm <= 0.0) return 0.0;
-        const double spb = sampleRate * (60.0 / bpm);
-        const int    barN = polyrhythm ? hostBeatsPerBar : beatsPerBar; //Measure the bar length
-        const double spbar = spb * (double)juce::jmax(1, barN);
-        if (spbar <= 0.0) return 0.0;
-        return std::fmod((double)transportSamples / spbar, 1.0);
-    }
-    double getVisualLapPhase01() const { return getPhase01(); }
-
-    // ===== AudioSource =====
-    void prepareToPlay(int /*block*/, double sr) override
-    {
-        sampleRate = sr; setTempo(bpm); click.prepare(sr);
-        recalcStep(); stepIndex = -1; stepCountdown = 1; lastBeatIndex = -1;
-    }
-    void releaseResources() override {}
-
-    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
-    {
-        auto* buffer = info.buffer; if (!buffer) return;
-        const int numCh = buffer->getNumChannels();
-        buffer->clear(info.startSample, info.numSamples);
-
-        if (!playing) return;
-
-        auto* L = buffer->getWritePointer(0, info.startSample);
-        auto* R = (numCh > 1 ? buffer->getWritePointer(1, info.startSample) : nullptr);
-
-        if (polyrhythm)
-        {
-            for (int i = 0; i < info.numSamples; ++i)
-            {
-                if (--stepCountdown <= 0)
-                {
-
-                  
-                    stepCountdown += stepSamps;                     
-                    stepIndex = (stepIndex + 1) % juce::jmax(1, subdivisions); 
-
-                   
-                    const bool isDown = (downIndex >= 0 && stepIndex == downIndex);
-                    const bool isUp = (upIndex >= 0 && stepIndex == upIndex);
-                    const bool isSub = (!isDown && !isUp);
-
-                    bool usedSample = false;
-
-                    if (isDown)
-                    {
-                        if (snare.data.getNumSamples() > 0) { snare.trigger(downGain); usedSample = true; }
-                    }
-                    else if (isUp)
-                    {
-                        if (kick.data.getNumSamples() > 0) { kick.trigger(upGain);    usedSample = true; }
-                    }
-                    else // subdivision
-                    {
-                        if (!muteSubdivisions)
-                        {
-                            if (hihat.data.getNumSamples() > 0) { hihat.trigger(normalGain); usedSample = true; }
-                        }
-                    }
-
-                  
-                    if (!usedSample)
-                    {
-                        if (!(isSub && muteSubdivisions))
-                        {
-                            double f = normalFreqHz; float g = normalGain;
-                            if (isDown) { f = downFreqHz; g = downGain; }
-                            else if (isUp) { f = upFreqHz; g = upGain; }
-                            click.setFreq(f); click.trigger(g);
-                        }
-                    }
-
-                }
-
-                const float drums = kick.next() + snare.next() + hihat.next();
-                const float tone = click.next();
-                const float s = drums + tone;
-                L[i] = s; if (R) R[i] = s;
-                ++transportSamples;
-            }
-        }
-        else
-        {
-            for (int i = 0; i < info.numSamples; ++i)
-            {
-                const int64_t beatIdx = (samplesPerBeat > 0.0 ? (int64_t)std::floor((double)transportSamples / samplesPerBeat) : 0);
-                if (beatIdx != lastBeatIndex)
-                {
-                    lastBeatIndex = beatIdx;
-                    const int whichInBar = (int)(beatIdx % (int64_t)juce::jmax(1, beatsPerBar));
-                    const bool isDown = (downIndex >= 0 && whichInBar == downIndex);
-                    const bool isUp = (upIndex >= 0 && whichInBar == upIndex);
-
-                    if (!muteSubdivisions || isDown || isUp)
-                    {
-                        double f = normalFreqHz; float g = normalGain;
-                        if (isDown) { f = downFreqHz; g = downGain; }
-                        else if (isUp) { f = upFreqHz; g = upGain; }
-                        click.setFreq(f); click.trigger(g);
-                    }
-                }
-
-                const float s = kick.next() + snare.next() + hihat.next() + click.next();
-                L[i] = s; if (R) R[i] = s;
-                ++transportSamples;
-            }
-        }
-    }
-
-private:
-    void recalcStep()
-    {
-        if (samplesPerBeat <= 0.0) { stepSamps = 1; stepCountdown = 1; return; }
-        if (polyrhythm)
-        {
-            const double samplesPerBar = samplesPerBeat * (double)juce::jmax(1, hostBeatsPerBar);
-            const double step = samplesPerBar / (double)juce::jmax(1, subdivisions);
-            stepSamps = juce::jmax<int64_t>(1, (int64_t)std::llround(step));
-        }
-        else
-        {
-            const double step = samplesPerBeat; 
-            stepSamps = juce::jmax<int64_t>(1, (int64_t)std::llround(step));
-        }
-        if (stepCountdown <= 0 || stepCountdown > stepSamps) stepCountdown = stepSamps;
-    }
-    int currentCount() const { return polyrhythm ? subdivisions : beatsPerBar; }
-};
 struct Layout {
     static constexpr int margin = 12;
     static constexpr int topH = 64;
@@ -359,7 +26,8 @@ struct Layout {
 };
 // === MainComponent:GUI + Timer ===
 class MainComponent : public juce::Component,
-    public juce::Timer
+    public juce::Timer,
+    public juce::MidiInputCallback
 {
 public:
     MainComponent();
@@ -371,10 +39,17 @@ public:
     void setPlaying(bool b) { playing = b; }
     bool isPlaying() const { return playing; }
     //void openOnboardingOverlay(juce::ApplicationProperties& appProps);
-    void setAppProperties(juce::ApplicationProperties* p) { appProps = p; }
+    void setAppProperties(juce::ApplicationProperties* p)
+    {
+        appProps = p;
+        // setting realtimeMode: lock/prefault audio memory, RT priority (see RealtimeGuard)
+        RealtimeGuard::setEnabled(p != nullptr && p->getUserSettings()->getBoolValue("realtimeMode", false));
+        loadPresetBank(); loadOutputSettings(); startAudio();
+    }
     void showQuickTour(bool resetFlag = false);
     void openOnboardingOverlay();
     bool keyPressed(const juce::KeyPress& key) override;  
+    void handleIncomingMidiMessage(juce::MidiInput* source, const juce::MidiMessage& m) override;
    
     // --- Uniform font for the three sample buttons ---
     struct UniformButtonLNF : public juce::LookAndFeel_V4
@@ -411,6 +86,16 @@ private:
     //sound
     juce::AudioDeviceManager deviceManager;
     juce::AudioSourcePlayer  audioSourcePlayer; 
+    // opened in the background at startup; the device is nullptr until then
+    AudioStartup             audioStartup;
+    juce::AudioIODevice* getOpenDevice() const { return audioStartup.isOpen() ? deviceManager.getCurrentAudioDevice() : nullptr; }
+    void startAudio();
+    void audioOpened();
+    bool firstFrameTraced = false, firstCallbackTraced = false;
+
+    // smallest stable buffer size, per device (Ctrl+T; setting autoTuneBuffer)
+    BufferTuner bufferTuner;
+    void startBufferTune();
     ClickAudioSource         clickSource;
 
     bool   playing = true;
@@ -437,6 +122,21 @@ private:
     int accentIndex = -1;  
 
     void mouseDown(const juce::MouseEvent& e) override;
+    void mouseDrag(const juce::MouseEvent& e) override;
+    void mouseUp(const juce::MouseEvent& e) override;
+    void mouseMove(const juce::MouseEvent& e) override;
+    void mouseExit(const juce::MouseEvent& e) override;
+
+    // Vertices of all shapes are hit-tested through the grid (rebuilt in
+    // rebuildLayerVerts). A click sets the upbeat there (shift: downbeat)
+    // and makes the shape active; dragging moves that accent along it.
+    static constexpr float hitRadius = 14.0f;
+    VertexGrid      vertexGrid;
+    VertexGrid::Hit hoverVertex;
+    int  dragLayer = -1;
+    bool dragDownbeat = false;
+    void setHover(const VertexGrid::Hit& h);
+    void setAccent(int layer, bool downbeat, int vertex);
     juce::ComboBox accentNoteBox;   
     juce::Label    accentNoteLabel; 
 
@@ -460,6 +160,15 @@ private:
     juce::ComboBox upNoteBox, downNoteBox;
     juce::Label    upNoteLabel, downNoteLabel;
 
+    // Output routing, level and pan of the active layer
+    juce::ComboBox outputBox;
+    juce::Label    outputLabel;
+    juce::Slider   gainSlider, panSlider;
+    juce::Label    gainLabel, panLabel;
+    void refreshMixControls();
+    void loadOutputSettings();
+    static int routeId(int first, int width) { return width == 1 ? 1001 + first : 1 + first; }
+
 
     struct LayerState {
         int sides = 3;
@@ -470,15 +179,79 @@ private:
         double upPhase01 = -1.0;   
         double downPhase01 = -1.0;
 
+        // Samples (for presets)
+        juce::String kickPath, snarePath, hihatPath;
+
         
         std::vector<juce::Point<float>> verts;
+
+        // Built with verts: the stroked outline and all vertex dots as one
+        // path each, so a frame fills two paths per shape at any side count.
+        juce::Path outline, dots;
+        float spacing = 0.0f;      // px between neighbouring vertices
+
+        // Where verts were last placed. rebuildLayerVerts redoes a layer
+        // only when this changes: its sides, or its centre/radius after a
+        // resize, a zoom or a layer below it going away.
+        juce::Point<float> placedCentre;
+        float placedRadius = -1.0f;
+        int   placedSides = 0;
     };
+    UnitPolygons unitPolygons;
+
+    // Level of detail for dense shapes, by vertex spacing in px: full dots,
+    // then small ones, then none; practice timings as text, else coloured dots.
+    static constexpr float fullDotSpacing = 10.0f, smallDotSpacing = 4.0f, practiceTextSpacing = 48.0f;
 
     std::vector<std::unique_ptr<ClickAudioSource>> layersAudio; 
     std::vector<LayerState>                       layers;       
-    juce::MixerAudioSource                         mixer;      
+    LayerEngine                                    engine;      
     int activeLayer = 0;                                         
 
+    // Preset slots (1-8 recall, Ctrl+1-8 store, MIDI program change)
+    PresetBank presetBank;
+    std::vector<std::unique_ptr<ClickAudioSource>> retiredAudio; // removed or switched out, freed once the engine is done with them (isFadeIdle)
+    PatternPreset captureCurrentPattern() const;
+    void storePreset(int slot);
+    void adoptSwitchedSlot(int slot);
+    void showPattern(const PatternPreset& p);
+    void loadPresetBank();
+    void savePresetBank();
+
+    // Sessions (Ctrl+S / Ctrl+O; the last one is reopened at launch)
+    bool saveSession(const juce::File& file, bool bundle);
+    Session captureSession(bool withSamples) const;
+    void autosaveSession();
+    juce::File getAutosaveBundleFile() const;
+    std::map<juce::String, std::weak_ptr<const SampleBuffer>> autosavedSamples;   // what that bundle holds, by spec
+    bool openSession(const juce::File& file);
+    void chooseSessionFile(bool forSaving);
+    juce::File getAutosaveFile() const;
+    void restoreLastSession()
+    {
+        if (appProps != nullptr && appProps->getUserSettings()->getBoolValue("restoreSession", true))
+            if (const auto f = getAutosaveFile(); f.existsAsFile())
+                openSession(f);
+    }
+
+    // MIDI note/clock output (settings: midiOutput, midiClock, midiOffsetMs)
+    MidiTriggerOutput midiOut;
+    void loadMidiOutputSettings();
+    void applyMidiLatency();
+
+    // External MIDI clock (setting midiClockInput = "virtual" opens a port for it)
+    MidiClockFollower clockFollower;
+    std::unique_ptr<juce::MidiInput> clockInPort;
+
+    // Bounce to disk (settings: recordFolder, recordFormat = wav/flac, recordStems)
+    BounceRecorder recorder;
+    void startRecording();
+    void stopRecording();
+
+    // Practice: onset timing on an input (settings: practiceInput, practiceLatencyMs, practiceThresholdDb)
+    PracticeMonitor practice;
+    void setListening(bool on);
+
     // UI: layers
     juce::TextButton addLayerBtn{ "Add Shape" };
     juce::TextButton removeLayerBtn{ "Remove Shape" };
@@ -492,13 +265,23 @@ private:
     void setSidesForActive(int n);        
     void addNewLayer();                     
     void removeActiveLayer();               
+    void refreshLayerCombo();
 
     // Helpers
     ClickAudioSource* getActiveAudio();     
     LayerState& getActiveLayer(); 
 
     //Quick Tour
-    void loadOneShotFromFile(ClickAudioSource::OneShot& dst, const juce::File& file);
+    // role: 0 = kick, 1 = snare, 2 = hihat; spec as in SampleLoader::load. Decodes in the background.
+    void loadSample(ClickAudioSource* target, int role, const juce::String& spec);
+    // Sets a loaded sample, repitched to the layer's Up/Down notes (kick / snare).
+    void applySample(ClickAudioSource* target, int role, ClickAudioSource::SampleData original);
+    PitchCache pitchCache;
+    std::map<std::pair<ClickAudioSource*, int>, int> sampleRequests;
+    int statsTicks = 0;   // debug log of voice / MIDI stats every 5 s
+    std::map<juce::String, std::weak_ptr<const SampleBuffer>> loadedSamples; // path@rate
+    juce::CriticalSection loadedSamplesLock;   // message thread writes, the preset loader reads
+    SampleBuffer::Options sampleOptions;   // settings: sampleStorage, sampleTrimDb
     juce::ApplicationProperties* appProps = nullptr;
     juce::TextButton helpBtn{ "Quick Tour (F1)" };
     
@@ -517,7 +300,10 @@ private:
 	// Buttons
     juce::TextButton playButton{ "Play" };
     juce::TextButton stopButton{ "Stop" };
+    juce::TextButton recButton{ "Record" };
     juce::ToggleButton muteSubsToggle{ "Mute subdivisions" };
+    juce::ToggleButton extClockToggle{ "Ext. MIDI clock" };
+    juce::ToggleButton listenToggle{ "Listen" };
     juce::TextButton loadKickBtn;
     juce::TextButton loadSnareBtn;
     juce::TextButton loadHihatBtn;
@@ -529,6 +315,9 @@ private:
     
 	// File Chooser
     juce::AudioFormatManager formatManager;
+    // after formatManager and pitchCache, which its jobs use: members go in
+    // reverse order, so the pool's thread is stopped before they are
+    juce::ThreadPool sampleLoadPool{ 1 };
 
 
     // --- Panels geometry ---
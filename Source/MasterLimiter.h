@@ -0,0 +1,155 @@
+#pragma once
+#include <JuceHeader.h>
+#include <vector>
+#include "RealtimeGuard.h"
+
+// =========== MasterLimiter.h ===========
+// Look-ahead brickwall limiter for the master bus, linked across all output
+// channels. The gain curve is computed once per sample from the loudest
+// channel: minimum-hold over the look-ahead window, release, then a box
+// filter of the same length, so the attack is a smooth ramp that reaches the
+// required gain exactly at the peak. Detection, delay and gain application
+// over the channels are block-wise vector operations.
+class MasterLimiter
+{
+public:
+    // ===== message thread (audio stopped) =====
+    void prepare(double sr, int maxBlock, int maxChannels, double lookAheadMs = 1.5, double releaseMs = 80.0)
+    {
+        window = juce::jmax(1, (int)std::lround(lookAheadMs * 0.001 * sr));
+        blockSize = juce::jmax(1, maxBlock);
+        releaseCoef = (float)std::exp(-1.0 / juce::jmax(1.0, releaseMs * 0.001 * sr));
+
+        const int d = getLatencySamples();
+        rings.setSize(juce::jmax(1, maxChannels), juce::jmax(1, d));
+        work.setSize(3, blockSize + d);
+
+        holdValue.assign((size_t)window, 1.0f);
+        holdIndex.assign((size_t)window, 0);
+        box.assign((size_t)window, 1.0f);
+        reset();
+    }
+
+    void reset()
+    {
+        rings.clear();
+        holdHead = holdCount = 0;
+        boxPos = 0;
+        boxSum = (double)window;
+        std::fill(box.begin(), box.end(), 1.0f);
+        released = 1.0f;
+        sampleIndex = 0;
+    }
+
+    int getLatencySamples() const { return window - 1; }
+
+    // realtimeMode: lock and prefault the state allocated by prepare()
+    void lockMemory()
+    {
+        RealtimeGuard::lockBuffer(rings);
+        RealtimeGuard::lockBuffer(work);
+        RealtimeGuard::lockMemory(holdValue.data(), holdValue.size() * sizeof(float), true);
+        RealtimeGuard::lockMemory(holdIndex.data(), holdIndex.size() * sizeof(juce::int64), true);
+        RealtimeGuard::lockMemory(box.data(), box.size() * sizeof(float), true);
+    }
+
+    // linear ceiling, e.g. Decibels::decibelsToGain(-0.3f)
+    void setCeiling(float c) { ceiling = juce::jlimit(0.01f, 1.0f, c); }
+
+    // ===== audio thread =====
+    void process(juce::AudioBuffer<float>& buf, int start, int n)
+    {
+        const int numCh = juce::jmin(buf.getNumChannels(), rings.getNumChannels());
+        if (numCh == 0) return;
+
+        for (int done = 0; done < n; )
+        {
+            const int m = juce::jmin(n - done, blockSize);
+            computeGain(buf, start + done, m, numCh);
+
+            for (int ch = 0; ch < numCh; ++ch)
+                delayAndApply(buf.getWritePointer(ch, start + done), ch, m);
+
+            done += m;
+        }
+    }
+
+private:
+    void computeGain(const juce::AudioBuffer<float>& buf, int start, int m, int numCh)
+    {
+        float* peak = work.getWritePointer(0);
+        float* tmp = work.getWritePointer(1);
+        float* gain = work.getWritePointer(2);
+
+        juce::FloatVectorOperations::abs(peak, buf.getReadPointer(0, start), m);
+        for (int ch = 1; ch < numCh; ++ch)
+        {
+            juce::FloatVectorOperations::abs(tmp, buf.getReadPointer(ch, start), m);
+            juce::FloatVectorOperations::max(peak, peak, tmp, m);
+        }
+        juce::FloatVectorOperations::max(peak, peak, ceiling, m); // quiet samples -> target gain 1
+
+        for (int i = 0; i < m; ++i, ++sampleIndex)
+        {
+            const float target = ceiling / peak[i];
+
+            // sliding minimum over the last `window` targets (monotonic queue)
+            if (holdCount > 0 && holdIndex[(size_t)holdHead] <= sampleIndex - window) { holdHead = (holdHead + 1) % window; --holdCount; }
+            while (holdCount > 0 && holdValue[(size_t)back()] >= target) --holdCount;
+            const int slot = (holdHead + holdCount) % window;
+            holdValue[(size_t)slot] = target;
+            holdIndex[(size_t)slot] = sampleIndex;
+            ++holdCount;
+            const float held = holdValue[(size_t)holdHead];
+
+            // instant down, exponential release up
+            released = held < released ? held : held + (released - held) * releaseCoef;
+
+            boxSum += (double)released - (double)box[(size_t)boxPos];
+            box[(size_t)boxPos] = released;
+            if (++boxPos == window) boxPos = 0;
+
+            gain[i] = juce::jmin(1.0f, (float)(boxSum / (double)window));
+        }
+    }
+
+    // out = [ring | in] delayed by the look-ahead, times the gain curve
+    void delayAndApply(float* io, int ch, int m)
+    {
+        const int d = getLatencySamples();
+        const float* gain = work.getReadPointer(2);
+
+        if (d > 0)
+        {
+            float* line = work.getWritePointer(1);
+            float* ring = rings.getWritePointer(ch);
+            juce::FloatVectorOperations::copy(line, ring, d);
+            juce::FloatVectorOperations::copy(line + d, io, m);
+            juce::FloatVectorOperations::copy(ring, line + m, d);
+            juce::FloatVectorOperations::multiply(io, line, gain, m);
+        }
+        else
+        {
+            juce::FloatVectorOperations::multiply(io, gain, m);
+        }
+    }
+
+    int back() const { return (holdHead + holdCount - 1) % window; }
+
+    int    window = 1, blockSize = 512;
+    float  ceiling = 0.966f, releaseCoef = 0.999f;
+
+    juce::AudioBuffer<float> rings;   // per channel: the last `latency` input samples
+    juce::AudioBuffer<float> work;    // 0 peak, 1 scratch/delay line, 2 gain
+
+    std::vector<float>        holdValue;
+    std::vector<juce::int64>  holdIndex;
+    int   holdHead = 0, holdCount = 0;
+
+    std::vector<float> box;
+    int    boxPos = 0;
+    double boxSum = 1.0;
+
+    float       released = 1.0f;
+    juce::int64 sampleIndex = 0;
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include "TimeDLL.h"
+
+// =========== MidiClockFollower.h ===========
+// Tracks an external 24-PPQN MIDI clock. Tick arrival times are smoothed
+// with a DLL (jittery USB/network MIDI would otherwise make the tempo
+// wobble); Start/Stop/Continue and Song Position Pointer move the tick
+// counter. The audio thread reads a consistent snapshot through a seqlock
+// and phase-locks the layer transport to it (see LayerEngine).
+class MidiClockFollower
+{
+public:
+    static constexpr int ticksPerBeat = 24;
+
+    struct State
+    {
+        bool   running = false;   // started and at least one tick seen
+        bool   stale = false;     // clock stopped arriving; freewheel
+        double ticks = 0.0;       // expected position at the queried time
+        double bpm = 120.0;
+        juce::uint32 generation = 0; // bumps on every position discontinuity
+    };
+
+    // ===== message thread =====
+    void setEnabled(bool b) { enabled.store(b); }
+    bool isEnabled() const { return enabled.load(); }
+    // output latency, so what we render now is heard on the tick
+    void setLatencyMs(double ms) { latencyMs.store(ms); }
+
+    double getBpm() const { return publishedBpm.load(); }
+
+    // ===== MIDI thread =====
+    void handleMessage(const juce::MidiMessage& m)
+    {
+        if (!enabled.load()) return;
+
+        const double nowMs = (m.getTimeStamp() > 0.0 ? m.getTimeStamp() * 1000.0
+                                                      : juce::Time::getMillisecondCounterHiRes());
+
+        if (m.isMidiClock())             onTick(nowMs);
+        else if (m.isMidiStart())        { nextTick = 0; running = true; haveTick = false; ++generation; publish(); }
+        else if (m.isMidiContinue())     { running = true; haveTick = false; ++generation; publish(); }
+        else if (m.isMidiStop())         { running = false; publish(); }
+        else if (m.isSongPositionPointer())
+        {
+            // 1 MIDI beat = a 16th note = 6 clocks
+            nextTick = (juce::int64)m.getSongPositionPointerMidiBeat() * 6;
+            haveTick = false; ++generation; publish();
+        }
+    }
+
+    // ===== audio thread =====
+    State snapshot(double nowMs) const
+    {
+        Shared s;
+        for (;;)
+        {
+            const auto v0 = seq.load(std::memory_order_acquire);
+            if ((v0 & 1u) != 0) continue;
+            s = shared;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == v0) break;
+        }
+
+        State st;
+        st.generation = s.generation;
+        st.running = s.running && s.haveTick;
+        if (!st.running || s.periodMs <= 0.0) return st;
+
+        st.bpm = 60000.0 / (s.periodMs * (double)ticksPerBeat);
+
+        const double since = (nowMs + latencyMs.load() - s.lastTickMs) / s.periodMs;
+        st.stale = since > 3.0;
+        st.ticks = (double)s.lastTickIndex + juce::jlimit(0.0, 3.0, since);
+        return st;
+    }
+
+private:
+    struct Shared
+    {
+        double lastTickMs = 0.0, periodMs = 0.0;
+        juce::int64 lastTickIndex = 0;
+        juce::uint32 generation = 0;
+        bool running = false, haveTick = false;
+    };
+
+    // ===== MIDI thread =====
+    void onTick(double nowMs)
+    {
+        const double raw = nowMs - lastRawMs;
+        lastRawMs = nowMs;
+
+        // A single late/dropped tick is coasted over; the loop only
+        // re-locks on start or when the master really jumps tempo.
+        const double nominal = dll.locked ? dll.getPeriodMs() : 0.0;
+        const bool outlier = dll.locked && (raw <= 0.0 || std::abs(raw - nominal) > 0.25 * nominal);
+
+        if (outlier && ++outliers < 3)
+        {
+            filteredMs = dll.update(dll.predictNext());
+        }
+        else if (!dll.locked || outlier)
+        {
+            if (havePrevRaw && raw > 0.0 && raw < 250.0)
+                dll.reset(nowMs, raw, 0.2);
+            havePrevRaw = true;
+            outliers = 0;
+            filteredMs = nowMs;
+        }
+        else
+        {
+            outliers = 0;
+            filteredMs = dll.update(nowMs);
+        }
+
+        if (!running) return;
+
+        lastTickIndex = nextTick++;
+        haveTick = true;
+        publish();
+    }
+
+    void publish()
+    {
+        seq.fetch_add(1, std::memory_order_acq_rel);
+        shared.lastTickMs = filteredMs;
+        shared.periodMs = dll.locked ? dll.getPeriodMs() : 0.0;
+        shared.lastTickIndex = lastTickIndex;
+        shared.generation = generation;
+        shared.running = running;
+        shared.haveTick = haveTick;
+        seq.fetch_add(1, std::memory_order_release);
+
+        if (shared.periodMs > 0.0)
+            publishedBpm.store(60000.0 / (shared.periodMs * (double)ticksPerBeat));
+    }
+
+    std::atomic<bool>   enabled{ false };
+    std::atomic<double> latencyMs{ 0.0 };
+    std::atomic<double> publishedBpm{ 120.0 };
+
+    // MIDI thread
+    TimeDLL dll;
+    double  lastRawMs = 0.0, filteredMs = 0.0;
+    bool    havePrevRaw = false;
+    int     outliers = 0;
+    bool    running = false, haveTick = false;
+    juce::int64  nextTick = 0, lastTickIndex = 0;
+    juce::uint32 generation = 0;
+
+    // seqlock-published copy
+    std::atomic<juce::uint32> seq{ 0 };
+    Shared shared;
+};
@@ -0,0 +1,263 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include "ClickAudioSource.h"
+#include "TimeDLL.h"
+
+// =========== MidiTriggerOutput.h ===========
+// Turns every layer/metronome trigger into a MIDI note (GM drum map on
+// channel 10) plus optional 24-PPQN clock. The audio thread only stamps
+// events with a DLL-smoothed wall-clock time and pushes them into a FIFO;
+// a dedicated sender thread waits for each timestamp (sleeping coarse,
+// spinning for the last millisecond) and measures how late every message
+// actually went out.
+class MidiTriggerOutput : public TriggerSink,
+                          private juce::Thread
+{
+public:
+    struct JitterStats { double meanMs = 0.0, maxMs = 0.0; juce::int64 count = 0, dropped = 0; };
+
+    MidiTriggerOutput() : juce::Thread("Tri-Beat MIDI out") {}
+    ~MidiTriggerOutput() override { close(); }
+
+    // ===== message thread =====
+    // "virtual" creates a new ALSA/CoreMIDI port called "Tri-Beat",
+    // anything else is matched against the available device names.
+    bool open(const juce::String& device)
+    {
+        close();
+        if (device.isEmpty()) return false;
+
+        fifo.reset();
+
+       #if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+        if (device == "virtual")
+            port = juce::MidiOutput::createNewDevice("Tri-Beat");
+       #endif
+
+        if (port == nullptr)
+            for (const auto& d : juce::MidiOutput::getAvailableDevices())
+                if (d.name == device || d.identifier == device)
+                {
+                    port = juce::MidiOutput::openDevice(d.identifier);
+                    break;
+                }
+
+        if (port == nullptr)
+        {
+            DBG("[MIDI] Could not open output: " << device);
+            return false;
+        }
+
+        dllNeedsReset = true;
+        startThread(juce::Thread::Priority::highest);
+        active.store(true);
+        return true;
+    }
+
+    void close()
+    {
+        active.store(false);
+        stopThread(500);
+        port.reset();
+    }
+
+    bool isOpen() const { return active.load(); }
+
+    void setClockEnabled(bool b) { clockEnabled.store(b); }
+    // device output latency + user offset, so notes line up with what is heard
+    void setLatencyMs(double ms) { latencyMs.store(ms); }
+
+    JitterStats getJitterStats() const
+    {
+        JitterStats s;
+        s.count = sentCount.load();
+        s.meanMs = s.count > 0 ? jitterSumMs.load() / (double)s.count : 0.0;
+        s.maxMs = jitterMaxMs.load();
+        s.dropped = droppedCount.load();
+        return s;
+    }
+    void resetJitterStats() { sentCount = 0; jitterSumMs = 0.0; jitterMaxMs = 0.0; droppedCount = 0; }
+
+    // GM drum notes per role
+    int noteFor(TriggerSink::Role r) const
+    {
+        switch (r)
+        {
+            case Downbeat:      return 38; // snare
+            case Upbeat:        return 36; // kick
+            case Subdivision:   return 42; // closed hi-hat
+            case MetronomeDown: return 76; // hi wood block
+            case MetronomeUp:   return 77; // low wood block
+        }
+        return 42;
+    }
+
+    // ===== audio thread =====
+    void beginBlock(int numSamples, double sr)
+    {
+        sampleRate = sr;
+        chunkOffset = 0;
+        if (!active.load()) { dllNeedsReset = true; return; }
+
+        const double now = juce::Time::getMillisecondCounterHiRes();
+        const double period = 1000.0 * (double)numSamples / sr;
+
+        // restart the loop after device (re)starts or xruns
+        if (dllNeedsReset || std::abs(now - dll.predictNext()) > 4.0 * period || numSamples != lastBlockSize)
+        {
+            dll.reset(now, period);
+            dllNeedsReset = false;
+            lastBlockSize = numSamples;
+            blockStartMs = now;
+        }
+        else
+        {
+            blockStartMs = dll.update(now);
+        }
+    }
+
+    void setChunkOffset(int offset) { chunkOffset = offset; }
+
+    // Clock ticks for the samples [transport, transport + n) of the chunk.
+    void renderClock(int64_t transport, int n, double samplesPerBeat, bool playing)
+    {
+        if (!active.load()) return;
+
+        if (playing && (!wasPlaying || transport < lastTransport))
+            push(chunkOffset, juce::MidiMessage::midiStart());
+        else if (!playing && wasPlaying)
+            push(chunkOffset, juce::MidiMessage::midiStop());
+
+        wasPlaying = playing;
+        lastTransport = transport + n;
+
+        if (!playing || !clockEnabled.load() || samplesPerBeat <= 0.0) return;
+
+        const double spt = samplesPerBeat / 24.0;
+        auto tick = (int64_t)std::ceil((double)transport / spt);
+        for (;; ++tick)
+        {
+            const auto at = (int64_t)std::ceil((double)tick * spt) - transport;
+            if (at >= n) break;
+            push(chunkOffset + (int)at, juce::MidiMessage::midiClock());
+        }
+    }
+
+    void trigger(int sampleOffset, int /*layer*/, Role role, float gain) override
+    {
+        if (!active.load()) return;
+        const auto vel = (juce::uint8)juce::jlimit(1, 127, juce::roundToInt(gain * 100.0f));
+        push(chunkOffset + sampleOffset, juce::MidiMessage::noteOn(10, noteFor(role), vel));
+    }
+
+private:
+    struct Event
+    {
+        double      timeMs = 0.0;
+        juce::uint8 bytes[3] = {};
+        int         size = 0;
+    };
+
+    void push(int offset, const juce::MidiMessage& m)
+    {
+        const int size = juce::jmin(3, m.getRawDataSize());
+        {
+            const auto w = fifo.write(1);
+            if (w.blockSize1 == 0) { droppedCount.fetch_add(1); return; }
+
+            auto& e = events[(size_t)w.startIndex1];
+            e.timeMs = blockStartMs + latencyMs.load() + 1000.0 * (double)offset / sampleRate;
+            e.size = size;
+            std::memcpy(e.bytes, m.getRawData(), (size_t)size);
+        }
+        notify();
+    }
+
+    // ===== sender thread =====
+    void run() override
+    {
+        std::vector<Event> staged;
+        staged.reserve(events.size());
+        std::array<double, 128> noteOffAt;
+        noteOffAt.fill(-1.0);
+        constexpr double noteLengthMs = 20.0;
+
+        while (!threadShouldExit())
+        {
+            {
+                const auto r = fifo.read(fifo.getNumReady());
+                r.forEach([&](int i) { staged.push_back(events[(size_t)i]); });
+            }
+            std::sort(staged.begin(), staged.end(), [](const Event& a, const Event& b) { return a.timeMs < b.timeMs; });
+
+            double next = staged.empty() ? -1.0 : staged.front().timeMs;
+            int offNote = -1;
+            for (int n = 0; n < 128; ++n)
+                if (noteOffAt[(size_t)n] >= 0.0 && (next < 0.0 || noteOffAt[(size_t)n] < next))
+                {
+                    next = noteOffAt[(size_t)n];
+                    offNote = n;
+                }
+
+            if (next < 0.0) { wait(2.0); continue; }
+
+            const double ahead = next - juce::Time::getMillisecondCounterHiRes();
+            if (ahead > 1.5) { wait(ahead - 1.0); continue; } // may wake early for new events
+
+            while (juce::Time::getMillisecondCounterHiRes() < next)
+                juce::Thread::yield();
+
+            if (offNote >= 0)
+            {
+                port->sendMessageNow(juce::MidiMessage::noteOff(10, offNote));
+                noteOffAt[(size_t)offNote] = -1.0;
+                continue;
+            }
+
+            const auto e = staged.front();
+            staged.erase(staged.begin());
+
+            const auto msg = juce::MidiMessage(e.bytes, e.size);
+            port->sendMessageNow(msg);
+            record(juce::Time::getMillisecondCounterHiRes() - e.timeMs);
+
+            if (msg.isNoteOn())
+                noteOffAt[(size_t)msg.getNoteNumber()] = e.timeMs + noteLengthMs;
+        }
+    }
+
+    void record(double lateMs)
+    {
+        const double j = std::abs(lateMs);
+        sentCount.fetch_add(1);
+        jitterSumMs.store(jitterSumMs.load() + j);
+        if (j > jitterMaxMs.load()) jitterMaxMs.store(j);
+    }
+
+    std::unique_ptr<juce::MidiOutput> port;   // sender thread only while active
+    std::atomic<bool> active{ false };
+
+    static constexpr int fifoSize = 4096;
+    juce::AbstractFifo fifo{ fifoSize };
+    std::array<Event, fifoSize> events;
+
+    // audio thread
+    TimeDLL dll;
+    bool    dllNeedsReset = true;
+    int     lastBlockSize = 0;
+    double  blockStartMs = 0.0, sampleRate = 48000.0;
+    int     chunkOffset = 0;
+    bool    wasPlaying = false;
+    int64_t lastTransport = 0;
+
+    std::atomic<bool>   clockEnabled{ false };
+    std::atomic<double> latencyMs{ 0.0 };
+
+    // stats (sender thread writes, anyone reads)
+    std::atomic<juce::int64> sentCount{ 0 }, droppedCount{ 0 };
+    std::atomic<double>      jitterSumMs{ 0.0 }, jitterMaxMs{ 0.0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiTriggerOutput)
+};
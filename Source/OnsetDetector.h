@@ -0,0 +1,118 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <vector>
+
+// =========== OnsetDetector.h ===========
+// Peak-envelope onset detector for drum hits on a mic or pad input.
+// The input is rectified and reduced to one peak per 16-sample frame with
+// vector ops; a hit is a frame whose peak is above an absolute floor and
+// rises by `ratio` over the slowly-decaying envelope of what came before.
+// Its position is refined to the first sample over that line, so timing is
+// sample-accurate even though the decision is per frame. Cheap enough for
+// 64-sample callbacks; nothing is allocated after prepare().
+class OnsetDetector
+{
+public:
+    static constexpr int frameSize = 16;
+    static constexpr int maxOnsetsPerBlock = 16;
+
+    // ===== message thread (audio stopped) =====
+    void prepare(double sr, int maxBlock)
+    {
+        sampleRate = sr;
+        scratch.assign((size_t)juce::jmax(frameSize, maxBlock), 0.0f);
+        updateCoefficients();
+        reset();
+    }
+
+    void reset() { slow = 0.0f; sinceLast = holdSamples; numOnsets = 0; }
+
+    // absolute floor, dBFS
+    void setThresholdDb(float db) { floorGain = juce::Decibels::decibelsToGain(db); }
+    // how far a hit must rise above the recent level, dB
+    void setRiseDb(float db) { ratio = juce::Decibels::decibelsToGain(juce::jmax(0.0f, db)); }
+    // minimum spacing between hits (flams closer than this count once)
+    void setHoldMs(double ms) { holdMs = juce::jmax(1.0, ms); updateCoefficients(); }
+
+    // ===== audio thread =====
+    // Returns the number of onsets in in[0, n); their offsets are getOnset(i).
+    int process(const float* in, int n)
+    {
+        numOnsets = 0;
+
+        for (int done = 0; done < n; )
+        {
+            const int m = juce::jmin(n - done, (int)scratch.size());
+            float* a = scratch.data();
+            juce::FloatVectorOperations::abs(a, in + done, m);
+
+            for (int f = 0; f < m; f += frameSize)
+            {
+                const int len = juce::jmin(frameSize, m - f);
+                const float peak = juce::FloatVectorOperations::findMaximum(a + f, len);
+                const float line = juce::jmax(floorGain, slow * ratio);
+
+                if (peak > line && sinceLast >= holdSamples && numOnsets < maxOnsetsPerBlock)
+                {
+                    int at = f;
+                    while (a[at] <= line) ++at;     // first sample over the line
+                    onsets[(size_t)numOnsets++] = done + at;
+                    sinceLast = f + len - at;
+                }
+                else
+                {
+                    sinceLast += len;
+                }
+
+                slow = juce::jmax(peak, slow * releasePerFrame);
+            }
+            done += m;
+        }
+        return numOnsets;
+    }
+
+    int getOnset(int i) const { return onsets[(size_t)i]; }
+
+    // ===== offline =====
+    // Feeds channel 0 of a file through process() in callback-sized blocks,
+    // exactly as the audio thread would, and returns the onset positions.
+    // For checking thresholds against recorded takes.
+    std::vector<juce::int64> analyse(juce::AudioFormatReader& reader, int blockSize = 64)
+    {
+        prepare(reader.sampleRate, blockSize);
+
+        std::vector<juce::int64> found;
+        juce::AudioBuffer<float> block(1, blockSize);
+        for (juce::int64 pos = 0; pos < reader.lengthInSamples; pos += blockSize)
+        {
+            const int n = (int)juce::jmin<juce::int64>(blockSize, reader.lengthInSamples - pos);
+            reader.read(&block, 0, n, pos, true, false);
+
+            const int count = process(block.getReadPointer(0), n);
+            for (int i = 0; i < count; ++i) found.push_back(pos + getOnset(i));
+        }
+        return found;
+    }
+
+private:
+    void updateCoefficients()
+    {
+        holdSamples = juce::jmax(1, (int)std::lround(holdMs * 0.001 * sampleRate));
+        // envelope falls by ~60 dB over two hold times
+        releasePerFrame = (float)std::pow(0.001, (double)frameSize / (double)holdSamples * 0.5);
+    }
+
+    double sampleRate = 48000.0, holdMs = 40.0;
+    float  floorGain = 0.03f;    // about -30 dBFS
+    float  ratio = 2.0f;     // +6 dB
+    float  releasePerFrame = 0.98f;
+    int    holdSamples = 1920;
+
+    float  slow = 0.0f;
+    int    sinceLast = 0;
+
+    std::vector<float> scratch;
+    std::array<int, maxOnsetsPerBlock> onsets{};
+    int numOnsets = 0;
+};
@@ -0,0 +1,160 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "RealtimeGuard.h"
+#include "RtCheck.h"
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+// =========== ParallelRenderer.h ===========
+// A few real-time worker threads that help the audio thread through a batch
+// of independent jobs (LayerEngine: one job per layer). The audio thread
+// publishes a batch, works on it itself, and spins until the last job is
+// done; nothing is locked or allocated on the way.
+//
+// Jobs are handed out through one 64-bit word, {generation, count, next},
+// claimed by compare-and-swap, so a worker that is late from the previous
+// batch can never take an index of the next one. Idle workers spin briefly
+// after a batch (they are usually needed again a chunk later) and then
+// sleep until the next one is published. In realtimeMode the workers ask
+// for SCHED_FIFO just below the audio thread.
+class ParallelRenderer
+{
+public:
+    using Job = void (*)(void* context, int index);
+
+    static constexpr int maxJobs = 0xffff;
+
+    ParallelRenderer() = default;
+    ~ParallelRenderer() { stop(); }
+
+    // ===== message thread (not while the audio thread is in run()) =====
+    void start(int numThreads)
+    {
+        stop();
+        for (int i = 0; i < numThreads; ++i)
+        {
+            workers.push_back(std::make_unique<Worker>(*this, i));
+            if (!workers.back()->startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(9)))
+                workers.back()->startThread(juce::Thread::Priority::highest);
+        }
+    }
+
+    void stop()
+    {
+        for (auto& w : workers) w->signalThreadShouldExit();
+        for (auto& w : workers) { w->wake.signal(); w->stopThread(1000); }
+        workers.clear();
+    }
+
+    int getNumThreads() const { return (int)workers.size(); }
+
+    // ===== audio thread =====
+    // Calls job(context, i) for every i in [0, count), spread over the
+    // workers and the caller; returns when all have finished.
+    void run(int count, Job job, void* context)
+    {
+        jassert(count <= maxJobs);
+        if (count <= 0) return;
+
+        currentJob = job;
+        currentContext = context;
+        finished.store(0, std::memory_order_relaxed);
+        generation = (generation + 1) & 0xffffffffu;
+        state.store(pack(generation, (juce::uint64)count, 0), std::memory_order_release);
+
+        for (auto& w : workers)
+            if (w->sleeping.load(std::memory_order_acquire))
+            {
+                const RtCheck::Allow wakeUp;   // only after an idle stretch
+                w->wake.signal();
+            }
+
+        work();
+        while (finished.load(std::memory_order_acquire) < count)
+            spinPause();
+    }
+
+private:
+    struct Worker : public juce::Thread
+    {
+        Worker(ParallelRenderer& o, int i) : juce::Thread("Layer render " + juce::String(i + 1)), owner(o) {}
+
+        void run() override
+        {
+            if (RealtimeGuard::isEnabled()) RealtimeGuard::promoteCurrentThread(60);
+
+            juce::uint64 seen = 0;
+            while (!threadShouldExit())
+            {
+                // spin for a while after the last batch, then sleep
+                for (int spin = 0; spin < spinLimit && genOf(owner.state.load(std::memory_order_acquire)) == seen; ++spin)
+                    spinPause();
+
+                const auto s = owner.state.load(std::memory_order_acquire);
+                if (genOf(s) == seen)
+                {
+                    sleeping.store(true, std::memory_order_release);
+                    if (genOf(owner.state.load(std::memory_order_acquire)) == seen)
+                        wake.wait(100);
+                    sleeping.store(false, std::memory_order_release);
+                    continue;
+                }
+                seen = genOf(s);
+                const RealtimeGuard::Probe probe;
+                const RtCheck::Scope rtCheck;
+                owner.work();
+            }
+        }
+
+        ParallelRenderer& owner;
+        juce::WaitableEvent wake;
+        std::atomic<bool> sleeping{ false };
+    };
+
+    static constexpr int spinLimit = 20000;
+
+    static juce::uint64 pack(juce::uint64 gen, juce::uint64 count, juce::uint64 next) { return (gen << 32) | (count << 16) | next; }
+    static juce::uint64 genOf(juce::uint64 s)   { return s >> 32; }
+    static int          countOf(juce::uint64 s) { return (int)((s >> 16) & 0xffff); }
+    static int          nextOf(juce::uint64 s)  { return (int)(s & 0xffff); }
+
+    static void spinPause()
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #elif JUCE_ARM && (defined(__GNUC__) || defined(__clang__))
+        __asm__ __volatile__("yield");
+       #endif
+    }
+
+    // Claims and runs jobs of the current batch until none are left.
+    void work()
+    {
+        auto s = state.load(std::memory_order_acquire);
+        while (nextOf(s) < countOf(s))
+        {
+            if (!state.compare_exchange_weak(s, s + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                continue;
+
+            currentJob(currentContext, nextOf(s));
+            finished.fetch_add(1, std::memory_order_acq_rel);
+            s = state.load(std::memory_order_acquire);
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // written by the audio thread before a batch is published
+    Job   currentJob = nullptr;
+    void* currentContext = nullptr;
+    juce::uint64 generation = 0;
+
+    std::atomic<juce::uint64> state{ 0 };
+    std::atomic<int>          finished{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(ParallelRenderer)
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <JuceHeader.h>
+#include <cmath>
+#include <map>
+#include <memory>
+#include "SampleBuffer.h"
+
+// =========== PitchCache.h ===========
+// Repitched copies of loaded samples, keyed by source buffer and cents.
+// Accent samples follow the Up/Down note selectors by playing a copy that
+// was resampled once (SampleBuffer::createResampled) instead of
+// interpolating on the audio thread, so a pitched hit costs the same as an
+// unpitched one. Copies that aren't playing anywhere are kept (up to
+// `maxIdle`) so flipping between notes doesn't render again.
+// Any thread except the audio thread.
+class PitchCache
+{
+public:
+    static constexpr int maxIdle = 32;
+
+    // `src` shifted by `semitones`; src itself for 0. With render = false a
+    // copy that isn't cached yet comes back as nullptr.
+    SampleBuffer::Ptr get(const SampleBuffer::Ptr& src, double semitones, bool render = true)
+    {
+        const int cents = juce::roundToInt(semitones * 100.0);
+        if (src == nullptr || cents == 0) return src;
+
+        const Key key{ src.get(), cents };
+        {
+            const juce::ScopedLock sl(lock);
+            auto it = entries.find(key);
+            if (it != entries.end() && it->second.source.lock() == src)
+            {
+                it->second.lastUse = ++useCounter;
+                return it->second.copy;
+            }
+        }
+        if (!render) return {};
+
+        auto copy = SampleBuffer::createResampled(*src, std::pow(2.0, (double)cents / 1200.0));
+
+        const juce::ScopedLock sl(lock);
+        entries[key] = { src, copy, ++useCounter };
+        trim();
+        return copy;
+    }
+
+private:
+    using Key = std::pair<const SampleBuffer*, int>;
+
+    struct Entry
+    {
+        std::weak_ptr<const SampleBuffer> source;
+        SampleBuffer::Ptr copy;
+        juce::uint64 lastUse = 0;
+    };
+
+    // Drops copies of unloaded sources, then the least recently used idle
+    // copies beyond maxIdle. Caller holds the lock.
+    void trim()
+    {
+        int idle = 0;
+        for (auto it = entries.begin(); it != entries.end(); )
+        {
+            if (it->second.source.expired()) { it = entries.erase(it); continue; }
+            if (it->second.copy.use_count() == 1) ++idle;
+            ++it;
+        }
+
+        while (idle > maxIdle)
+        {
+            auto oldest = entries.end();
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+                if (it->second.copy.use_count() == 1 && (oldest == entries.end() || it->second.lastUse < oldest->second.lastUse))
+                    oldest = it;
+            if (oldest == entries.end()) break;
+            entries.erase(oldest);
+            --idle;
+        }
+    }
+
+    juce::CriticalSection   lock;
+    std::map<Key, Entry>    entries;
+    juce::uint64            useCounter = 0;
+};
@@ -0,0 +1,232 @@
+#include "PluginProcessor.h"
+#include "SampleLoader.h"
+
+// ================= ctor/dtor =================
+TriBeatAudioProcessor::TriBeatAudioProcessor()
+    : AudioProcessor(BusesProperties().withOutput("Output", juce::AudioChannelSet::stereo(), true))
+{
+    juce::StringArray presetNames{ "Session" };
+    for (int i = 1; i <= PresetBank::numSlots; ++i)
+        presetNames.add("Slot " + juce::String(i));
+
+    addParameter(presetParam = new juce::AudioParameterChoice(juce::ParameterID{ "preset", 1 }, "Preset", presetNames, 0));
+    addParameter(metronomeParam = new juce::AudioParameterBool(juce::ParameterID{ "metronome", 1 }, "Metronome", false));
+
+    formats.registerBasicFormats();
+
+    metronome.setTempo(120.0);
+    metronome.setBeatsPerBar(4);
+    engine.setMetronome(&metronome);
+    engine.setPresetBank(&presetBank);
+    engine.setCrossfadeMs(10.0);
+
+    loadSharedPresetBank();
+
+    PatternPreset p;
+    p.layers.push_back({});   // one triangle, like a fresh app window
+    loadPattern(p);
+
+    startTimerHz(10);
+}
+
+TriBeatAudioProcessor::~TriBeatAudioProcessor()
+{
+    stopTimer();
+}
+
+// ================= audio =================
+void TriBeatAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    engine.prepareToPlay(samplesPerBlock, sampleRate);
+
+    // samples are resampled to the device rate when they are loaded
+    if (sampleRate != preparedRate)
+    {
+        preparedRate = sampleRate;
+        loadPattern(pattern);
+    }
+
+    setLatencySamples(engine.getLatencySamples());
+}
+
+void TriBeatAudioProcessor::releaseResources()
+{
+    engine.releaseResources();
+}
+
+bool TriBeatAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
+{
+    const auto out = layouts.getMainOutputChannelSet();
+    return out == juce::AudioChannelSet::mono() || out == juce::AudioChannelSet::stereo();
+}
+
+void TriBeatAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi)
+{
+    juce::ScopedNoDenormals noDenormals;
+    midi.clear();
+
+    bool hostPlaying = false;
+    double bpm = 120.0, ppq = 0.0;
+    int beatsPerBar = 4;
+
+    if (auto* head = getPlayHead())
+        if (const auto pos = head->getPosition())
+        {
+            hostPlaying = pos->getIsPlaying();
+            if (const auto b = pos->getBpm()) bpm = *b;
+            if (const auto t = pos->getTimeSignature()) beatsPerBar = t->numerator;
+
+            if (const auto q = pos->getPpqPosition())        ppq = *q;
+            else if (const auto s = pos->getTimeInSamples()) ppq = (double)*s / getSampleRate() * bpm / 60.0;
+        }
+
+    const int preset = presetParam->getIndex();
+    if (preset != requestedPreset.load())
+    {
+        requestedPreset.store(preset);
+        if (preset > 0) presetBank.requestSlot(preset - 1);
+    }
+
+    metronome.setPlaying(hostPlaying && metronomeParam->get());
+    engine.followHost(hostPlaying, bpm, ppq, beatsPerBar);
+
+    engine.getNextAudioBlock(juce::AudioSourceChannelInfo(&buffer, 0, buffer.getNumSamples()));
+}
+
+// ================= editor =================
+juce::AudioProcessorEditor* TriBeatAudioProcessor::createEditor()
+{
+    return new juce::GenericAudioProcessorEditor(*this);
+}
+
+// ================= state =================
+void TriBeatAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
+{
+    juce::ValueTree state("TriBeatPlugin");
+    state.setProperty("preset", presetParam->getIndex(), nullptr);
+    state.setProperty("metronome", metronomeParam->get(), nullptr);
+    state.appendChild(pattern.toValueTree(), nullptr);
+
+    if (auto xml = state.createXml())
+        copyXmlToBinary(*xml, destData);
+}
+
+void TriBeatAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
+{
+    const auto xml = getXmlFromBinary(data, sizeInBytes);
+    if (xml == nullptr) return;
+
+    const auto state = juce::ValueTree::fromXml(*xml);
+    if (!state.hasType("TriBeatPlugin")) return;
+
+    *metronomeParam = (bool)state.getProperty("metronome", false);
+
+    const auto p = PatternPreset::fromValueTree(state.getChildWithName("Pattern"));
+    if (!p.isEmpty()) loadPattern(p);
+
+    // the restored pattern is already what the slot produced; don't switch again
+    const int preset = juce::jlimit(0, PresetBank::numSlots, (int)state.getProperty("preset", 0));
+    requestedPreset.store(preset);
+    *presetParam = preset;
+}
+
+// ================= helpers =================
+// Preset slots are stored by the app; the plugin only reads them.
+void TriBeatAudioProcessor::loadSharedPresetBank()
+{
+    juce::PropertiesFile::Options opts;
+    opts.applicationName = "Tri-Beat";
+    opts.filenameSuffix = "settings";
+    opts.osxLibrarySubFolder = "Application Support";
+    opts.storageFormat = juce::PropertiesFile::storeAsXML;
+
+    juce::PropertiesFile settings(opts);
+    sampleOptions = SampleLoader::optionsFrom(settings);
+    presetBank.setSampleOptions(sampleOptions);
+
+    if (auto xml = settings.getXmlValue("presetBank"))
+        presetBank.setFromValueTree(juce::ValueTree::fromXml(*xml));
+}
+
+// Message thread. Replaces the live layer set with voices built from `p`.
+void TriBeatAudioProcessor::loadPattern(const PatternPreset& p)
+{
+    adoptSwitchedSlot();
+    const double sr = presetBank.getSampleRate();
+
+    // one buffer per file, shared by the layers (lets the engine merge hits)
+    std::map<juce::String, ClickAudioSource::SampleData> decoded;
+    auto sample = [&](const juce::String& path) -> ClickAudioSource::SampleData
+        {
+            if (path.isEmpty()) return {};
+            auto& d = decoded[path];
+            if (d == nullptr)
+                d = SampleLoader::load(formats, path, sr, sampleOptions);
+            return d;
+        };
+
+    std::vector<std::unique_ptr<ClickAudioSource>> fresh;
+    for (const auto& l : p.layers)
+    {
+        auto v = PresetBank::createVoice(p, l);
+        const juce::String* paths[] = { &l.kickPath, &l.snarePath, &l.hihatPath };
+        for (int role = 0; role < 3; ++role)
+        {
+            auto original = sample(*paths[role]);
+            v->getOneShot(role).setSample(pitchCache.get(original, v->getSampleSemitones(role)), original);
+        }
+        fresh.push_back(std::move(v));
+    }
+
+    // old voices may still be fading out after a slot switch
+    for (auto& v : layers)
+    {
+        engine.removeLayer(v.get());
+        retired.push_back(std::move(v));
+    }
+    layers.clear();
+
+    for (auto& v : fresh)
+    {
+        engine.addLayer(v.get());
+        layers.push_back(std::move(v));
+    }
+
+    pattern = p;
+    engine.post([this, bpm = p.bpm] { metronome.setTempo(bpm); });
+}
+
+// A slot the audio thread switched to: its voices are live now, the ones
+// they replaced are only referenced by the crossfade (if at all).
+void TriBeatAudioProcessor::adoptSwitchedSlot()
+{
+    const int slot = presetBank.takeCompletedSwitch();
+    if (slot < 0) return;
+
+    PatternPreset p;
+    auto voices = presetBank.takeVoices(slot, p);
+    if (voices.empty()) return;
+
+    for (auto& v : layers)
+    {
+        engine.removeLayer(v.get()); // in case loadPattern() raced the switch
+        retired.push_back(std::move(v));
+    }
+    layers = std::move(voices);
+    pattern = p;
+    presetBank.reload(slot);
+}
+
+void TriBeatAudioProcessor::timerCallback()
+{
+    adoptSwitchedSlot();
+
+    if (!retired.empty() && engine.isFadeIdle())
+        retired.clear();
+}
+
+// ================= factory =================
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
+{
+    return new TriBeatAudioProcessor();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <JuceHeader.h>
+#include "ClickAudioSource.h"
+#include "LayerEngine.h"
+#include "PresetBank.h"
+
+// =========== PluginProcessor.h ===========
+// Tri-Beat as a VST3/LV2 instrument. The same LayerEngine the app uses
+// renders straight into the host buffer; tempo, meter and position come
+// from the host transport, so the layers play on the DAW's grid. The
+// pattern is saved with the host session, and the app's preset slots can
+// be recalled (bar-quantized) through the "Preset" parameter.
+class TriBeatAudioProcessor : public juce::AudioProcessor,
+    private juce::Timer
+{
+public:
+    TriBeatAudioProcessor();
+    ~TriBeatAudioProcessor() override;
+
+    // ===== audio =====
+    void prepareToPlay(double sampleRate, int samplesPerBlock) override;
+    void releaseResources() override;
+    bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+    void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    using AudioProcessor::processBlock;
+
+    // ===== editor =====
+    juce::AudioProcessorEditor* createEditor() override;
+    bool hasEditor() const override { return true; }
+
+    // ===== info =====
+    const juce::String getName() const override { return JucePlugin_Name; }
+    bool acceptsMidi() const override { return false; }
+    bool producesMidi() const override { return false; }
+    bool isMidiEffect() const override { return false; }
+    double getTailLengthSeconds() const override { return 0.0; }
+
+    int getNumPrograms() override { return 1; }
+    int getCurrentProgram() override { return 0; }
+    void setCurrentProgram(int) override {}
+    const juce::String getProgramName(int) override { return {}; }
+    void changeProgramName(int, const juce::String&) override {}
+
+    // ===== state =====
+    void getStateInformation(juce::MemoryBlock& destData) override;
+    void setStateInformation(const void* data, int sizeInBytes) override;
+
+private:
+    void timerCallback() override;
+    void adoptSwitchedSlot();
+    void loadPattern(const PatternPreset& p);
+    void loadSharedPresetBank();
+
+    // 0 = the pattern stored with the session, 1..8 = app preset slots
+    juce::AudioParameterChoice* presetParam = nullptr;
+    juce::AudioParameterBool*   metronomeParam = nullptr;
+
+    MetronomeSource metronome;
+    PresetBank      presetBank;
+    juce::AudioFormatManager formats;
+    SampleBuffer::Options    sampleOptions;   // from the app's settings
+    PitchCache               pitchCache;
+
+    std::vector<std::unique_ptr<ClickAudioSource>> layers;
+    std::vector<std::unique_ptr<ClickAudioSource>> retired; // removed or switched out, kept until the engine is done with them
+    PatternPreset pattern;                                   // what `layers` was built from
+    double preparedRate = 0.0;
+
+    std::atomic<int> requestedPreset{ 0 }; // last slot asked of the bank
+
+    LayerEngine engine;        // last: references everything above
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TriBeatAudioProcessor)
+};
@@ -0,0 +1,140 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <vector>
+#include "ClickAudioSource.h"
+#include "OnsetDetector.h"
+
+// =========== PracticeMonitor.h ===========
+// Listens to the player on an audio input and scores each hit against the
+// pattern. The engine hands it the input block before rendering, while the
+// layers' transports still point at the block start, so every onset can be
+// placed on each playing layer's grid: the hit goes to the layer/vertex
+// whose scheduled step is closest. Device round-trip latency is removed
+// first. Hits are queued lock-free for the message thread, which keeps
+// per-vertex timing stats.
+class PracticeMonitor
+{
+public:
+    static constexpr int maxVertices = ClickAudioSource::maxSteps;
+
+    struct Hit
+    {
+        int   layer = -1, vertex = -1;
+        float errorMs = 0.0f;         // positive = late
+    };
+
+    struct VertexStats
+    {
+        int    hits = 0;
+        double sumMs = 0.0, sumAbsMs = 0.0;
+
+        double meanMs() const    { return hits > 0 ? sumMs / hits : 0.0; }
+        double meanAbsMs() const { return hits > 0 ? sumAbsMs / hits : 0.0; }
+    };
+
+    // ===== message thread =====
+    void setEnabled(bool b) { enabled.store(b); }
+    bool isEnabled() const { return enabled.load(); }
+
+    // input + output latency of the device plus any manual offset
+    void setLatencySamples(int n) { latency.store(juce::jmax(0, n)); }
+
+    OnsetDetector& getDetector() { return detector; }
+
+    // Drains new hits into the stats; returns how many arrived.
+    int collect()
+    {
+        int count = 0;
+        fifo.read(fifo.getNumReady()).forEach([&](int i)
+            {
+                const auto& h = hits[(size_t)i];
+                if (h.layer < 0 || !juce::isPositiveAndBelow(h.vertex, maxVertices)) return;
+                if ((int)stats.size() <= h.layer) stats.resize((size_t)h.layer + 1);
+
+                auto& s = stats[(size_t)h.layer][(size_t)h.vertex];
+                ++s.hits;
+                s.sumMs += h.errorMs;
+                s.sumAbsMs += std::abs(h.errorMs);
+                lastHit = h;
+                ++count;
+            });
+        return count;
+    }
+
+    const VertexStats* getStats(int layer, int vertex) const
+    {
+        if (!juce::isPositiveAndBelow(layer, (int)stats.size()) || !juce::isPositiveAndBelow(vertex, maxVertices)) return nullptr;
+        const auto& s = stats[(size_t)layer][(size_t)vertex];
+        return s.hits > 0 ? &s : nullptr;
+    }
+
+    Hit  getLastHit() const { return lastHit; }
+    void resetStats() { stats.clear(); lastHit = {}; }
+
+    juce::int64 getDroppedCount() const { return dropped.load(); }
+
+    // ===== audio thread =====
+    void prepare(double sr, int maxBlock)
+    {
+        sampleRate = sr;
+        detector.prepare(sr, maxBlock);
+    }
+
+    // `in` is the input for this block; `layers` have not rendered it yet.
+    void analyse(const float* in, int n, const std::vector<ClickAudioSource*>& layers)
+    {
+        if (!enabled.load()) return;
+
+        const int count = detector.process(in, n);
+        const double lat = (double)latency.load();
+
+        for (int o = 0; o < count; ++o)
+        {
+            const double t = (double)detector.getOnset(o) - lat;
+
+            Hit best;
+            double bestOffset = 0.0;
+            for (size_t i = 0; i < layers.size(); ++i)
+            {
+                const auto* v = layers[i];
+                if (!v->isPlaying()) continue;
+
+                double off = 0.0;
+                const int vertex = v->nearestStep((double)v->getTransportSamples() + t, off);
+                if (vertex < 0) continue;
+                if (best.layer < 0 || std::abs(off) < std::abs(bestOffset))
+                {
+                    best.layer = (int)i;
+                    best.vertex = vertex;
+                    bestOffset = off;
+                }
+            }
+            if (best.layer < 0) continue;
+
+            best.errorMs = (float)(bestOffset * 1000.0 / sampleRate);
+            push(best);
+        }
+    }
+
+private:
+    void push(const Hit& h)
+    {
+        if (fifo.getFreeSpace() == 0) { dropped.fetch_add(1); return; }
+        fifo.write(1).forEach([&](int i) { hits[(size_t)i] = h; });
+    }
+
+    OnsetDetector     detector;
+    double            sampleRate = 48000.0;
+    std::atomic<bool> enabled{ false };
+    std::atomic<int>  latency{ 0 };
+
+    juce::AbstractFifo          fifo{ 256 };
+    std::array<Hit, 256>        hits{};
+    std::atomic<juce::int64>    dropped{ 0 };
+
+    // message thread
+    std::vector<std::array<VertexStats, maxVertices>> stats;
+    Hit lastHit;
+};
@@ -0,0 +1,413 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include "ClickAudioSource.h"
+#include "PitchCache.h"
+#include "SampleLoader.h"
+
+// =========== PatternPreset ===========
+// Everything needed to rebuild a groove: transport settings plus, per layer,
+// the shape, accents, tones and the sample files for each role.
+struct LayerPreset
+{
+    int    sides = 3;
+    int    upIndex = -1, downIndex = -1;
+    double upFreqHz = 440.0, downFreqHz = 220.0;
+    juce::String kickPath, snarePath, hihatPath;
+    int    outChannel = 0, outWidth = 2;    // output routing
+    float  gainDb = 0.0f, pan = 0.0f;
+};
+
+struct PatternPreset
+{
+    double bpm = 120.0;
+    bool   polyrhythm = true;
+    bool   muteSubdivisions = false;
+    std::vector<LayerPreset> layers;
+
+    bool isEmpty() const { return layers.empty(); }
+
+    juce::ValueTree toValueTree() const
+    {
+        juce::ValueTree v("Pattern");
+        v.setProperty("bpm", bpm, nullptr);
+        v.setProperty("polyrhythm", polyrhythm, nullptr);
+        v.setProperty("muteSubdivisions", muteSubdivisions, nullptr);
+
+        for (const auto& l : layers)
+        {
+            juce::ValueTree lt("Layer");
+            lt.setProperty("sides", l.sides, nullptr);
+            lt.setProperty("upIndex", l.upIndex, nullptr);
+            lt.setProperty("downIndex", l.downIndex, nullptr);
+            lt.setProperty("upFreqHz", l.upFreqHz, nullptr);
+            lt.setProperty("downFreqHz", l.downFreqHz, nullptr);
+            lt.setProperty("kick", l.kickPath, nullptr);
+            lt.setProperty("snare", l.snarePath, nullptr);
+            lt.setProperty("hihat", l.hihatPath, nullptr);
+            lt.setProperty("outChannel", l.outChannel, nullptr);
+            lt.setProperty("outWidth", l.outWidth, nullptr);
+            lt.setProperty("gainDb", l.gainDb, nullptr);
+            lt.setProperty("pan", l.pan, nullptr);
+            v.appendChild(lt, nullptr);
+        }
+        return v;
+    }
+
+    static PatternPreset fromValueTree(const juce::ValueTree& v)
+    {
+        PatternPreset p;
+        if (!v.hasType("Pattern")) return p;
+
+        p.bpm = (double)v.getProperty("bpm", 120.0);
+        p.polyrhythm = (bool)v.getProperty("polyrhythm", true);
+        p.muteSubdivisions = (bool)v.getProperty("muteSubdivisions", false);
+
+        for (const auto& lt : v)
+        {
+            if (!lt.hasType("Layer")) continue;
+            LayerPreset l;
+            l.sides = juce::jlimit(1, ClickAudioSource::maxSteps, (int)lt.getProperty("sides", 3));
+            l.upIndex = (int)lt.getProperty("upIndex", -1);
+            l.downIndex = (int)lt.getProperty("downIndex", -1);
+            l.upFreqHz = (double)lt.getProperty("upFreqHz", 440.0);
+            l.downFreqHz = (double)lt.getProperty("downFreqHz", 220.0);
+            l.kickPath = lt.getProperty("kick").toString();
+            l.snarePath = lt.getProperty("snare").toString();
+            l.hihatPath = lt.getProperty("hihat").toString();
+            l.outChannel = (int)lt.getProperty("outChannel", 0);
+            l.outWidth = (int)lt.getProperty("outWidth", 2);
+            l.gainDb = (float)lt.getProperty("gainDb", 0.0f);
+            l.pan = (float)lt.getProperty("pan", 0.0f);
+            p.layers.push_back(std::move(l));
+        }
+        return p;
+    }
+};
+
+// =========== PresetBank ===========
+// Fixed set of slots, each holding a fully prepared set of layer sources
+// (samples decoded, resampled and shared per file) built on a background thread.
+// The audio thread swaps a ready slot in at the next bar (see LayerEngine);
+// the message thread then takes ownership and the slot is rebuilt from its
+// preset so it can be recalled again.
+class PresetBank
+{
+public:
+    static constexpr int numSlots = 8;
+
+    struct Slot
+    {
+        PatternPreset preset;
+        bool hasPreset = false;
+        int  generation = 0;
+
+        std::vector<std::unique_ptr<ClickAudioSource>> owned;
+        std::vector<ClickAudioSource*>                 voices;  // fixed while ready
+        std::atomic<bool>                              ready{ false };
+        std::atomic<bool>                              consumed{ false };
+
+        // voices the audio thread switched in, parked here if the slot gets
+        // rebuilt before the message thread has taken them
+        std::vector<std::unique_ptr<ClickAudioSource>> handoff;
+        PatternPreset                                  handoffPreset;
+    };
+
+    PresetBank() { pool.addJob([this] { formats.registerBasicFormats(); }); }
+    ~PresetBank() { pool.removeAllJobs(true, -1); }   // a running build finishes; nothing here holds its locks
+
+    // ===== message thread =====
+    void prepare(double sr, int block)
+    {
+        const bool rateChanged = (sr != sampleRate);
+        sampleRate = sr; blockSize = juce::jmax(1, block);
+        if (!rateChanged) return;
+
+        pool.addJob([this] { sampleCache.clear(); });
+        for (int i = 0; i < numSlots; ++i)
+            reload(i);
+    }
+
+    // Where slots look for a sample before decoding it themselves, e.g. the
+    // buffers the app already holds (bundled with a session, or loaded by a
+    // layer); nullptr if it has none. Called on the loader thread. Clearing
+    // it returns only once no call is running, so the owner can go.
+    using SampleSource = std::function<ClickAudioSource::SampleData(const juce::String& path, double sr)>;
+    void setSampleSource(SampleSource source)
+    {
+        const juce::ScopedLock sl(sourceLock);
+        sampleSource = std::move(source);
+    }
+
+    // Storage/trim for samples loaded from now on; rebuilds the slots.
+    void setSampleOptions(const SampleBuffer::Options& o)
+    {
+        pool.addJob([this, o] { sampleOptions = o; sampleCache.clear(); });
+        for (int i = 0; i < numSlots; ++i)
+            reload(i);
+    }
+
+    void setPreset(int slot, const PatternPreset& p)
+    {
+        if (!juce::isPositiveAndBelow(slot, numSlots)) return;
+        {
+            const juce::ScopedLock sl(slotLock);
+            auto& s = slots[(size_t)slot];
+            unpublish(s);
+            s.preset = p;
+            s.hasPreset = !p.isEmpty();
+        }
+        reload(slot);
+    }
+
+    PatternPreset getPreset(int slot) const
+    {
+        const juce::ScopedLock sl(slotLock);
+        return juce::isPositiveAndBelow(slot, numSlots) && slots[(size_t)slot].hasPreset
+            ? slots[(size_t)slot].preset : PatternPreset{};
+    }
+
+    // "PresetBank" tree with one "Slot" child (holding a "Pattern") per stored slot
+    juce::ValueTree toValueTree() const
+    {
+        juce::ValueTree bank("PresetBank");
+        for (int i = 0; i < numSlots; ++i)
+        {
+            const auto p = getPreset(i);
+            if (p.isEmpty()) continue;
+
+            juce::ValueTree slot("Slot");
+            slot.setProperty("index", i, nullptr);
+            slot.appendChild(p.toValueTree(), nullptr);
+            bank.appendChild(slot, nullptr);
+        }
+        return bank;
+    }
+
+    void setFromValueTree(const juce::ValueTree& bank)
+    {
+        for (const auto& slot : bank)
+            if (slot.hasType("Slot") && slot.getNumChildren() > 0)
+                setPreset((int)slot.getProperty("index", -1), PatternPreset::fromValueTree(slot.getChild(0)));
+    }
+
+    // Config-only voice for one layer of a pattern (no samples, not prepared).
+    static std::unique_ptr<ClickAudioSource> createVoice(const PatternPreset& p, const LayerPreset& l)
+    {
+        auto src = std::make_unique<ClickAudioSource>();
+        src->setTempo(p.bpm);
+        src->setPolyrhythm(p.polyrhythm);
+        src->setHostBeatsPerBar(4);
+        if (p.polyrhythm) src->setSubdivisions(l.sides);
+        else              src->setBeatsPerBar(l.sides);
+        src->setUpbeatIndex(l.upIndex);
+        src->setDownbeatIndex(l.downIndex);
+        src->setUpbeatFreqHz(l.upFreqHz);
+        src->setDownbeatFreqHz(l.downFreqHz);
+        src->setMuteSubdivisions(p.muteSubdivisions);
+        src->outChannel = juce::jmax(0, l.outChannel);
+        src->outWidth = juce::jlimit(1, 2, l.outWidth);
+        src->outGain = juce::Decibels::decibelsToGain(l.gainDb, -60.0f);
+        src->outPan = juce::jlimit(-1.0f, 1.0f, l.pan);
+        return src;
+    }
+
+    bool hasPreset(int slot) const
+    {
+        const juce::ScopedLock sl(slotLock);
+        return juce::isPositiveAndBelow(slot, numSlots) && slots[(size_t)slot].hasPreset;
+    }
+
+    // Rebuild the slot's voices from its preset in the background.
+    void reload(int slot)
+    {
+        if (!juce::isPositiveAndBelow(slot, numSlots)) return;
+
+        PatternPreset p; int gen = 0;
+        {
+            const juce::ScopedLock sl(slotLock);
+            auto& s = slots[(size_t)slot];
+            unpublish(s);
+            gen = ++s.generation;
+            if (!s.hasPreset) return;
+            p = s.preset;
+        }
+
+        const double sr = sampleRate; const int block = blockSize;
+        pool.addJob([this, slot, gen, p, sr, block] { build(slot, gen, p, sr, block); });
+    }
+
+    void requestSlot(int slot)
+    {
+        if (juce::isPositiveAndBelow(slot, numSlots)) pending.store(slot);
+    }
+
+    // Returns the slot the audio thread switched to since the last call, or -1.
+    int takeCompletedSwitch() { return completed.exchange(-1); }
+
+    // Hands the voices of a slot that was switched in over to the caller.
+    std::vector<std::unique_ptr<ClickAudioSource>> takeVoices(int slot, PatternPreset& presetOut)
+    {
+        std::vector<std::unique_ptr<ClickAudioSource>> out;
+        if (!juce::isPositiveAndBelow(slot, numSlots)) return out;
+
+        const juce::ScopedLock sl(slotLock);
+        auto& s = slots[(size_t)slot];
+        if (!s.consumed.exchange(false)) return out;
+
+        if (!s.handoff.empty())
+        {
+            presetOut = s.handoffPreset;
+            out = std::move(s.handoff);
+            s.handoff.clear();
+        }
+        else
+        {
+            presetOut = s.preset;
+            out = std::move(s.owned);
+            s.owned.clear();
+            s.voices.clear();
+        }
+        return out;
+    }
+
+    double getSampleRate() const { return sampleRate; }
+
+    // ===== audio thread =====
+    bool hasArmedSwitch() const
+    {
+        const int i = pending.load();
+        return i >= 0 && slots[(size_t)i].ready.load(std::memory_order_acquire);
+    }
+
+    // Calls swapIn(slot) with the armed slot if it can be taken without
+    // blocking; the slot is then unpublished and reported as completed.
+    // While the message thread holds the slot the switch waits a bar.
+    template <typename SwapIn>
+    bool consumePending(SwapIn&& swapIn)
+    {
+        const int i = pending.load();
+        if (i < 0) return false;
+
+        const juce::ScopedTryLock tl(publishLock);
+        if (!tl.isLocked()) return false;
+
+        auto& s = slots[(size_t)i];
+        if (!s.ready.load(std::memory_order_acquire) || s.consumed.load()) return false;
+
+        swapIn(static_cast<const Slot&>(s));
+        s.ready.store(false, std::memory_order_release);
+        s.consumed.store(true);
+
+        int expected = i;
+        pending.compare_exchange_strong(expected, -1);
+        completed.store(i);
+        return true;
+    }
+
+private:
+    // Caller holds slotLock.
+    void unpublish(Slot& s)
+    {
+        const juce::ScopedLock pl(publishLock);
+        s.ready.store(false, std::memory_order_release);
+        stashConsumed(s);
+        s.voices.clear();
+        s.owned.clear();
+    }
+
+    // Caller holds slotLock and publishLock. Voices that are live on the
+    // audio thread must never be destroyed here.
+    void stashConsumed(Slot& s)
+    {
+        if (s.consumed.load() && !s.owned.empty() && s.handoff.empty())
+        {
+            s.handoff = std::move(s.owned);
+            s.handoffPreset = s.preset;
+            s.owned.clear();
+        }
+    }
+
+    // ===== loader thread =====
+    void build(int slot, int gen, const PatternPreset& p, double sr, int block)
+    {
+        std::vector<std::unique_ptr<ClickAudioSource>> built;
+        built.reserve(p.layers.size());
+
+        for (const auto& l : p.layers)
+        {
+            auto src = createVoice(p, l);
+            src->prepareToPlay(block, sr);
+
+            const juce::String* paths[] = { &l.kickPath, &l.snarePath, &l.hihatPath };
+            for (int role = 0; role < 3; ++role)
+            {
+                auto original = cachedSample(*paths[role], sr);
+                src->getOneShot(role).setSample(pitchCache.get(original, src->getSampleSemitones(role)), original);
+            }
+
+            src->setPlaying(false);
+            src->restart();
+            built.push_back(std::move(src));
+        }
+
+        const juce::ScopedLock sl(slotLock);
+        auto& s = slots[(size_t)slot];
+        if (s.generation != gen) return; // superseded while we were building
+
+        const juce::ScopedLock pl(publishLock);
+        stashConsumed(s);
+        s.owned = std::move(built);
+        s.voices.clear();
+        for (auto& v : s.owned) s.voices.push_back(v.get());
+        s.ready.store(true, std::memory_order_release);
+    }
+
+    // Voices using the same file(s) share one buffer (see VoicePool). The
+    // sample source is asked first, so a slot plays the very buffer the
+    // app's layers do rather than a copy decoded earlier.
+    ClickAudioSource::SampleData cachedSample(const juce::String& path, double sr)
+    {
+        if (path.isEmpty()) return {};
+
+        ClickAudioSource::SampleData shared;
+        {
+            const juce::ScopedLock sl(sourceLock);
+            if (sampleSource) shared = sampleSource(path, sr);
+        }
+        if (shared != nullptr) return sampleCache[path] = std::move(shared);
+
+        auto it = sampleCache.find(path);
+        if (it == sampleCache.end())
+            it = sampleCache.emplace(path, SampleLoader::load(formats, path, sr, sampleOptions)).first;
+
+        return it->second;
+    }
+
+    std::array<Slot, numSlots> slots;
+    juce::CriticalSection slotLock;     // message/loader thread
+    juce::CriticalSection publishLock;  // only ever try-locked by the audio thread
+
+    std::atomic<int> pending{ -1 };
+    std::atomic<int> completed{ -1 };
+
+    double sampleRate = 48000.0;
+    int    blockSize = 512;
+
+    // loader thread only
+    juce::AudioFormatManager formats;
+    std::map<juce::String, ClickAudioSource::SampleData> sampleCache;
+    SampleBuffer::Options sampleOptions;
+    PitchCache            pitchCache;
+
+    juce::CriticalSection sourceLock;   // message thread sets, loader thread calls
+    SampleSource          sampleSource;
+
+    // after everything its jobs use, so its thread is stopped before they go
+    juce::ThreadPool pool{ 1 };
+
+    JUCE_DECLARE_NON_COPYABLE(PresetBank)
+};
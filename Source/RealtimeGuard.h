@@ -0,0 +1,166 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+ #include <pthread.h>
+ #include <sched.h>
+ #include <sys/mman.h>
+ #include <sys/resource.h>
+ #include <unistd.h>
+#elif JUCE_WINDOWS
+ // from kernel32, which JUCE links
+ extern "C" __declspec(dllimport) int   __stdcall VirtualLock(void*, size_t);
+ extern "C" __declspec(dllimport) void* __stdcall GetCurrentThread();
+ extern "C" __declspec(dllimport) int   __stdcall SetThreadPriority(void*, int);
+#endif
+
+// =========== RealtimeGuard.h ===========
+// Opt-in hardening of the audio path (setting realtimeMode):
+//  - memory the audio thread reads or writes (engine lines, limiter state,
+//    sample data) is locked into RAM and prefaulted when it is allocated,
+//    so the callback never waits on a page fault or on swap;
+//  - the audio thread and the render workers ask for SCHED_FIFO, up to the
+//    RLIMIT_RTPRIO the user has been granted (limits.conf / rtkit's limit);
+//  - page faults and involuntary context switches (preemptions) that happen
+//    inside callbacks and render batches are counted (Linux; getrusage per
+//    thread).
+// Locks aren't taken back when a buffer is freed: large blocks go back to
+// the OS (and lose the lock) anyway, and small ones are reused by the heap.
+// Nothing here throws; a lock or priority that is refused is only reported.
+struct RealtimeGuard
+{
+    // ===== any thread =====
+    static void setEnabled(bool b) { enabledFlag().store(b); }
+    static bool isEnabled() { return enabledFlag().load(std::memory_order_relaxed); }
+
+    // Locks [data, data + bytes) into RAM and touches every page. Pass
+    // writable for buffers the audio thread writes, so the first write
+    // doesn't fault either (only while nothing else uses the buffer).
+    static bool lockMemory(const void* data, size_t bytes, bool writable)
+    {
+        if (data == nullptr || bytes == 0) return true;
+
+        const size_t page = pageSize();
+        const auto base = reinterpret_cast<juce::pointer_sized_uint>(data);
+        const auto first = base & ~(juce::pointer_sized_uint)(page - 1);
+        const auto end = base + bytes;
+
+       #if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+        const bool locked = mlock(reinterpret_cast<void*>(first), (size_t)(end - first)) == 0;
+       #elif JUCE_WINDOWS
+        const bool locked = VirtualLock(reinterpret_cast<void*>(first), (size_t)(end - first)) != 0;
+       #else
+        const bool locked = false;
+       #endif
+
+        // one byte per page, inside the buffer (the first page may start before it)
+        auto* p = static_cast<volatile char*>(const_cast<void*>(data));
+        auto touch = [&](size_t i) { const char c = p[i]; if (writable) p[i] = c; };
+        touch(0);
+        for (auto a = first + page; a < end; a += page) touch((size_t)(a - base));
+
+        if (!locked) counters().lockFailures.fetch_add(1, std::memory_order_relaxed);
+        return locked;
+    }
+
+    static void lockBuffer(juce::AudioBuffer<float>& b)
+    {
+        for (int c = 0; c < b.getNumChannels(); ++c)
+            lockMemory(b.getWritePointer(c), (size_t)b.getNumSamples() * sizeof(float), true);
+    }
+
+    // ===== the thread itself =====
+    // SCHED_FIFO at `priority` (1..99), clamped to what the user may use.
+    // A thread that is real-time already (JACK's) is left as it is.
+    static bool promoteCurrentThread(int priority = 70)
+    {
+       #if JUCE_LINUX || JUCE_BSD
+        int policy = SCHED_OTHER;
+        sched_param current{};
+        if (pthread_getschedparam(pthread_self(), &policy, &current) == 0 && (policy == SCHED_FIFO || policy == SCHED_RR))
+            return true;
+
+        int prio = juce::jlimit(1, sched_get_priority_max(SCHED_FIFO), priority);
+        rlimit rl{};
+        if (getrlimit(RLIMIT_RTPRIO, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur > 0)
+            prio = juce::jmin(prio, (int)rl.rlim_cur);
+
+        sched_param param{};
+        param.sched_priority = prio;
+        const bool ok = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+       #elif JUCE_WINDOWS
+        juce::ignoreUnused(priority);
+        const bool ok = SetThreadPriority(GetCurrentThread(), 15 /* THREAD_PRIORITY_TIME_CRITICAL */) != 0;
+       #else
+        juce::ignoreUnused(priority);   // CoreAudio's threads are real-time already
+        const bool ok = true;
+       #endif
+
+        if (!ok) counters().priorityFailures.fetch_add(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+    // Counts the faults and preemptions of the current thread between
+    // construction and destruction (a callback, a render batch).
+    struct Probe
+    {
+        Probe() : active(isEnabled()) { if (active) sample(faults, switches); }
+
+        ~Probe()
+        {
+            if (!active) return;
+            long f = 0, s = 0;
+            sample(f, s);
+            if (f > faults)   counters().pageFaults.fetch_add(f - faults, std::memory_order_relaxed);
+            if (s > switches) counters().preemptions.fetch_add(s - switches, std::memory_order_relaxed);
+        }
+
+    private:
+        static void sample(long& f, long& s)
+        {
+           #if JUCE_LINUX
+            rusage u{};
+            if (getrusage(RUSAGE_THREAD, &u) == 0) { f = u.ru_minflt + u.ru_majflt; s = u.ru_nivcsw; }
+           #else
+            juce::ignoreUnused(f, s);
+           #endif
+        }
+
+        const bool active;
+        long faults = 0, switches = 0;
+
+        JUCE_DECLARE_NON_COPYABLE(Probe)
+    };
+
+    struct Counters
+    {
+        std::atomic<juce::int64> pageFaults{ 0 }, preemptions{ 0 };
+        std::atomic<int>         lockFailures{ 0 }, priorityFailures{ 0 };
+    };
+
+    static Counters& counters() { static Counters c; return c; }
+
+    static juce::String describe()
+    {
+        auto& c = counters();
+        juce::String s = "RT: " + juce::String(c.pageFaults.load()) + " page faults, "
+                       + juce::String(c.preemptions.load()) + " preemptions";
+        if (c.lockFailures.load() > 0)     s << ", " << c.lockFailures.load() << " unlocked buffers";
+        if (c.priorityFailures.load() > 0) s << ", no RT priority";
+        return s;
+    }
+
+private:
+    static std::atomic<bool>& enabledFlag() { static std::atomic<bool> b{ false }; return b; }
+
+    static size_t pageSize()
+    {
+       #if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+        static const size_t size = (size_t)juce::jmax(4096L, sysconf(_SC_PAGESIZE));
+        return size;
+       #else
+        return 4096;
+       #endif
+    }
+};
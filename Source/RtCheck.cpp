@@ -0,0 +1,191 @@
+#include "RtCheck.h"
+
+#if TRIBEAT_RT_CHECKS
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__GLIBC__)
+ #define TRIBEAT_RT_INTERPOSE 1
+ #include <dlfcn.h>
+ #include <execinfo.h>
+ #include <malloc.h>
+ #include <pthread.h>
+ #include <unistd.h>
+
+ extern "C" void* __libc_malloc(size_t);
+ extern "C" void* __libc_calloc(size_t, size_t);
+ extern "C" void* __libc_realloc(void*, size_t);
+ extern "C" void* __libc_memalign(size_t, size_t);
+ extern "C" void  __libc_free(void*);
+#else
+ #define TRIBEAT_RT_INTERPOSE 0
+#endif
+
+// =========== RtCheck.cpp ===========
+// The hooks behind RtCheck.h. Only trivially initialised thread_locals are
+// used, so checking costs no allocation; while a report is being written
+// (the first backtrace() loads libgcc) the hooks stay quiet.
+namespace
+{
+    thread_local int  scopeDepth = 0, allowDepth = 0;
+    thread_local bool reporting = false;
+    std::atomic<int>  violations{ 0 };
+
+    void writeError(const char* s)
+    {
+       #if TRIBEAT_RT_INTERPOSE
+        const auto ignored = ::write(2, s, std::strlen(s));
+        (void)ignored;
+       #else
+        std::fputs(s, stderr);
+       #endif
+    }
+
+    void report(const char* what)
+    {
+        if (scopeDepth == 0 || allowDepth > 0 || reporting) return;
+        reporting = true;
+        violations.fetch_add(1);
+
+        writeError("[RtCheck] ");
+        writeError(what);
+        writeError(" on the audio thread\n");
+       #if TRIBEAT_RT_INTERPOSE
+        void* frames[48];
+        const int n = backtrace(frames, 48);
+        backtrace_symbols_fd(frames + 2, n - 2, 2);   // from the caller of the hook
+        writeError("\n");
+       #endif
+        reporting = false;
+    }
+
+    // allocation without going through the hooks again
+    void* rawAlloc(std::size_t n)
+    {
+       #if TRIBEAT_RT_INTERPOSE
+        return __libc_malloc(n == 0 ? 1 : n);
+       #else
+        return std::malloc(n == 0 ? 1 : n);
+       #endif
+    }
+
+    void* rawAlignedAlloc(std::size_t n, std::size_t align)
+    {
+       #if TRIBEAT_RT_INTERPOSE
+        return __libc_memalign(align, n == 0 ? 1 : n);
+       #elif defined(_MSC_VER)
+        return _aligned_malloc(n == 0 ? 1 : n, align);
+       #else
+        return std::aligned_alloc(align, (n + align - 1) / align * align);
+       #endif
+    }
+
+    void rawFree(void* p)
+    {
+       #if TRIBEAT_RT_INTERPOSE
+        __libc_free(p);
+       #else
+        std::free(p);
+       #endif
+    }
+
+    void rawAlignedFree(void* p)
+    {
+       #if defined(_MSC_VER)
+        _aligned_free(p);
+       #else
+        rawFree(p);
+       #endif
+    }
+
+    void* checkedNew(std::size_t n)
+    {
+        report("operator new");
+        if (auto* p = rawAlloc(n)) return p;
+        throw std::bad_alloc();
+    }
+
+    void* checkedAlignedNew(std::size_t n, std::align_val_t a)
+    {
+        report("operator new");
+        if (auto* p = rawAlignedAlloc(n, (std::size_t)a)) return p;
+        throw std::bad_alloc();
+    }
+
+    void checkedDelete(void* p)        { if (p != nullptr) { report("operator delete"); rawFree(p); } }
+    void checkedAlignedDelete(void* p) { if (p != nullptr) { report("operator delete"); rawAlignedFree(p); } }
+}
+
+RtCheck::Scope::Scope()  { ++scopeDepth; }
+RtCheck::Scope::~Scope() { --scopeDepth; }
+RtCheck::Allow::Allow()  { ++allowDepth; }
+RtCheck::Allow::~Allow() { --allowDepth; }
+int RtCheck::getViolationCount() { return violations.load(); }
+
+// ===== operator new/delete =====
+void* operator new(std::size_t n)                                      { return checkedNew(n); }
+void* operator new[](std::size_t n)                                    { return checkedNew(n); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept      { report("operator new"); return rawAlloc(n); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept    { report("operator new"); return rawAlloc(n); }
+void* operator new(std::size_t n, std::align_val_t a)                  { return checkedAlignedNew(n, a); }
+void* operator new[](std::size_t n, std::align_val_t a)                { return checkedAlignedNew(n, a); }
+void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept   { report("operator new"); return rawAlignedAlloc(n, (std::size_t)a); }
+void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { report("operator new"); return rawAlignedAlloc(n, (std::size_t)a); }
+
+void operator delete(void* p) noexcept                                 { checkedDelete(p); }
+void operator delete[](void* p) noexcept                               { checkedDelete(p); }
+void operator delete(void* p, std::size_t) noexcept                    { checkedDelete(p); }
+void operator delete[](void* p, std::size_t) noexcept                  { checkedDelete(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept          { checkedDelete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept        { checkedDelete(p); }
+void operator delete(void* p, std::align_val_t) noexcept               { checkedAlignedDelete(p); }
+void operator delete[](void* p, std::align_val_t) noexcept             { checkedAlignedDelete(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept  { checkedAlignedDelete(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { checkedAlignedDelete(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept   { checkedAlignedDelete(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { checkedAlignedDelete(p); }
+
+#if TRIBEAT_RT_INTERPOSE
+// ===== glibc: malloc & co., pthread_mutex_lock =====
+// Defined in the executable, these take the place of libc's for every
+// library in the process.
+extern "C"
+{
+    void* malloc(size_t n) noexcept                { report("malloc"); return __libc_malloc(n); }
+    void* calloc(size_t n, size_t size) noexcept   { report("calloc"); return __libc_calloc(n, size); }
+    void* realloc(void* p, size_t n) noexcept      { report("realloc"); return __libc_realloc(p, n); }
+    void  free(void* p) noexcept                   { if (p != nullptr) report("free"); __libc_free(p); }
+    void* memalign(size_t a, size_t n) noexcept    { report("memalign"); return __libc_memalign(a, n); }
+    void* aligned_alloc(size_t a, size_t n) noexcept { report("aligned_alloc"); return __libc_memalign(a, n); }
+
+    int posix_memalign(void** out, size_t a, size_t n) noexcept
+    {
+        report("posix_memalign");
+        if (a < sizeof(void*) || (a & (a - 1)) != 0) return 22;   // EINVAL
+        *out = __libc_memalign(a, n);
+        return *out != nullptr ? 0 : 12;                          // ENOMEM
+    }
+
+    using MutexLockFn = int (*)(pthread_mutex_t*);
+    static std::atomic<MutexLockFn> realMutexLock{ nullptr };
+
+    // resolved at load time, so the hook never calls dlsym on a checked thread
+    __attribute__((constructor)) static void resolveMutexLock()
+    {
+        realMutexLock.store(reinterpret_cast<MutexLockFn>(dlsym(RTLD_NEXT, "pthread_mutex_lock")));
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* m) noexcept
+    {
+        report("pthread_mutex_lock");
+        auto fn = realMutexLock.load(std::memory_order_relaxed);
+        if (fn == nullptr) { resolveMutexLock(); fn = realMutexLock.load(); }
+        return fn(m);
+    }
+}
+#endif
+
+#endif
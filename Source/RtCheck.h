@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef TRIBEAT_RT_CHECKS
+ #define TRIBEAT_RT_CHECKS 0
+#endif
+
+// =========== RtCheck.h ===========
+// Debug aid (CMake option TRIBEAT_RT_CHECKS). While a Scope is open on a
+// thread, every heap allocation or free and every blocking mutex lock made
+// by that thread is reported to stderr with a stack trace, and counted.
+// LayerEngine opens one around each whole callback, before it runs the
+// changes posted to it, and ParallelRenderer around each render batch.
+// Allow marks a deliberate exception inside a Scope.
+//
+// The hooks (RtCheck.cpp) replace the global operator new/delete; on glibc
+// they also interpose malloc & co. and pthread_mutex_lock, which catches
+// juce::CriticalSection and allocations inside C libraries. Without the
+// option both classes are empty and nothing is hooked.
+struct RtCheck
+{
+   #if TRIBEAT_RT_CHECKS
+    struct Scope { Scope(); ~Scope(); };
+    struct Allow { Allow(); ~Allow(); };
+    static int getViolationCount();
+   #else
+    struct Scope { Scope() {} };
+    struct Allow { Allow() {} };
+    static int getViolationCount() { return 0; }
+   #endif
+};
@@ -0,0 +1,435 @@
+#pragma once
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "RealtimeGuard.h"
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+ #include <immintrin.h>
+ #define TRIBEAT_F16C 1
+#else
+ #define TRIBEAT_F16C 0
+#endif
+
+// =========== SampleBuffer.h ===========
+// Immutable one-shot as the audio thread plays it: already at the device
+// rate, mixed to mono (stereo files have always played as mono), with the
+// leading and trailing silence cut off at load time. The samples can be
+// kept as float, 16-bit (scaled to the sample's own peak) or half float;
+// read() expands a run back to float with a loop the compiler vectorizes
+// (F16C for half when the target has it). int16/half use 1/2 the memory of
+// mono float and 1/4 of the stereo buffers they replace.
+// A buffer can hold a whole set of variations of one sound: velocity layers,
+// each with any number of round-robin takes, packed back to back in one
+// block so hundreds of them stay contiguous. select() picks a zone in O(1).
+// createResampled() makes a repitched copy (see PitchCache); writeTo() and
+// readFrom() store a buffer as-is in a session bundle (see SessionFile).
+// In realtimeMode every new buffer is locked into RAM (see RealtimeGuard).
+class SampleBuffer
+{
+public:
+    enum class Format { float32, int16, half };
+
+    struct Options
+    {
+        Format format = Format::float32;
+        float  trimDb = -60.0f;    // at or below -120: no trimming
+    };
+
+    // one take as decoded; layers are ordered by velocity, softest first
+    struct Variation
+    {
+        const juce::AudioBuffer<float>* audio = nullptr;
+        int velocityLayer = 0;
+    };
+
+    // where one take lives in the packed data
+    struct Zone
+    {
+        int start = 0, length = 0;
+    };
+
+    using Ptr = std::shared_ptr<const SampleBuffer>;
+
+    // ===== any thread except audio =====
+    static Ptr create(const juce::AudioBuffer<float>& in, const Options& opts)
+    {
+        return create(std::vector<Variation>{ { &in, 0 } }, opts);
+    }
+
+    static Ptr create(std::vector<Variation> vars, const Options& opts)
+    {
+        vars.erase(std::remove_if(vars.begin(), vars.end(), [](const Variation& v)
+            { return v.audio == nullptr || v.audio->getNumChannels() == 0 || v.audio->getNumSamples() == 0; }), vars.end());
+        if (vars.empty()) return {};
+
+        std::stable_sort(vars.begin(), vars.end(), [](const Variation& a, const Variation& b) { return a.velocityLayer < b.velocityLayer; });
+
+        auto b = std::shared_ptr<SampleBuffer>(new SampleBuffer());
+        b->format = opts.format;
+
+        // mono, trimmed takes back to back; velocity layers renumbered 0..n-1
+        std::vector<float> packed;
+        int lastTag = vars.front().velocityLayer;
+        b->layers.push_back({ 0, 0 });
+        for (const auto& v : vars)
+        {
+            if (v.velocityLayer != lastTag) { lastTag = v.velocityLayer; b->layers.push_back({ (int)b->zones.size(), 0 }); }
+
+            auto mono = toMono(*v.audio);
+            int start = 0, end = (int)mono.size();
+            if (opts.trimDb > -120.0f) trim(mono, juce::Decibels::decibelsToGain(opts.trimDb), start, end);
+
+            b->zones.push_back({ (int)packed.size(), end - start });
+            packed.insert(packed.end(), mono.begin() + start, mono.begin() + end);
+            ++b->layers.back().count;
+        }
+
+        const int numLayers = (int)b->layers.size();
+        for (int i = 0; i < 128; ++i)
+            b->velocityMap[(size_t)i] = (juce::uint8)juce::jmin(numLayers - 1, i * numLayers / 128);
+
+        b->encode(packed);
+        b->lockIfRealtime();
+        return b;
+    }
+
+    // A copy played `ratio` times faster (higher pitch for ratio > 1). Each
+    // take is resampled on its own with a 4-point cubic; format, velocity
+    // layers and round-robin order stay the same.
+    static Ptr createResampled(const SampleBuffer& src, double ratio)
+    {
+        ratio = juce::jlimit(0.125, 8.0, ratio);
+
+        auto b = std::shared_ptr<SampleBuffer>(new SampleBuffer());
+        b->format = src.format;
+        b->layers = src.layers;
+        b->velocityMap = src.velocityMap;
+
+        std::vector<float> packed, in;
+        for (const auto& z : src.zones)
+        {
+            in.resize((size_t)z.length);
+            src.read(in.data(), z.start, z.length);
+
+            const int outLen = juce::jmax(1, (int)std::ceil((double)z.length / ratio));
+            b->zones.push_back({ (int)packed.size(), outLen });
+            packed.resize(packed.size() + (size_t)outLen);
+            resampleCubic(in.data(), z.length, packed.data() + b->zones.back().start, outLen, ratio);
+        }
+
+        b->encode(packed);
+        b->lockIfRealtime();
+        return b;
+    }
+
+    // ===== serialisation (SessionFile bundles) =====
+    // Header, then the stored samples exactly as they are in memory, so
+    // reading one back is a copy rather than a decode.
+    void writeTo(juce::OutputStream& out) const
+    {
+        out.writeInt((int)format);
+        out.writeInt(numSamples);
+        out.writeFloat(scale);
+        out.writeInt((int)zones.size());
+        out.writeInt((int)layers.size());
+        for (const auto& z : zones)  { out.writeInt(z.start); out.writeInt(z.length); }
+        for (const auto& l : layers) { out.writeInt(l.first); out.writeInt(l.count); }
+        out.write(velocityMap.data(), velocityMap.size());
+        out.write(rawData(), (size_t)numSamples * bytesPerSample(format));
+    }
+
+    // nullptr if `data` doesn't hold a complete, consistent buffer.
+    static Ptr readFrom(const void* data, size_t size)
+    {
+        juce::MemoryInputStream in(data, size, false);
+        auto b = std::shared_ptr<SampleBuffer>(new SampleBuffer());
+
+        const int fmt = in.readInt();
+        if (fmt < (int)Format::float32 || fmt > (int)Format::half) return {};
+        b->format = (Format)fmt;
+        b->numSamples = in.readInt();
+        b->scale = in.readFloat();
+        const int numZones = in.readInt(), numLayers = in.readInt();
+
+        if (b->numSamples <= 0 || numZones <= 0 || numLayers <= 0 || numLayers > numZones) return {};
+        const size_t rawBytes = (size_t)b->numSamples * bytesPerSample(b->format);
+        const size_t need = ((size_t)numZones + (size_t)numLayers) * 8 + b->velocityMap.size() + rawBytes;
+        if ((size_t)in.getNumBytesRemaining() < need) return {};
+
+        for (int i = 0; i < numZones; ++i)
+        {
+            Zone z;
+            z.start = in.readInt(); z.length = in.readInt();
+            if (z.start < 0 || z.length <= 0 || z.length > b->numSamples - z.start) return {};
+            b->zones.push_back(z);
+        }
+        for (int i = 0; i < numLayers; ++i)
+        {
+            Layer l;
+            l.first = in.readInt(); l.count = in.readInt();
+            if (l.first < 0 || l.count <= 0 || l.count > numZones - l.first) return {};
+            b->layers.push_back(l);
+        }
+        in.read(b->velocityMap.data(), (int)b->velocityMap.size());
+        for (auto v : b->velocityMap)
+            if ((int)v >= numLayers) return {};
+
+        const auto* raw = static_cast<const char*>(data) + in.getPosition();
+        switch (b->format)
+        {
+            case Format::float32: b->f32.resize((size_t)b->numSamples); std::memcpy(b->f32.data(), raw, rawBytes); break;
+            case Format::int16:   b->i16.resize((size_t)b->numSamples); std::memcpy(b->i16.data(), raw, rawBytes); break;
+            case Format::half:    b->f16.resize((size_t)b->numSamples); std::memcpy(b->f16.data(), raw, rawBytes); break;
+        }
+        b->lockIfRealtime();
+        return b;
+    }
+
+    static Format parseFormat(const juce::String& s)
+    {
+        if (s.equalsIgnoreCase("int16")) return Format::int16;
+        if (s.equalsIgnoreCase("half"))  return Format::half;
+        return Format::float32;
+    }
+
+    int    getNumSamples() const { return numSamples; }
+    Format getFormat() const { return format; }
+    int    getNumVelocityLayers() const { return (int)layers.size(); }
+    int    getNumZones() const { return (int)zones.size(); }
+    size_t getSizeInBytes() const { return f32.size() * sizeof(float) + i16.size() * sizeof(int16_t) + f16.size() * sizeof(uint16_t); }
+
+    // ===== audio thread =====
+    // The take to play for a hit of velocity 0..1; `rr` is the caller's
+    // round-robin counter and is advanced.
+    const Zone& select(float velocity, juce::uint32& rr) const
+    {
+        const int v = juce::jlimit(0, 127, (int)(velocity * 127.0f));
+        const auto& l = layers[(size_t)velocityMap[(size_t)v]];
+        return zones[(size_t)(l.first + (int)(rr++ % (juce::uint32)l.count))];
+    }
+
+    // Direct pointer when stored as float, else nullptr (use read()).
+    const float* getFloatPointer(int pos) const { return f32.empty() ? nullptr : f32.data() + pos; }
+
+    // dst[0, n) = samples [pos, pos + n) as float.
+    void read(float* dst, int pos, int n) const
+    {
+        switch (format)
+        {
+            case Format::float32:
+                juce::FloatVectorOperations::copy(dst, f32.data() + pos, n);
+                break;
+
+            case Format::int16:
+            {
+                const int16_t* s = i16.data() + pos;
+                const float k = scale;
+                for (int i = 0; i < n; ++i) dst[i] = (float)s[i] * k;
+                break;
+            }
+
+            case Format::half:
+            {
+                const uint16_t* s = f16.data() + pos;
+                int i = 0;
+               #if TRIBEAT_F16C
+                for (; i + 8 <= n; i += 8)
+                    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i))));
+               #endif
+                for (; i < n; ++i) dst[i] = halfToFloat(s[i]);
+                break;
+            }
+        }
+    }
+
+    // Single sample, for layers that play their own one-shots.
+    float getSample(int pos) const
+    {
+        switch (format)
+        {
+            case Format::int16: return (float)i16[(size_t)pos] * scale;
+            case Format::half:  return halfToFloat(f16[(size_t)pos]);
+            case Format::float32:
+            default:            return f32[(size_t)pos];
+        }
+    }
+
+private:
+    SampleBuffer() = default;
+
+    struct Layer { int first = 0, count = 0; };
+
+    static size_t bytesPerSample(Format f) { return f == Format::float32 ? sizeof(float) : sizeof(int16_t); }
+
+    // realtimeMode: keep what the audio thread reads resident
+    void lockIfRealtime() const
+    {
+        if (!RealtimeGuard::isEnabled()) return;
+        RealtimeGuard::lockMemory(rawData(), (size_t)numSamples * bytesPerSample(format), false);
+        RealtimeGuard::lockMemory(zones.data(), zones.size() * sizeof(Zone), false);
+    }
+
+    const void* rawData() const
+    {
+        switch (format)
+        {
+            case Format::int16: return i16.data();
+            case Format::half:  return f16.data();
+            case Format::float32:
+            default:            return f32.data();
+        }
+    }
+
+    void encode(const std::vector<float>& packed)
+    {
+        numSamples = (int)packed.size();
+        const float* src = packed.data();
+
+        switch (format)
+        {
+            case Format::float32:
+                f32.assign(src, src + numSamples);
+                break;
+
+            case Format::int16:
+            {
+                const auto r = juce::FloatVectorOperations::findMinAndMax(src, numSamples);
+                const float peak = juce::jmax(std::abs(r.getStart()), std::abs(r.getEnd()), 1.0e-9f);
+                scale = peak / 32767.0f;
+                i16.resize((size_t)numSamples);
+                for (int i = 0; i < numSamples; ++i)
+                    i16[(size_t)i] = (int16_t)juce::roundToInt(src[i] / scale);
+                break;
+            }
+
+            case Format::half:
+                f16.resize((size_t)numSamples);
+                for (int i = 0; i < numSamples; ++i)
+                    f16[(size_t)i] = floatToHalf(src[i]);
+                break;
+        }
+    }
+
+    // Catmull-Rom over blocks: the four taps are gathered first, so the
+    // polynomial runs as a straight loop the compiler vectorizes.
+    static void resampleCubic(const float* in, int inLen, float* out, int outLen, double ratio)
+    {
+        constexpr int block = 64;
+        float xm1[block], x0[block], x1[block], x2[block], t[block];
+        auto at = [in, inLen](int i) { return (i >= 0 && i < inLen) ? in[i] : 0.0f; };
+
+        for (int b = 0; b < outLen; b += block)
+        {
+            const int m = juce::jmin(block, outLen - b);
+            for (int i = 0; i < m; ++i)
+            {
+                const double pos = (double)(b + i) * ratio;
+                const int k = (int)pos;
+                t[i] = (float)(pos - (double)k);
+                xm1[i] = at(k - 1); x0[i] = at(k); x1[i] = at(k + 1); x2[i] = at(k + 2);
+            }
+
+            float* o = out + b;
+            for (int i = 0; i < m; ++i)
+            {
+                const float c1 = 0.5f * (x1[i] - xm1[i]);
+                const float c2 = xm1[i] - 2.5f * x0[i] + 2.0f * x1[i] - 0.5f * x2[i];
+                const float c3 = 0.5f * (x2[i] - xm1[i]) + 1.5f * (x0[i] - x1[i]);
+                o[i] = ((c3 * t[i] + c2) * t[i] + c1) * t[i] + x0[i];
+            }
+        }
+    }
+
+    static std::vector<float> toMono(const juce::AudioBuffer<float>& in)
+    {
+        std::vector<float> mono((size_t)in.getNumSamples());
+        juce::FloatVectorOperations::copy(mono.data(), in.getReadPointer(0), (int)mono.size());
+        if (in.getNumChannels() > 1)
+        {
+            juce::FloatVectorOperations::add(mono.data(), in.getReadPointer(1), (int)mono.size());
+            juce::FloatVectorOperations::multiply(mono.data(), 0.5f, (int)mono.size());
+        }
+        return mono;
+    }
+
+    // [start, end) = first to last sample above the threshold, with a short
+    // fade where the tail was cut. All-quiet samples are left alone.
+    static void trim(std::vector<float>& x, float threshold, int& start, int& end)
+    {
+        const int n = (int)x.size();
+        int first = 0, last = n - 1;
+        while (first < n && std::abs(x[(size_t)first]) <= threshold) ++first;
+        if (first == n) return;
+        while (last > first && std::abs(x[(size_t)last]) <= threshold) --last;
+
+        start = first;
+        end = last + 1;
+
+        if (end < n)
+        {
+            const int fade = juce::jmin(64, end - start);
+            for (int i = 0; i < fade; ++i)
+                x[(size_t)(end - 1 - i)] *= (float)i / (float)fade;
+        }
+    }
+
+    // Exact for normals and denormals (inf/NaN are never stored).
+    static float halfToFloat(uint16_t h)
+    {
+        uint32_t bits = (uint32_t)(h & 0x7fff) << 13;
+        float f;
+        std::memcpy(&f, &bits, sizeof f);
+        f *= 0x1p112f;                  // re-bias the exponent
+        std::memcpy(&bits, &f, sizeof f);
+        bits |= (uint32_t)(h & 0x8000) << 16;
+        std::memcpy(&f, &bits, sizeof f);
+        return f;
+    }
+
+    // Round to nearest even, clamped to the largest finite half.
+    static uint16_t floatToHalf(float x)
+    {
+        uint32_t f;
+        std::memcpy(&f, &x, sizeof f);
+        const uint32_t sign = f & 0x80000000u;
+        f ^= sign;
+
+        uint16_t o;
+        if (f >= 0x477fe000u)                      // >= 65520 (or inf/NaN)
+        {
+            o = 0x7bff;
+        }
+        else if (f < 0x38800000u)                  // half denormal or zero
+        {
+            float v;
+            std::memcpy(&v, &f, sizeof v);
+            v += 0.5f;
+            std::memcpy(&f, &v, sizeof v);
+            o = (uint16_t)(f - 0x3f000000u);
+        }
+        else
+        {
+            const uint32_t mantOdd = (f >> 13) & 1u;
+            f += 0xc8000fffu;                      // re-bias (15 - 127) << 23, plus rounding
+            f += mantOdd;
+            o = (uint16_t)(f >> 13);
+        }
+        return (uint16_t)(o | (sign >> 16));
+    }
+
+    Format format = Format::float32;
+    int    numSamples = 0;
+    float  scale = 1.0f;
+
+    std::vector<Zone>  zones;                 // grouped by velocity layer
+    std::vector<Layer> layers;
+    std::array<juce::uint8, 128> velocityMap{};
+
+    std::vector<float>    f32;
+    std::vector<int16_t>  i16;
+    std::vector<uint16_t> f16;
+};
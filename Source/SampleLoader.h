@@ -0,0 +1,126 @@
+#pragma once
+#include <JuceHeader.h>
+#include <algorithm>
+#include <vector>
+#include "SampleBuffer.h"
+
+// =========== SampleLoader.h ===========
+// Decodes a one-shot from disk and resamples it to the device rate, so the
+// audio thread can play it back 1:1 without any conversion.
+struct SampleLoader
+{
+    static constexpr int maxChannels = 2;
+
+    // What the layers play: decoded, resampled, trimmed and stored as set
+    // in the options (see SampleBuffer). nullptr if nothing could be read.
+    // `spec` is one file, several files separated by '|', or a folder. Files
+    // tagged v1, v2, ... ("snare_v2_rr1.wav") are velocity layers, softest
+    // first; untagged files are layer 1. Takes within a layer alternate
+    // round-robin in file name order.
+    static SampleBuffer::Ptr load(juce::AudioFormatManager& formats, const juce::String& spec,
+                                  double targetRate, const SampleBuffer::Options& opts)
+    {
+        const auto files = expandSpec(spec);
+
+        std::vector<juce::AudioBuffer<float>> decoded;
+        std::vector<int> tags;
+        decoded.reserve((size_t)files.size());
+        size_t sourceBytes = 0;
+        for (const auto& f : files)
+        {
+            auto buf = decode(formats, f, targetRate);
+            if (buf.getNumSamples() == 0) continue;
+            sourceBytes += (size_t)buf.getNumChannels() * (size_t)buf.getNumSamples() * sizeof(float);
+            decoded.push_back(std::move(buf));
+            tags.push_back(velocityTag(f));
+        }
+
+        std::vector<SampleBuffer::Variation> vars;
+        for (size_t i = 0; i < decoded.size(); ++i)
+            vars.push_back({ &decoded[i], tags[i] });
+
+        auto s = SampleBuffer::create(std::move(vars), opts);
+        if (s != nullptr)
+            DBG("[Samples] " << files[0].getFileName() << (files.size() > 1 ? " ..." : "") << ": " << s->getNumZones() << " take(s), "
+                << s->getNumVelocityLayers() << " layer(s), " << (int)(sourceBytes / 1024)
+                << " KB -> " << (int)(s->getSizeInBytes() / 1024) << " KB");
+        return s;
+    }
+
+    static juce::Array<juce::File> expandSpec(const juce::String& spec)
+    {
+        juce::Array<juce::File> files;
+        for (const auto& part : juce::StringArray::fromTokens(spec, "|", ""))
+        {
+            if (part.trim().isEmpty()) continue;
+            const juce::File f(part.trim());
+            if (f.isDirectory())
+                files.addArray(f.findChildFiles(juce::File::findFiles, false, "*.wav;*.aif;*.aiff;*.flac;*.ogg;*.mp3"));
+            else
+                files.add(f);
+        }
+
+        std::sort(files.begin(), files.end(), [](const juce::File& a, const juce::File& b)
+            { return a.getFileName().compareNatural(b.getFileName()) < 0; });
+        return files;
+    }
+
+    // "v3" / "vel3" as a separate word in the file name; 1 if there is none
+    static int velocityTag(const juce::File& f)
+    {
+        for (const auto& t : juce::StringArray::fromTokens(f.getFileNameWithoutExtension(), "_- .", ""))
+        {
+            const auto digits = t.startsWithIgnoreCase("vel") ? t.substring(3)
+                              : t.startsWithIgnoreCase("v")   ? t.substring(1) : juce::String();
+            if (digits.isNotEmpty() && digits.containsOnly("0123456789"))
+                return digits.getIntValue();
+        }
+        return 1;
+    }
+
+    // settings: sampleStorage = float / int16 / half, sampleTrimDb (default -60)
+    static SampleBuffer::Options optionsFrom(const juce::PropertySet& settings)
+    {
+        SampleBuffer::Options o;
+        o.format = SampleBuffer::parseFormat(settings.getValue("sampleStorage", "float"));
+        o.trimDb = (float)settings.getDoubleValue("sampleTrimDb", -60.0);
+        return o;
+    }
+
+    static juce::AudioBuffer<float> decode(juce::AudioFormatManager& formats,
+                                           const juce::File& file,
+                                           double targetRate)
+    {
+        if (!file.existsAsFile()) return {};
+
+        std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+        if (!reader || reader->lengthInSamples <= 0) return {};
+
+        const int numSamples = (int)reader->lengthInSamples;
+        const int numCh = juce::jlimit(1, maxChannels, (int)reader->numChannels);
+
+        juce::AudioBuffer<float> temp(numCh, numSamples);
+        reader->read(&temp, 0, numSamples, 0, true, true);
+
+        return resample(temp, reader->sampleRate, targetRate);
+    }
+
+    static juce::AudioBuffer<float> resample(const juce::AudioBuffer<float>& in,
+                                             double sourceRate, double targetRate)
+    {
+        if (sourceRate <= 0.0 || targetRate <= 0.0 || std::abs(sourceRate - targetRate) < 1.0e-6)
+            return in;
+
+        const double ratio = sourceRate / targetRate;
+        const int inLen = in.getNumSamples();
+        const int outLen = juce::jmax(1, (int)std::ceil((double)inLen / ratio));
+
+        juce::AudioBuffer<float> out(in.getNumChannels(), outLen);
+        for (int ch = 0; ch < in.getNumChannels(); ++ch)
+        {
+            juce::LagrangeInterpolator interp;
+            interp.process(ratio, in.getReadPointer(ch), out.getWritePointer(ch), outLen, inLen, 0);
+        }
+        return out;
+    }
+};
@@ -0,0 +1,175 @@
+#pragma once
+#include <JuceHeader.h>
+#include <map>
+#include "PresetBank.h"
+#include "SampleBuffer.h"
+
+// =========== SessionFile.h ===========
+// Saves and reopens the whole working state: the live pattern (layers,
+// accents, notes, routing, mode, BPM), the preset slots, the active layer
+// and the sample files each role uses.
+//
+// A bundled session also carries every loaded sample as stored in memory
+// (already resampled, trimmed and in its storage format), so reopening is a
+// read of one file with no decoding. Layout, little-endian:
+//
+//   "TBSN" | version | header bytes | 0        16 bytes
+//   header                                     ValueTree::writeToStream
+//   sample blobs                               each 64-byte aligned
+//
+// Blob offsets in the header count from the first 64-byte boundary after it.
+// The file is memory-mapped for reading and the blobs are copied out, so the
+// audio thread never touches (or page-faults on) the mapping.
+//
+// A session can instead name a sibling file that holds its samples (a
+// session file with only the sample section), so a session that is saved
+// often, like the autosave, needn't rewrite samples that haven't changed.
+struct Session
+{
+    PatternPreset   pattern;
+    juce::ValueTree presetBank;
+    int             activeLayer = 0;
+
+    // bundled samples by path spec (as in LayerPreset), at `sampleRate`
+    std::map<juce::String, SampleBuffer::Ptr> samples;
+    double sampleRate = 0.0;
+
+    // file name of a sibling that holds the samples instead; when saving,
+    // `samples` is then not written
+    juce::String sampleBundle;
+};
+
+struct SessionFile
+{
+    static constexpr const char* extension = ".tribeat";
+    static constexpr int version = 1;
+
+    // Bundles session.samples when it has any. Written to a temporary file
+    // first, so a failed save leaves the old one intact.
+    static bool save(const juce::File& file, const Session& session)
+    {
+        juce::ValueTree header("Session");
+        header.setProperty("activeLayer", session.activeLayer, nullptr);
+        header.appendChild(session.pattern.toValueTree(), nullptr);
+        if (session.presetBank.isValid())
+            header.appendChild(session.presetBank.createCopy(), nullptr);
+
+        juce::MemoryOutputStream blobs;
+        juce::ValueTree index("Samples");
+        index.setProperty("sampleRate", session.sampleRate, nullptr);
+        if (session.sampleBundle.isNotEmpty()) index.setProperty("bundle", session.sampleBundle, nullptr);
+        for (const auto& [spec, buf] : session.samples)
+        {
+            if (buf == nullptr || session.sampleBundle.isNotEmpty()) continue;
+            pad(blobs);
+            const auto start = blobs.getPosition();
+            buf->writeTo(blobs);
+
+            juce::ValueTree s("Sample");
+            s.setProperty("spec", spec, nullptr);
+            s.setProperty("offset", (juce::int64)start, nullptr);
+            s.setProperty("bytes", (juce::int64)(blobs.getPosition() - start), nullptr);
+            index.appendChild(s, nullptr);
+        }
+        header.appendChild(index, nullptr);
+
+        juce::MemoryOutputStream head;
+        header.writeToStream(head);
+
+        juce::TemporaryFile temp(file);
+        {
+            juce::FileOutputStream out(temp.getFile());
+            if (!out.openedOk()) return false;
+
+            out.write("TBSN", 4);
+            out.writeInt(version);
+            out.writeInt((int)head.getDataSize());
+            out.writeInt(0);
+            out.write(head.getData(), head.getDataSize());
+            pad(out);
+            out.write(blobs.getData(), blobs.getDataSize());
+            out.flush();
+            if (out.getStatus().failed()) return false;
+        }
+        return temp.overwriteTargetFileWithTemporary();
+    }
+
+    // Bundled samples saved at another rate are resampled to `targetRate`.
+    static bool load(const juce::File& file, Session& session, double targetRate)
+    {
+        return read(file, session, targetRate, true);
+    }
+
+private:
+    static constexpr size_t alignment = 64;
+
+    static bool read(const juce::File& file, Session& session, double targetRate, bool followBundle)
+    {
+        juce::MemoryMappedFile mapped(file, juce::MemoryMappedFile::readOnly);
+        juce::MemoryBlock fallback;
+        const void* data = mapped.getData();
+        size_t size = mapped.getSize();
+        if (data == nullptr)
+        {
+            if (!file.loadFileAsData(fallback)) return false;
+            data = fallback.getData(); size = fallback.getSize();
+        }
+
+        const auto* bytes = static_cast<const char*>(data);
+        if (size < 16 || std::memcmp(bytes, "TBSN", 4) != 0) return false;
+
+        juce::MemoryInputStream prefix(bytes + 4, 12, false);
+        if (prefix.readInt() > version) return false;
+        const auto headBytes = (size_t)juce::jmax(0, prefix.readInt());
+        if (16 + headBytes > size) return false;
+
+        const auto header = juce::ValueTree::readFromData(bytes + 16, headBytes);
+        if (!header.hasType("Session")) return false;
+
+        session = {};
+        session.activeLayer = (int)header.getProperty("activeLayer", 0);
+        session.pattern = PatternPreset::fromValueTree(header.getChildWithName("Pattern"));
+        session.presetBank = header.getChildWithName("PresetBank").createCopy();
+
+        const auto index = header.getChildWithName("Samples");
+        session.sampleRate = (double)index.getProperty("sampleRate", 0.0);
+        const size_t blobStart = aligned(16 + headBytes);
+        const double ratio = (session.sampleRate > 0.0 && targetRate > 0.0) ? session.sampleRate / targetRate : 1.0;
+
+        for (const auto& s : index)
+        {
+            const auto offset = (size_t)(juce::int64)s.getProperty("offset", -1);
+            const auto length = (size_t)(juce::int64)s.getProperty("bytes", 0);
+            if (blobStart > size || offset > size - blobStart || length > size - blobStart - offset) continue;
+
+            auto buf = SampleBuffer::readFrom(bytes + blobStart + offset, length);
+            if (buf == nullptr) continue;
+            if (std::abs(ratio - 1.0) > 1.0e-9)
+                buf = SampleBuffer::createResampled(*buf, ratio);
+            session.samples[s.getProperty("spec").toString()] = std::move(buf);
+        }
+        if (session.sampleRate > 0.0) session.sampleRate = targetRate;
+
+        // a missing or broken bundle only costs the decoding it would have saved
+        session.sampleBundle = index.getProperty("bundle").toString();
+        if (session.sampleBundle.isNotEmpty() && followBundle
+            && juce::File::createLegalFileName(session.sampleBundle) == session.sampleBundle)   // a sibling, nowhere else
+        {
+            Session bundled;
+            if (read(file.getSiblingFile(session.sampleBundle), bundled, targetRate, false))
+            {
+                session.samples = std::move(bundled.samples);
+                session.sampleRate = bundled.sampleRate;
+            }
+        }
+        return true;
+    }
+
+    static size_t aligned(size_t n) { return (n + alignment - 1) & ~(alignment - 1); }
+
+    static void pad(juce::OutputStream& out)
+    {
+        const auto pos = (size_t)out.getPosition();
+        for (size_t i = pos; i < aligned(pos); ++i) out.writeByte(0);
+    }
+};
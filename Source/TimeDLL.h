@@ -0,0 +1,39 @@
+#pragma once
+#include <JuceHeader.h>
+
+// =========== TimeDLL.h ===========
+// Second-order delay-locked loop (F. Adriaensen, "Using a DLL to filter time").
+// Fed with noisy wall-clock timestamps of periodic events (audio callbacks,
+// MIDI clock ticks), it returns a smoothed timestamp and period.
+struct TimeDLL
+{
+    double b = 0.0, c = 0.0;     // loop coefficients
+    double t0 = 0.0, t1 = 0.0;   // filtered time of current / next event (ms)
+    double e2 = 0.0;             // filtered period (ms)
+    bool   locked = false;
+
+    // bandwidthHz relative to the nominal event rate
+    void reset(double nowMs, double nominalPeriodMs, double bandwidthHz = 0.5)
+    {
+        const double omega = juce::MathConstants<double>::twoPi * bandwidthHz * nominalPeriodMs * 0.001;
+        b = std::sqrt(2.0) * omega;
+        c = omega * omega;
+        e2 = nominalPeriodMs;
+        t0 = nowMs;
+        t1 = nowMs + nominalPeriodMs;
+        locked = true;
+    }
+
+    // Returns the filtered time of the event that just happened.
+    double update(double nowMs)
+    {
+        const double e = nowMs - t1;
+        t0 = t1;
+        t1 += b * e + e2;
+        e2 += c * e;
+        return t0;
+    }
+
+    double getPeriodMs() const { return e2; }
+    double predictNext() const { return t1; }
+};
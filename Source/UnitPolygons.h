@@ -0,0 +1,55 @@
+#pragma once
+#include <JuceHeader.h>
+#include <map>
+#include <vector>
+
+// =========== UnitPolygons.h ===========
+// Vertex tables of regular polygons on the unit circle, one per side count,
+// computed once (first vertex at 12 o'clock, clockwise on screen). Placing a
+// shape is then a scale and an offset of its table, with no trig, done in one
+// multiply-add pass over the interleaved x/y values that the compiler
+// vectorizes.
+// Message thread only.
+class UnitPolygons
+{
+public:
+    const std::vector<juce::Point<float>>& get(int sides)
+    {
+        sides = juce::jmax(1, sides);
+        auto& t = tables[sides];
+        if (t.empty())
+        {
+            t.reserve((size_t)sides);
+            for (int k = 0; k < sides; ++k)
+            {
+                const double a = -juce::MathConstants<double>::halfPi + juce::MathConstants<double>::twoPi * k / sides;
+                t.push_back({ (float)std::cos(a), (float)std::sin(a) });
+            }
+        }
+        return t;
+    }
+
+    // The polygon with this many sides around centre, into out (resized).
+    void place(int sides, juce::Point<float> centre, float radius, std::vector<juce::Point<float>>& out)
+    {
+        static_assert(sizeof(juce::Point<float>) == 2 * sizeof(float), "Point<float> must be two packed floats");
+
+        const auto& unit = get(sides);
+        const int n = (int)unit.size();
+        out.resize((size_t)n);
+
+        // x and y take different offsets, so this is one pass over the pairs
+        // rather than FloatVectorOperations, which only adds a scalar to all
+        const auto* src = reinterpret_cast<const float*>(unit.data());
+        auto* dst = reinterpret_cast<float*>(out.data());
+        const float cx = centre.x, cy = centre.y;
+        for (int i = 0; i < 2 * n; i += 2)
+        {
+            dst[i]     = src[i] * radius + cx;
+            dst[i + 1] = src[i + 1] * radius + cy;
+        }
+    }
+
+private:
+    std::map<int, std::vector<juce::Point<float>>> tables;   // by side count; references stay valid
+};
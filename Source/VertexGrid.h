@@ -0,0 +1,108 @@
+#pragma once
+#include <JuceHeader.h>
+#include <algorithm>
+#include <vector>
+
+// =========== VertexGrid.h ===========
+// Hit-testing for the vertices of every shape on screen. The points are
+// bucketed into a uniform grid of cells about the size of the hit radius,
+// stored cell by cell in one array (a counting sort), so a lookup only
+// looks at the few cells around the pointer, however many shapes and
+// vertices there are. Rebuilt whenever the geometry changes (begin, add
+// each layer, end); lookups don't allocate.
+class VertexGrid
+{
+public:
+    struct Hit
+    {
+        int   layer = -1, vertex = -1;
+        float distance = 0.0f;
+
+        bool isValid() const { return layer >= 0; }
+        bool operator==(const Hit& o) const { return layer == o.layer && vertex == o.vertex; }
+        bool operator!=(const Hit& o) const { return !(*this == o); }
+    };
+
+    void begin(juce::Rectangle<float> area, float cell)
+    {
+        bounds = area;
+        cellSize = juce::jmax(1.0f, cell);
+        cols = juce::jmax(1, (int)std::ceil(area.getWidth() / cellSize));
+        rows = juce::jmax(1, (int)std::ceil(area.getHeight() / cellSize));
+        points.clear();
+    }
+
+    void add(int layer, const std::vector<juce::Point<float>>& verts)
+    {
+        for (int i = 0; i < (int)verts.size(); ++i)
+            points.push_back({ verts[(size_t)i], layer, i });
+    }
+
+    void end()
+    {
+        cellStart.assign((size_t)(cols * rows + 1), 0);
+        for (const auto& p : points) ++cellStart[(size_t)cellOf(p.pos) + 1];
+        for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+
+        entries.resize(points.size());
+        fill.assign(cellStart.begin(), cellStart.end() - 1);
+        for (const auto& p : points) entries[(size_t)fill[(size_t)cellOf(p.pos)]++] = p;
+    }
+
+    // The vertex nearest to pos within radius, of one layer or (layer < 0)
+    // any; on a tie the preferred layer wins.
+    Hit find(juce::Point<float> pos, float radius, int layer = -1, int preferLayer = -1) const
+    {
+        Hit best;
+        if (entries.empty()) return best;
+
+        float bestD2 = radius * radius;
+        const auto [c0, r0] = cellXY(pos - juce::Point<float>(radius, radius));
+        const auto [c1, r1] = cellXY(pos + juce::Point<float>(radius, radius));
+
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+            {
+                const int cell = r * cols + c;
+                for (int i = cellStart[(size_t)cell]; i < cellStart[(size_t)cell + 1]; ++i)
+                {
+                    const auto& p = entries[(size_t)i];
+                    if (layer >= 0 && p.layer != layer) continue;
+
+                    const float d2 = p.pos.getDistanceSquaredFrom(pos);
+                    if (d2 < bestD2 || (d2 == bestD2 && p.layer == preferLayer && best.layer != preferLayer))
+                    {
+                        bestD2 = d2;
+                        best = { p.layer, p.vertex, 0.0f };
+                    }
+                }
+            }
+
+        if (best.isValid()) best.distance = std::sqrt(bestD2);
+        return best;
+    }
+
+    int getNumVertices() const { return (int)entries.size(); }
+
+private:
+    struct Entry
+    {
+        juce::Point<float> pos;
+        int layer = -1, vertex = -1;
+    };
+
+    // points off the grid (a zoomed-in shape) go to the nearest edge cell
+    std::pair<int, int> cellXY(juce::Point<float> p) const
+    {
+        return { juce::jlimit(0, cols - 1, (int)std::floor((p.x - bounds.getX()) / cellSize)),
+                 juce::jlimit(0, rows - 1, (int)std::floor((p.y - bounds.getY()) / cellSize)) };
+    }
+    int cellOf(juce::Point<float> p) const { const auto [c, r] = cellXY(p); return r * cols + c; }
+
+    juce::Rectangle<float> bounds;
+    float cellSize = 16.0f;
+    int   cols = 1, rows = 1;
+
+    std::vector<Entry> points, entries;
+    std::vector<int>   cellStart, fill;
+};
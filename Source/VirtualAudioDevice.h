@@ -0,0 +1,303 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+
+// =========== VirtualAudioDevice.h ===========
+// An audio device without hardware, for headless machines and timing tests
+// (audioBackend = "Virtual"). A thread of its own pulls blocks from the
+// callback at the chosen rate and buffer size, either paced by the clock like
+// a sound card ("Virtual (real-time)") or as fast as the callback returns
+// ("Virtual (free-running)"). The output goes to a WAV file, or else into
+// memory (the first Options::memorySeconds, preallocated on open; a few
+// seconds by default, 0 for none).
+// Every callback is timed; in real-time mode one that ends after its
+// deadline (the start of the next block) counts as an xrun, exactly where a
+// sound card would have glitched. Inputs deliver silence.
+class VirtualAudioDevice : public juce::AudioIODevice,
+                           private juce::Thread
+{
+public:
+    enum class Pacing { realtime, freeRunning };
+
+    struct Options
+    {
+        juce::File outputFile;          // WAV; none = memory
+        double     memorySeconds = 4.0;
+        int        numOutputs = 8, numInputs = 2;
+    };
+
+    struct TimingStats
+    {
+        juce::int64 callbacks = 0;
+        double meanMs = 0.0, maxMs = 0.0;     // time spent in the callback
+        double maxLateMs = 0.0;               // start after the block's due time
+        int    xruns = 0;
+    };
+
+    VirtualAudioDevice(const juce::String& name, Pacing p, const Options& o)
+        : juce::AudioIODevice(name, "Virtual"), juce::Thread("Virtual audio device"), pacing(p), options(o) {}
+
+    ~VirtualAudioDevice() override { close(); }
+
+    // ===== AudioIODevice =====
+    juce::StringArray getOutputChannelNames() override { return channelNames("Output", options.numOutputs); }
+    juce::StringArray getInputChannelNames() override  { return channelNames("Input", options.numInputs); }
+
+    juce::Array<double> getAvailableSampleRates() override { return { 44100.0, 48000.0, 88200.0, 96000.0 }; }
+    juce::Array<int>    getAvailableBufferSizes() override { return { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 }; }
+    int getDefaultBufferSize() override { return 256; }
+
+    juce::String open(const juce::BigInteger& inputChannels, const juce::BigInteger& outputChannels,
+                      double sampleRate, int bufferSizeSamples) override
+    {
+        close();
+        rate = sampleRate > 0.0 ? sampleRate : 48000.0;
+        blockSize = juce::jlimit(16, 8192, bufferSizeSamples > 0 ? bufferSizeSamples : getDefaultBufferSize());
+
+        activeInputs = inputChannels;
+        activeInputs.setRange(options.numInputs, juce::jmax(0, activeInputs.getHighestBit() + 1 - options.numInputs), false);
+        activeOutputs = outputChannels;
+        activeOutputs.setRange(options.numOutputs, juce::jmax(0, activeOutputs.getHighestBit() + 1 - options.numOutputs), false);
+
+        const int numIn = activeInputs.countNumberOfSetBits(), numOut = activeOutputs.countNumberOfSetBits();
+        inputs.setSize(juce::jmax(1, numIn), blockSize);
+        inputs.clear();
+        outputs.setSize(juce::jmax(1, numOut), blockSize);
+
+        if (options.outputFile != juce::File())
+        {
+            options.outputFile.deleteFile();
+            std::unique_ptr<juce::OutputStream> stream = options.outputFile.createOutputStream();
+            if (stream != nullptr)
+                writer.reset(juce::WavAudioFormat().createWriterFor(stream.get(), rate, (unsigned int)juce::jmax(1, numOut), 24, {}, 0));
+            if (writer == nullptr) { lastError = "Can't write " + options.outputFile.getFullPathName(); return lastError; }
+            stream.release();   // owned by the writer
+        }
+        else
+        {
+            capture.setSize(juce::jmax(1, numOut), (int)(juce::jmax(0.0, options.memorySeconds) * rate));
+            capture.clear();
+        }
+        captured.store(0);
+
+        stats = {};
+        xruns.store(0);
+        opened = true;
+        lastError.clear();
+        return {};
+    }
+
+    void close() override
+    {
+        stop();
+        if (!opened) return;
+        opened = false;
+        writer.reset();     // flushes the file
+        juce::Logger::writeToLog("[Virtual audio] " + getName() + ": " + describe(getTimingStats()));
+    }
+
+    bool isOpen() override { return opened; }
+
+    void start(juce::AudioIODeviceCallback* cb) override
+    {
+        if (!opened || cb == nullptr) return;
+        stop();
+        cb->audioDeviceAboutToStart(this);
+        {
+            const juce::ScopedLock sl(callbackLock);
+            callback = cb;
+        }
+        startThread(juce::Thread::Priority::highest);
+    }
+
+    void stop() override
+    {
+        stopThread(2000);
+        juce::AudioIODeviceCallback* old = nullptr;
+        {
+            const juce::ScopedLock sl(callbackLock);
+            std::swap(old, callback);
+        }
+        if (old != nullptr) old->audioDeviceStopped();
+    }
+
+    bool isPlaying() override { return isThreadRunning(); }
+    juce::String getLastError() override { return lastError; }
+
+    int    getCurrentBufferSizeSamples() override { return blockSize; }
+    double getCurrentSampleRate() override { return rate; }
+    int    getCurrentBitDepth() override { return 32; }
+
+    juce::BigInteger getActiveOutputChannels() const override { return activeOutputs; }
+    juce::BigInteger getActiveInputChannels() const override  { return activeInputs; }
+
+    int getOutputLatencyInSamples() override { return 0; }
+    int getInputLatencyInSamples() override { return 0; }
+    int getXRunCount() const noexcept override { return xruns.load(); }
+
+    // ===== results (any thread) =====
+    TimingStats getTimingStats() const
+    {
+        const juce::ScopedLock sl(statsLock);
+        auto s = stats;
+        s.xruns = xruns.load();
+        return s;
+    }
+
+    static juce::String describe(const TimingStats& s)
+    {
+        return juce::String(s.callbacks) + " callbacks, " + juce::String(s.meanMs, 3) + " ms mean / "
+             + juce::String(s.maxMs, 3) + " ms max in the callback, up to " + juce::String(s.maxLateMs, 3)
+             + " ms late, " + juce::String(s.xruns) + " xrun(s)";
+    }
+
+    // The memory sink: the first getCapturedSamples() samples of each output.
+    const juce::AudioBuffer<float>& getCapture() const { return capture; }
+    int getCapturedSamples() const { return captured.load(std::memory_order_acquire); }
+
+private:
+    static juce::StringArray channelNames(const juce::String& prefix, int n)
+    {
+        juce::StringArray names;
+        for (int i = 0; i < n; ++i) names.add(prefix + " " + juce::String(i + 1));
+        return names;
+    }
+
+    void run() override
+    {
+        const double periodMs = 1000.0 * blockSize / rate;
+        double due = juce::Time::getMillisecondCounterHiRes();
+        const juce::AudioIODeviceCallbackContext context;
+
+        while (!threadShouldExit())
+        {
+            if (pacing == Pacing::realtime)
+            {
+                // sleep most of the way, then yield up to the due time
+                for (double left = due - juce::Time::getMillisecondCounterHiRes(); left > 0.0 && !threadShouldExit();
+                     left = due - juce::Time::getMillisecondCounterHiRes())
+                {
+                    if (left > 2.0) juce::Thread::sleep((int)(left - 1.0));
+                    else            juce::Thread::yield();
+                }
+            }
+
+            const double t0 = juce::Time::getMillisecondCounterHiRes();
+            {
+                const juce::ScopedLock sl(callbackLock);
+                if (callback != nullptr)
+                    callback->audioDeviceIOCallbackWithContext(inputs.getArrayOfReadPointers(), activeInputs.countNumberOfSetBits(),
+                                                               outputs.getArrayOfWritePointers(), activeOutputs.countNumberOfSetBits(),
+                                                               blockSize, context);
+                else
+                    outputs.clear();
+            }
+            const double t1 = juce::Time::getMillisecondCounterHiRes();
+
+            const bool late = pacing == Pacing::realtime && t1 > due + periodMs;
+            record(t1 - t0, pacing == Pacing::realtime ? juce::jmax(0.0, t0 - due) : 0.0, late);
+            deliver();
+
+            if (pacing == Pacing::realtime)
+            {
+                due += periodMs;
+                // a sound card doesn't wait either: resync after a dropout
+                if (late) due = juce::jmax(due, juce::Time::getMillisecondCounterHiRes());
+            }
+        }
+    }
+
+    void record(double callbackMs, double lateMs, bool late)
+    {
+        if (late) xruns.fetch_add(1);
+
+        const juce::ScopedLock sl(statsLock);
+        ++stats.callbacks;
+        stats.meanMs += (callbackMs - stats.meanMs) / (double)stats.callbacks;
+        stats.maxMs = juce::jmax(stats.maxMs, callbackMs);
+        stats.maxLateMs = juce::jmax(stats.maxLateMs, lateMs);
+    }
+
+    void deliver()
+    {
+        const int numOut = activeOutputs.countNumberOfSetBits();
+        if (writer != nullptr)
+        {
+            writer->writeFromFloatArrays(outputs.getArrayOfReadPointers(), juce::jmax(1, numOut), blockSize);
+            return;
+        }
+
+        const int at = captured.load(std::memory_order_relaxed);
+        const int n = juce::jmin(blockSize, capture.getNumSamples() - at);
+        if (n <= 0) return;
+        for (int ch = 0; ch < juce::jmin(numOut, capture.getNumChannels()); ++ch)
+            capture.copyFrom(ch, at, outputs, ch, 0, n);
+        captured.store(at + n, std::memory_order_release);
+    }
+
+    const Pacing pacing;
+    Options      options;
+
+    double rate = 48000.0;
+    int    blockSize = 256;
+    bool   opened = false;
+    juce::String lastError;
+    juce::BigInteger activeInputs, activeOutputs;
+
+    juce::AudioBuffer<float> inputs, outputs;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    juce::AudioBuffer<float> capture;
+    std::atomic<int>         captured{ 0 };
+
+    juce::CriticalSection        callbackLock;
+    juce::AudioIODeviceCallback* callback = nullptr;
+
+    juce::CriticalSection statsLock;
+    TimingStats           stats;
+    std::atomic<int>      xruns{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VirtualAudioDevice)
+};
+
+// =========== VirtualAudioDeviceType ===========
+// Offers the two virtual devices to an AudioDeviceManager.
+class VirtualAudioDeviceType : public juce::AudioIODeviceType
+{
+public:
+    static constexpr const char* typeName = "Virtual";
+    static constexpr const char* realtimeName = "Virtual (real-time)";
+    static constexpr const char* freeRunningName = "Virtual (free-running)";
+
+    explicit VirtualAudioDeviceType(const VirtualAudioDevice::Options& o = {})
+        : juce::AudioIODeviceType(typeName), options(o) {}
+
+    // Device manager state that opens one of them at the given rate and size.
+    static std::unique_ptr<juce::XmlElement> createSetup(bool freeRunning, double sampleRate, int bufferSize)
+    {
+        auto xml = std::make_unique<juce::XmlElement>("DEVICESETUP");
+        xml->setAttribute("deviceType", typeName);
+        xml->setAttribute("audioOutputDeviceName", freeRunning ? freeRunningName : realtimeName);
+        xml->setAttribute("audioDeviceRate", sampleRate);
+        xml->setAttribute("audioDeviceBufferSize", bufferSize);
+        return xml;
+    }
+
+    void scanForDevices() override {}
+
+    juce::StringArray getDeviceNames(bool /*wantInputNames*/) const override { return { realtimeName, freeRunningName }; }
+    int  getDefaultDeviceIndex(bool) const override { return 0; }
+    int  getIndexOfDevice(juce::AudioIODevice* d, bool) const override { return d != nullptr ? getDeviceNames(false).indexOf(d->getName()) : -1; }
+    bool hasSeparateInputsAndOutputs() const override { return false; }
+
+    juce::AudioIODevice* createDevice(const juce::String& outputName, const juce::String& inputName) override
+    {
+        const auto name = outputName.isNotEmpty() ? outputName : inputName;
+        if (name == realtimeName)    return new VirtualAudioDevice(name, VirtualAudioDevice::Pacing::realtime, options);
+        if (name == freeRunningName) return new VirtualAudioDevice(name, VirtualAudioDevice::Pacing::freeRunning, options);
+        return nullptr;
+    }
+
+private:
+    VirtualAudioDevice::Options options;
+};
@@ -0,0 +1,227 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include "SampleBuffer.h"
+
+// --- routing helpers (shared by LayerEngine and VoicePool) ---
+// Routes the current device doesn't have fall back to the first outputs.
+inline void resolveRoute(int& first, int& width, int numOut)
+{
+    width = juce::jlimit(1, juce::jmax(1, numOut), width);
+    if (first < 0 || first + width > numOut) first = 0;
+    width = juce::jmin(width, juce::jmax(0, numOut - first));
+}
+
+// Per-output gains for a level and constant-power pan (-1..1); a mono
+// route only uses out[0].
+inline void routeGains(float level, float pan, int width, float out[2])
+{
+    if (width < 2) { out[0] = out[1] = level; return; }
+    const float a = (juce::jlimit(-1.0f, 1.0f, pan) + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+    out[0] = level * std::cos(a);
+    out[1] = level * std::sin(a);
+}
+
+// =========== VoicePool.h ===========
+// One-shot sample voices shared by all layers. When several layers start
+// the same take of a sample at the same sample on the same outputs (kick on
+// the "one" of a 3:4:6 stack), the hits are merged into one voice whose
+// per-output gains are the sum, so the mix is identical but the sample is
+// read once. Each layer keeps a handle to the voice it contributed to and
+// takes its share back out when it retriggers (one-shots stay monophonic
+// per layer, as before). Audio thread only, except where noted.
+class VoicePool
+{
+public:
+    static constexpr int maxVoices = 128;
+
+    // What a layer's one-shot contributed to a voice.
+    struct Handle
+    {
+        int          voice = -1;
+        juce::uint32 generation = 0;
+        float        gain[2] = {};
+    };
+
+    // Triggers of one layer recorded off the audio thread (LayerEngine's
+    // parallel rendering) and replayed into the pool afterwards, so the pool
+    // sees the same calls in the same order as when rendering serially.
+    struct Deferred
+    {
+        static constexpr int capacity = 32;   // hits of one layer in one chunk
+
+        void add(Handle& h, int offset, const SampleBuffer* data, const SampleBuffer::Zone& zone,
+                 int first, int width, const float gain[2])
+        {
+            jassert(count < capacity);
+            if (count < capacity)
+                entries[(size_t)count++] = { &h, offset, data, &zone, first, width, { gain[0], gain[1] } };
+        }
+
+        void replay(VoicePool& pool)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                const auto& e = entries[(size_t)i];
+                pool.trigger(*e.handle, e.offset, e.data, *e.zone, e.first, e.width, e.gain);
+            }
+            count = 0;
+        }
+
+    private:
+        struct Entry
+        {
+            Handle* handle;
+            int offset;
+            const SampleBuffer* data;
+            const SampleBuffer::Zone* zone;
+            int first, width;
+            float gain[2];
+        };
+        std::array<Entry, capacity> entries;
+        int count = 0;
+    };
+
+    void beginChunk() { ++chunk; }
+
+    void trigger(Handle& h, int offset, const SampleBuffer* data, const SampleBuffer::Zone& zone,
+                 int first, int width, const float gain[2])
+    {
+        release(h);
+        if (data == nullptr || zone.length <= 0) return;
+
+        int idx = -1;
+        for (int i = 0; i < maxVoices && idx < 0; ++i)
+        {
+            const auto& v = voices[(size_t)i];
+            if (v.active && v.chunk == chunk && v.data == data && v.zoneStart == zone.start
+                && v.startOffset == offset && v.first == first && v.width == width)
+                idx = i;
+        }
+
+        if (idx >= 0)
+        {
+            mergedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            idx = allocate();
+            auto& v = voices[(size_t)idx];
+            v.data = data; v.startOffset = offset;
+            v.zoneStart = v.pos = zone.start;
+            v.end = zone.start + zone.length;
+            v.first = first; v.width = width;
+            v.gain[0] = v.gain[1] = 0.0f;
+            v.chunk = chunk; v.active = true;
+            ++v.generation;
+            startedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        auto& v = voices[(size_t)idx];
+        v.gain[0] += gain[0];
+        v.gain[1] += gain[1];
+
+        h.voice = idx;
+        h.generation = v.generation;
+        h.gain[0] = gain[0];
+        h.gain[1] = gain[1];
+    }
+
+    // Takes a layer's share out of its voice (no-op if the voice was reused).
+    void release(Handle& h)
+    {
+        if (h.voice >= 0)
+        {
+            auto& v = voices[(size_t)h.voice];
+            if (v.active && v.generation == h.generation)
+            {
+                v.gain[0] -= h.gain[0];
+                v.gain[1] -= h.gain[1];
+                if (std::abs(v.gain[0]) < 1.0e-6f && std::abs(v.gain[1]) < 1.0e-6f) v.active = false;
+            }
+        }
+        h.voice = -1;
+    }
+
+    // Adds every active voice into its outputs for samples [dst, dst + n).
+    void render(juce::AudioBuffer<float>& out, int dst, int n)
+    {
+        const int numOut = out.getNumChannels();
+        int busy = 0;
+
+        for (auto& v : voices)
+        {
+            if (!v.active) continue;
+
+            const int from = (v.chunk == chunk ? v.startOffset : 0);
+            const int len = juce::jmin(n - from, v.end - v.pos);
+            if (len > 0)
+            {
+                int first = v.first, width = v.width;
+                resolveRoute(first, width, numOut);
+
+                // compact formats are expanded a run at a time
+                for (int done = 0; done < len; )
+                {
+                    const int m = juce::jmin(len - done, scratchSize);
+                    const float* src = v.data->getFloatPointer(v.pos + done);
+                    if (src == nullptr) { v.data->read(scratch.data(), v.pos + done, m); src = scratch.data(); }
+
+                    for (int c = 0; c < width; ++c)
+                        juce::FloatVectorOperations::addWithMultiply(out.getWritePointer(first + c, dst + from + done),
+                                                                     src, v.gain[c], m);
+                    done += m;
+                }
+                v.pos += len;
+            }
+
+            if (v.pos >= v.end) v.active = false;
+            else                                  ++busy;
+        }
+
+        if (busy > peakVoices.load(std::memory_order_relaxed))
+            peakVoices.store(busy, std::memory_order_relaxed);
+    }
+
+    void stopAll() { for (auto& v : voices) v.active = false; }
+
+    // ===== any thread: stats =====
+    juce::int64 getStartedCount() const { return startedCount.load(); }
+    juce::int64 getMergedCount() const { return mergedCount.load(); }
+    int         getPeakVoices() const { return peakVoices.load(); }
+
+private:
+    struct Voice
+    {
+        const SampleBuffer* data = nullptr;
+        int   pos = 0, end = 0, zoneStart = 0, startOffset = 0;
+        int   first = 0, width = 2;
+        float gain[2] = {};
+        juce::uint32 chunk = 0, generation = 0;
+        bool  active = false;
+    };
+
+    // a free voice, or the one closest to its end
+    int allocate()
+    {
+        int best = 0, bestLeft = std::numeric_limits<int>::max();
+        for (int i = 0; i < maxVoices; ++i)
+        {
+            const auto& v = voices[(size_t)i];
+            if (!v.active) return i;
+            const int left = v.end - v.pos;
+            if (left < bestLeft) { bestLeft = left; best = i; }
+        }
+        return best;
+    }
+
+    static constexpr int scratchSize = 256;
+
+    std::array<Voice, maxVoices> voices;
+    std::array<float, scratchSize> scratch{};
+    juce::uint32 chunk = 0;
+
+    std::atomic<juce::int64> startedCount{ 0 }, mergedCount{ 0 };
+    std::atomic<int>         peakVoices{ 0 };
+};
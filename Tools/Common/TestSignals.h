@@ -0,0 +1,35 @@
+#pragma once
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+#include "SampleBuffer.h"
+
+// =========== TestSignals.h ===========
+// Synthetic material shared by the console tools, so they all exercise the
+// engine with the same sounds. A hit is a decaying sine: each round-robin
+// take is detuned by 1 % per take, and each velocity layer is louder than
+// the one below, up to a peak of 0.5.
+struct TestSignals
+{
+    static SampleBuffer::Ptr makeHit(double rate, double hz, double seconds, int takes = 1, int velocityLayers = 1,
+                                     const SampleBuffer::Options& options = {})
+    {
+        const int len = (int)(seconds * rate);
+        std::vector<juce::AudioBuffer<float>> audio;
+        std::vector<SampleBuffer::Variation> vars;
+        audio.reserve((size_t)(takes * velocityLayers));
+
+        for (int v = 0; v < velocityLayers; ++v)
+            for (int t = 0; t < takes; ++t)
+            {
+                const double gain = 0.5 * (v + 1) / velocityLayers;
+                audio.emplace_back(1, len);
+                auto* d = audio.back().getWritePointer(0);
+                for (int i = 0; i < len; ++i)
+                    d[i] = (float)(std::sin(juce::MathConstants<double>::twoPi * hz * (1.0 + 0.01 * t) * i / rate)
+                                   * std::exp(-8.0 * i / len) * gain);
+                vars.push_back({ &audio.back(), v });
+            }
+        return SampleBuffer::create(std::move(vars), options);
+    }
+};
@@ -0,0 +1,368 @@
+#include <JuceHeader.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "ClickAudioSource.h"
+#include "TestSignals.h"
+
+// =========== tribeat-golden ===========
+// Renders a matrix of patterns offline with ClickAudioSource (polyrhythm
+// with 1..256 sides, polymeter, accents, muted subdivisions, samples and the
+// synth, 44.1/48/96 kHz) and checks every case four ways:
+//  - the events (sample, role, gain) and a hash of the audio, rendered in
+//    256-sample blocks, match the case's golden file;
+//  - rendering in 37-sample blocks gives exactly the same;
+//  - every event has its step's role (accents on their steps, muted
+//    subdivisions silent) and falls on the first sample at or after the
+//    step's exact time;
+//  - the render costs no more than the case's ns/sample budget (best of
+//    three runs, 256-sample blocks).
+// Goldens live in Tools/GoldenRender/golden, one file per case; without
+// them every check fails. After a change that moves events or alters the
+// sound on purpose, record them again with --update and commit them along
+// with the change.
+//
+//   cmake -B build -DTRIBEAT_BUILD_TOOLS=ON -DCMAKE_BUILD_TYPE=Release
+//   cmake --build build --target TriBeatGolden
+//   tribeat-golden [--update] [--filter <text>] [--no-timing] [--budget-scale <x>] [--golden <dir>] [--verbose]
+#ifndef TRIBEAT_GOLDEN_DIR
+ #define TRIBEAT_GOLDEN_DIR "Tools/GoldenRender/golden"
+#endif
+
+namespace
+{
+    constexpr double seconds = 8.0;
+
+    struct Event
+    {
+        juce::int64 sample;
+        TriggerSink::Role role;
+        float gain;
+        bool operator==(const Event& o) const { return sample == o.sample && role == o.role && gain == o.gain; }
+        bool operator!=(const Event& o) const { return !(*this == o); }
+    };
+
+    struct EventLog : TriggerSink
+    {
+        std::vector<Event> events;
+        juce::int64 blockStart = 0;
+
+        void trigger(int sampleOffset, int, Role role, float gain) override
+        {
+            events.push_back({ blockStart + sampleOffset, role, gain });
+        }
+    };
+
+    struct Case
+    {
+        juce::String name;
+        double rate = 48000.0, bpm = 120.0;
+        bool   polyrhythm = true;
+        int    sides = 4;           // subdivisions, or beats per bar in polymeter
+        bool   accents = false, mute = false, samples = false;
+        double budgetNs = 0.0;      // per sample
+
+        juce::int64 length() const { return (juce::int64)(seconds * rate); }
+    };
+
+    struct Render
+    {
+        std::vector<Event> events;
+        juce::uint64 audioHash = 0;
+        double nsPerSample = 0.0;
+    };
+
+    // ns/sample, Release build; the per-sample work is the same at every
+    // side count, so only the voice kind matters
+    constexpr double synthBudgetNs = 60.0, sampleBudgetNs = 80.0;
+
+    std::vector<Case> makeCases()
+    {
+        std::vector<Case> cases;
+        const int polySides[] = { 1, 2, 3, 4, 5, 7, 12, 16, 31, 64, 128, 256 };
+        const int meterBeats[] = { 2, 3, 5, 7, 9, 128 };
+
+        for (const double rate : { 44100.0, 48000.0, 96000.0 })
+        {
+            int n = 0;
+            auto add = [&](bool poly, int sides, bool accents, bool mute, bool samples)
+            {
+                Case c;
+                c.rate = rate;
+                c.bpm = (n++ % 2 == 0) ? 120.0 : 97.3;   // a step length that isn't whole samples
+                c.polyrhythm = poly; c.sides = sides;
+                c.accents = accents; c.mute = mute; c.samples = samples;
+                c.budgetNs = samples ? sampleBudgetNs : synthBudgetNs;
+                c.name = juce::String(poly ? "poly" : "meter") + juce::String(sides)
+                       + (accents ? "-accents" : "") + (mute ? "-muted" : "") + (samples ? "-samples" : "-synth")
+                       + "-" + juce::String((int)rate) + "-" + juce::String(c.bpm, 1) + "bpm";
+                cases.push_back(c);
+            };
+
+            for (const int s : polySides)
+            {
+                add(true, s, false, false, false);
+                add(true, s, true,  false, false);
+                add(true, s, true,  true,  false);
+                add(true, s, true,  false, true);
+            }
+            for (const int b : meterBeats)
+            {
+                add(false, b, true, false, false);
+                add(false, b, true, true,  false);
+                add(false, b, true, false, true);
+            }
+        }
+        return cases;
+    }
+
+    void setUp(ClickAudioSource& src, const Case& c)
+    {
+        src.prepareToPlay(256, c.rate);
+        src.setTempo(c.bpm);
+        src.setPolyrhythm(c.polyrhythm);
+        src.setHostBeatsPerBar(4);
+        if (c.polyrhythm) src.setSubdivisions(c.sides);
+        else              src.setBeatsPerBar(c.sides);
+        src.setUpbeatIndex(c.accents && c.sides > 1 ? c.sides / 2 : -1);
+        src.setDownbeatIndex(c.accents ? 0 : -1);
+        src.setMuteSubdivisions(c.mute);
+        if (c.samples)
+        {
+            SampleBuffer::Options untrimmed;
+            untrimmed.trimDb = -120.0f;
+            src.kick.setSample(TestSignals::makeHit(c.rate, 60.0, 0.3, 1, 1, untrimmed));
+            src.snare.setSample(TestSignals::makeHit(c.rate, 180.0, 0.2, 3, 1, untrimmed));
+            src.hihat.setSample(TestSignals::makeHit(c.rate, 6000.0, 0.05, 4, 1, untrimmed));
+        }
+        src.setPlaying(true);
+        src.restart();
+    }
+
+    // FNV-1a over the audio at 16 bits, so last-bit differences between
+    // maths libraries don't count
+    struct AudioHash
+    {
+        juce::uint64 h = 14695981039346656037ull;
+        void add(const float* d, int n)
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                const auto q = (juce::uint16)(juce::int16)juce::jlimit(-32768, 32767, juce::roundToInt(d[i] * 32767.0f));
+                h = (h ^ (q & 0xff)) * 1099511628211ull;
+                h = (h ^ (q >> 8)) * 1099511628211ull;
+            }
+        }
+    };
+
+    Render render(const Case& c, int blockSize, bool timed)
+    {
+        ClickAudioSource src;
+        EventLog log;
+        log.events.reserve((size_t)(seconds * 64.0 * 8.0));
+        setUp(src, c);
+        src.sink = &log;
+
+        std::vector<float> out((size_t)blockSize);
+        AudioHash hash;
+        const auto total = c.length();
+
+        const auto t0 = std::chrono::steady_clock::now();
+        for (juce::int64 at = 0; at < total; at += blockSize)
+        {
+            const int n = (int)juce::jmin<juce::int64>(blockSize, total - at);
+            log.blockStart = at;
+            src.render(out.data(), n);
+            if (!timed) hash.add(out.data(), n);
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+
+        Render r;
+        r.events = std::move(log.events);
+        r.audioHash = hash.h;
+        r.nsPerSample = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)total;
+        return r;
+    }
+
+    // The role and time each step should have, in firing order: step k is
+    // step k mod sides of the pattern, due at k * step length.
+    juce::String checkPattern(const Case& c, const std::vector<Event>& events)
+    {
+        const int up = c.accents && c.sides > 1 ? c.sides / 2 : -1, down = c.accents ? 0 : -1;
+        const double samplesPerBeat = c.rate * 60.0 / c.bpm;
+        const double stepLength = c.polyrhythm ? samplesPerBeat * 4.0 / c.sides : samplesPerBeat;
+        size_t e = 0;
+        const juce::int64 steps = (juce::int64)(c.length() * 2);   // more than can fire
+
+        for (juce::int64 k = 0; k < steps && e < events.size(); ++k)
+        {
+            const int step = (int)(k % c.sides);
+            const auto role = step == down ? TriggerSink::Downbeat : step == up ? TriggerSink::Upbeat : TriggerSink::Subdivision;
+            if (role == TriggerSink::Subdivision && c.mute) continue;
+            if (events[e].role != role)
+                return "event " + juce::String((int)e) + " at sample " + juce::String(events[e].sample) + " should be step "
+                     + juce::String(step) + " (" + juce::String((int)role) + "), is role " + juce::String((int)events[e].role);
+            const double late = (double)events[e].sample - (double)k * stepLength;
+            if (late < -0.01 || late > 1.01)
+                return "event " + juce::String((int)e) + " (step " + juce::String(k) + ") is " + juce::String(late, 2)
+                     + " samples off its time";
+            ++e;
+        }
+        if (events.empty() && !(c.mute && !c.accents)) return "no events";
+        return {};
+    }
+
+    // ===== golden files =====
+    const char* roleName(TriggerSink::Role r) { return r == TriggerSink::Downbeat ? "down" : r == TriggerSink::Upbeat ? "up" : "sub"; }
+
+    TriggerSink::Role parseRole(const juce::String& s)
+    {
+        return s == "down" ? TriggerSink::Downbeat : s == "up" ? TriggerSink::Upbeat : TriggerSink::Subdivision;
+    }
+
+    juce::String toText(const Case& c, const Render& r)
+    {
+        juce::String t;
+        t << "# tribeat-golden: " << c.name << "\n"
+          << "audio " << juce::String::toHexString((juce::int64)r.audioHash) << "\n"
+          << "events " << (int)r.events.size() << "\n";
+        for (const auto& e : r.events)
+            t << e.sample << " " << roleName(e.role) << " " << juce::String(e.gain, 4) << "\n";
+        return t;
+    }
+
+    bool fromText(const juce::String& text, Render& r)
+    {
+        juce::StringArray lines;
+        lines.addLines(text);
+        bool haveAudio = false;
+        for (const auto& line : lines)
+        {
+            const auto l = line.trim();
+            if (l.isEmpty() || l.startsWithChar('#') || l.startsWith("events")) continue;
+            if (l.startsWith("audio"))
+            {
+                r.audioHash = (juce::uint64)l.fromFirstOccurrenceOf(" ", false, false).trim().getHexValue64();
+                haveAudio = true;
+                continue;
+            }
+            const auto f = juce::StringArray::fromTokens(l, " ", "");
+            if (f.size() != 3) return false;
+            r.events.push_back({ f[0].getLargeIntValue(), parseRole(f[1]), f[2].getFloatValue() });
+        }
+        return haveAudio;
+    }
+
+    // gains are stored to 4 places
+    bool sameEvent(const Event& a, const Event& b)
+    {
+        return a.sample == b.sample && a.role == b.role && std::abs(a.gain - b.gain) < 1.0e-3f;
+    }
+
+    juce::String firstDifference(const std::vector<Event>& expected, const std::vector<Event>& actual, bool exact)
+    {
+        const size_t n = std::min(expected.size(), actual.size());
+        for (size_t i = 0; i < n; ++i)
+            if (exact ? expected[i] != actual[i] : !sameEvent(expected[i], actual[i]))
+                return "event " + juce::String((int)i) + ": expected " + juce::String(expected[i].sample) + " " + roleName(expected[i].role)
+                     + ", got " + juce::String(actual[i].sample) + " " + roleName(actual[i].role);
+        if (expected.size() != actual.size())
+            return juce::String((int)expected.size()) + " events expected, got " + juce::String((int)actual.size());
+        return {};
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool update = false, timing = true, verbose = false;
+    double budgetScale = 1.0;
+    juce::String filter;
+    juce::File goldenDir(juce::File::getCurrentWorkingDirectory().getChildFile(TRIBEAT_GOLDEN_DIR));
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String a(argv[i]);
+        if (a == "--update")                      update = true;
+        else if (a == "--no-timing")              timing = false;
+        else if (a == "--verbose")                verbose = true;
+        else if (a == "--filter" && i + 1 < argc) filter = argv[++i];
+        else if (a == "--budget-scale" && i + 1 < argc) budgetScale = juce::String(argv[++i]).getDoubleValue();
+        else if (a == "--golden" && i + 1 < argc) goldenDir = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else { std::cerr << "usage: tribeat-golden [--update] [--filter <text>] [--no-timing] [--budget-scale <x>] [--golden <dir>] [--verbose]\n"; return 2; }
+    }
+   #if JUCE_DEBUG
+    budgetScale *= 10.0;   // budgets are for optimised builds
+   #endif
+
+    if (update && !goldenDir.createDirectory())
+    {
+        std::cerr << "Can't create " << goldenDir.getFullPathName() << "\n";
+        return 2;
+    }
+    if (!update && goldenDir.findChildFiles(juce::File::findFiles, false, "*.txt").isEmpty())
+    {
+        std::cerr << "No golden files in " << goldenDir.getFullPathName() << " (record them with --update and commit them)\n";
+        return 1;
+    }
+
+    int run = 0, failed = 0, missing = 0;
+    for (const auto& c : makeCases())
+    {
+        if (filter.isNotEmpty() && !c.name.contains(filter)) continue;
+        ++run;
+
+        juce::StringArray problems;
+        const auto r = render(c, 256, false);
+        const auto odd = render(c, 37, false);
+
+        if (const auto d = firstDifference(r.events, odd.events, true); d.isNotEmpty())
+            problems.add("37-sample blocks: " + d);
+        else if (odd.audioHash != r.audioHash)
+            problems.add("37-sample blocks: different audio");
+
+        if (const auto d = checkPattern(c, r.events); d.isNotEmpty())
+            problems.add("pattern: " + d);
+
+        const auto file = goldenDir.getChildFile(c.name + ".txt");
+        if (update)
+        {
+            if (!file.replaceWithText(toText(c, r))) problems.add("can't write " + file.getFullPathName());
+        }
+        else
+        {
+            Render golden;
+            if (!file.existsAsFile())               { problems.add("no golden file (record with --update)"); ++missing; }
+            else if (!fromText(file.loadFileAsString(), golden)) problems.add("unreadable golden file " + file.getFileName());
+            else
+            {
+                if (const auto d = firstDifference(golden.events, r.events, false); d.isNotEmpty()) problems.add("golden: " + d);
+                if (golden.audioHash != r.audioHash) problems.add("golden: different audio");
+            }
+        }
+
+        double ns = 0.0;
+        if (timing)
+        {
+            ns = render(c, 256, true).nsPerSample;
+            for (int rep = 0; rep < 2; ++rep) ns = std::min(ns, render(c, 256, true).nsPerSample);
+            if (ns > c.budgetNs * budgetScale)
+                problems.add("too slow: " + juce::String(ns, 1) + " ns/sample, budget " + juce::String(c.budgetNs * budgetScale, 1));
+        }
+
+        if (!problems.isEmpty()) ++failed;
+        if (verbose || !problems.isEmpty())
+        {
+            std::cout << (problems.isEmpty() ? "ok    " : "FAIL  ") << c.name << "  " << (int)r.events.size() << " events";
+            if (timing) std::cout << ", " << juce::String(ns, 1) << " ns/sample";
+            std::cout << "\n";
+            for (const auto& p : problems) std::cout << "      " << p << "\n";
+        }
+    }
+
+    std::cout << (update ? "recorded " : "checked ") << run << " case(s), " << failed << " failed";
+    if (missing > 0) std::cout << " (" << missing << " without a golden file)";
+    std::cout << "\n";
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+#include <JuceHeader.h>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include "LayerEngine.h"
+#include "VirtualAudioDevice.h"
+
+// =========== tribeat-headless ===========
+// Runs LayerEngine the way the app does, through an AudioDeviceManager and
+// an AudioSourcePlayer, on the virtual audio device (createSetup), with no
+// hardware. It plays one polyrhythm layer on the synth for a few seconds and
+// then checks what the device saw:
+//  - timing: every block was called back, and in real-time pacing no
+//    callback overran its block (xruns);
+//  - output: the memory capture holds the whole run, is not silent, and
+//    every step starts on its own sample, ceil(k * step length), with
+//    silence just before it.
+// The exit code is 1 if any check fails. Meant for CI machines without a
+// sound card; --free-running renders as fast as the machine can.
+//
+//   cmake -B build -DTRIBEAT_BUILD_TOOLS=ON -DCMAKE_BUILD_TYPE=Release
+//   cmake --build build --target TriBeatHeadless
+//   tribeat-headless [--seconds 5] [--rate 48000] [--block 256] [--sides 5] [--bpm 120] [--free-running] [--max-xruns 0]
+namespace
+{
+    struct Settings
+    {
+        double seconds = 5.0, rate = 48000.0, bpm = 120.0;
+        int    block = 256, sides = 5, maxXruns = 0;
+        bool   freeRunning = false;
+    };
+
+    bool parse(int argc, char* argv[], Settings& s)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const juce::String a(argv[i]);
+            const bool hasValue = i + 1 < argc;
+            if (a == "--free-running")                s.freeRunning = true;
+            else if (a == "--seconds" && hasValue)    s.seconds = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--rate" && hasValue)       s.rate = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--block" && hasValue)      s.block = juce::String(argv[++i]).getIntValue();
+            else if (a == "--sides" && hasValue)      s.sides = juce::String(argv[++i]).getIntValue();
+            else if (a == "--bpm" && hasValue)        s.bpm = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--max-xruns" && hasValue)  s.maxXruns = juce::String(argv[++i]).getIntValue();
+            else return false;
+        }
+        s.seconds = juce::jlimit(0.5, 600.0, s.seconds);
+        s.sides = juce::jlimit(1, ClickAudioSource::maxSteps, s.sides);
+        return s.rate > 0.0 && s.block > 0 && s.bpm > 0.0;
+    }
+
+    // The steps of the layer against the capture: each must be silent for a
+    // while before its sample and sound from that sample (or the next, when
+    // the synth's phase is at a zero crossing). Needs steps longer than the
+    // click's decay.
+    juce::StringArray checkSteps(const juce::AudioBuffer<float>& capture, int numSamples, double stepLength, int& checked)
+    {
+        constexpr int quiet = 64;
+        constexpr float onset = 1.0e-3f;
+        juce::StringArray problems;
+        const float* d = capture.getReadPointer(0);
+
+        checked = 0;
+        for (juce::int64 k = 0;; ++k)
+        {
+            const auto due = (juce::int64)std::ceil((double)k * stepLength - 1.0e-7);
+            if (due + quiet >= numSamples) break;
+
+            int first = -1;
+            for (int i = (int)juce::jmax<juce::int64>(0, due - quiet); i < (int)due + quiet; ++i)
+                if (std::abs(d[i]) > onset) { first = i; break; }
+
+            if (first < 0)                       problems.add("step " + juce::String(k) + " at " + juce::String(due) + " is silent");
+            else if (first < due || first > due + 1)
+                problems.add("step " + juce::String(k) + " due at " + juce::String(due) + " starts at " + juce::String(first));
+            ++checked;
+        }
+        return problems;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const juce::ScopedJuceInitialiser_GUI init;
+
+    Settings settings;
+    if (!parse(argc, argv, settings))
+    {
+        std::cerr << "usage: tribeat-headless [--seconds 5] [--rate 48000] [--block 256] [--sides 5] [--bpm 120] [--free-running] [--max-xruns 0]\n";
+        return 2;
+    }
+
+    const double spbar = settings.rate * 60.0 / settings.bpm * 4.0;
+    const double stepLength = spbar / settings.sides;
+    if (stepLength < 4096.0)
+    {
+        std::cerr << "Steps of " << stepLength << " samples are too short to tell apart; use fewer sides or a slower tempo.\n";
+        return 2;
+    }
+
+    // only as much memory capture as the run needs
+    VirtualAudioDevice::Options options;
+    options.memorySeconds = settings.seconds + 1.0;
+    options.numOutputs = 2;
+    options.numInputs = 0;
+
+    LayerEngine engine;
+    engine.setLimiterEnabled(false);   // its look-ahead would delay every step
+
+    ClickAudioSource layer;
+    layer.setTempo(settings.bpm);
+    layer.setPolyrhythm(true);
+    layer.setHostBeatsPerBar(4);
+    layer.setSubdivisions(settings.sides);
+    layer.setUpbeatIndex(settings.sides > 1 ? settings.sides / 2 : -1);
+    layer.setDownbeatIndex(0);
+    layer.setPlaying(true);
+    engine.addLayer(&layer);
+
+    // the player is in place before the device starts, so the first captured
+    // block is the engine's first block
+    juce::AudioSourcePlayer player;
+    player.setSource(&engine);
+
+    juce::AudioDeviceManager deviceManager;
+    deviceManager.addAudioDeviceType(std::make_unique<VirtualAudioDeviceType>(options));
+    deviceManager.addAudioCallback(&player);
+    const auto setup = VirtualAudioDeviceType::createSetup(settings.freeRunning, settings.rate, settings.block);
+    if (const auto err = deviceManager.initialise(0, 2, setup.get(), false); err.isNotEmpty())
+    {
+        std::cerr << "Can't open the virtual device: " << err << "\n";
+        return 1;
+    }
+    auto* device = dynamic_cast<VirtualAudioDevice*>(deviceManager.getCurrentAudioDevice());
+    if (device == nullptr)
+    {
+        std::cerr << "The device manager didn't open the virtual device.\n";
+        return 1;
+    }
+
+    const auto wanted = (int)(settings.seconds * device->getCurrentSampleRate());
+    std::printf("%s virtual device, %d-sample blocks at %.0f Hz, %.1f s of %d steps per bar at %.1f bpm\n",
+                settings.freeRunning ? "free-running" : "real-time", device->getCurrentBufferSizeSamples(),
+                device->getCurrentSampleRate(), settings.seconds, settings.sides, settings.bpm);
+    std::fflush(stdout);
+
+    const double deadline = juce::Time::getMillisecondCounterHiRes() + 1000.0 * (settings.seconds * 2.0 + 5.0);
+    while (device->getCapturedSamples() < wanted && juce::Time::getMillisecondCounterHiRes() < deadline)
+        juce::Thread::sleep(10);
+
+    deviceManager.removeAudioCallback(&player);
+    player.setSource(nullptr);
+    const auto stats = device->getTimingStats();
+    const int length = juce::jmin(device->getCapturedSamples(), wanted);   // the device runs on silent
+
+    juce::StringArray problems;
+    const auto blocks = (juce::int64)(length / device->getCurrentBufferSizeSamples());
+    if (length < wanted)
+        problems.add("captured " + juce::String(length) + " of " + juce::String(wanted) + " samples before the timeout");
+    if (stats.callbacks < blocks)
+        problems.add(juce::String(stats.callbacks) + " callbacks for " + juce::String(blocks) + " captured blocks");
+    if (!settings.freeRunning && stats.xruns > settings.maxXruns)
+        problems.add(juce::String(stats.xruns) + " xrun(s), at most " + juce::String(settings.maxXruns) + " allowed");
+
+    const auto& capture = device->getCapture();
+    if (length == 0 || capture.getMagnitude(0, 0, length) <= 0.0f) problems.add("the output is silent");
+
+    int steps = 0;
+    problems.addArray(checkSteps(capture, length, stepLength, steps));
+
+    std::printf("%s\n", VirtualAudioDevice::describe(stats).toRawUTF8());
+    std::printf("%d steps checked in %d captured samples\n", steps, length);
+
+    engine.removeLayer(&layer);
+    deviceManager.closeAudioDevice();
+
+    for (const auto& p : problems) std::printf("FAIL  %s\n", p.toRawUTF8());
+    if (problems.isEmpty()) std::printf("Done.\n");
+    return problems.isEmpty() ? 0 : 1;
+}
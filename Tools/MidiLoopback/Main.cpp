@@ -0,0 +1,250 @@
+#include <JuceHeader.h>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include "LayerEngine.h"
+
+// =========== tribeat-midi-loopback ===========
+// Measures the MIDI output end to end. LayerEngine plays one polyrhythm
+// layer on a simulated audio thread paced in real time, with a
+// MidiTriggerOutput on the virtual "Tri-Beat" port (or --output <device>);
+// the tool opens that port again as a MIDI input and timestamps every
+// note-on as it arrives. Step k is due k * step length after the first, so
+// the arrival times are fitted to a line over the step index and the
+// jitter is each arrival's distance from that line. The exit code is 1 if
+// the worst jitter is above --max-jitter-ms (0.5 ms) or notes were lost.
+//
+// Virtual ports exist on Linux (ALSA) and macOS (CoreMIDI). Elsewhere, or if
+// the system doesn't list our own port as an input, route a loopback cable
+// and name both ends with --output and --input.
+//
+//   cmake -B build -DTRIBEAT_BUILD_TOOLS=ON -DCMAKE_BUILD_TYPE=Release
+//   cmake --build build --target TriBeatMidiLoopback
+//   tribeat-midi-loopback [--seconds 10] [--bpm 120] [--sides 8] [--rate 48000] [--block 256]
+//                         [--output virtual] [--input Tri-Beat] [--max-jitter-ms 0.5]
+namespace
+{
+    struct Settings
+    {
+        double seconds = 10.0, bpm = 120.0, rate = 48000.0, maxJitterMs = 0.5;
+        double warmupSeconds = 1.0;   // the output's DLL locks onto the callbacks first
+        int    block = 256, sides = 8;
+        juce::String output = "virtual", input = "Tri-Beat";
+    };
+
+    bool parse(int argc, char* argv[], Settings& s)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const juce::String a(argv[i]);
+            const bool hasValue = i + 1 < argc;
+            if (a == "--seconds" && hasValue)             s.seconds = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--bpm" && hasValue)            s.bpm = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--sides" && hasValue)          s.sides = juce::String(argv[++i]).getIntValue();
+            else if (a == "--rate" && hasValue)           s.rate = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--block" && hasValue)          s.block = juce::String(argv[++i]).getIntValue();
+            else if (a == "--output" && hasValue)         s.output = argv[++i];
+            else if (a == "--input" && hasValue)          s.input = argv[++i];
+            else if (a == "--max-jitter-ms" && hasValue)  s.maxJitterMs = juce::String(argv[++i]).getDoubleValue();
+            else return false;
+        }
+        s.seconds = juce::jlimit(2.0, 3600.0, s.seconds);
+        s.sides = juce::jlimit(1, ClickAudioSource::maxSteps, s.sides);
+        return s.rate > 0.0 && s.block > 0 && s.bpm > 0.0 && s.maxJitterMs > 0.0;
+    }
+
+    // Pulls blocks from the engine at the device's pace, the way a sound
+    // card's callback would, so the output's DLL sees real callback times.
+    class Pacer : public juce::Thread
+    {
+    public:
+        Pacer(LayerEngine& e, double sr, int blockSize)
+            : juce::Thread("Tri-Beat loopback audio"), engine(e), rate(sr), buffer(2, blockSize) {}
+
+        ~Pacer() override { stopThread(1000); }
+
+        void run() override
+        {
+            const double periodMs = 1000.0 * buffer.getNumSamples() / rate;
+            double next = juce::Time::getMillisecondCounterHiRes();
+
+            while (!threadShouldExit())
+            {
+                buffer.clear();
+                engine.getNextAudioBlock(juce::AudioSourceChannelInfo(&buffer, 0, buffer.getNumSamples()));
+
+                next += periodMs;
+                for (double ahead = next - juce::Time::getMillisecondCounterHiRes(); ahead > 0.0;
+                     ahead = next - juce::Time::getMillisecondCounterHiRes())
+                {
+                    if (ahead > 2.0) juce::Thread::sleep((int)(ahead - 1.0));
+                    else             juce::Thread::yield();
+                }
+            }
+        }
+
+    private:
+        LayerEngine& engine;
+        double rate;
+        juce::AudioBuffer<float> buffer;
+    };
+
+    // Arrival time of every note-on, in ms.
+    class Receiver : public juce::MidiInputCallback
+    {
+    public:
+        void handleIncomingMidiMessage(juce::MidiInput*, const juce::MidiMessage& m) override
+        {
+            if (!m.isNoteOn()) return;
+            const double now = juce::Time::getMillisecondCounterHiRes();
+            const juce::ScopedLock sl(lock);
+            arrivals.push_back(now);
+        }
+
+        std::vector<double> take()
+        {
+            std::vector<double> out;
+            const juce::ScopedLock sl(lock);
+            out.swap(arrivals);
+            return out;
+        }
+
+    private:
+        juce::CriticalSection lock;
+        std::vector<double> arrivals;
+    };
+
+    std::unique_ptr<juce::MidiInput> openInput(const juce::String& name, Receiver& receiver)
+    {
+        for (const auto& d : juce::MidiInput::getAvailableDevices())
+            if (d.name == name || d.identifier == name)
+                return juce::MidiInput::openDevice(d.identifier, &receiver);
+        return nullptr;
+    }
+
+    struct Jitter { double meanMs = 0.0, maxMs = 0.0; int notes = 0, lost = 0; };
+
+    // Steps are numbered by their distance from the first arrival, then
+    // arrival = a + b * step is fitted by least squares; the slope absorbs
+    // any rate difference between the two clocks.
+    Jitter measure(const std::vector<double>& arrivals, double stepMs)
+    {
+        Jitter j;
+        j.notes = (int)arrivals.size();
+        if (j.notes < 3) return j;
+
+        std::vector<double> step;
+        step.reserve(arrivals.size());
+        for (const double t : arrivals) step.push_back(std::round((t - arrivals.front()) / stepMs));
+
+        double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        for (size_t i = 0; i < arrivals.size(); ++i)
+        {
+            sx += step[i]; sy += arrivals[i];
+            sxx += step[i] * step[i]; sxy += step[i] * arrivals[i];
+        }
+        const double n = (double)arrivals.size();
+        const double b = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+        const double a = (sy - b * sx) / n;
+
+        double sum = 0.0;
+        for (size_t i = 0; i < arrivals.size(); ++i)
+        {
+            const double d = std::abs(arrivals[i] - (a + b * step[i]));
+            sum += d;
+            j.maxMs = juce::jmax(j.maxMs, d);
+        }
+        j.meanMs = sum / n;
+        j.lost = (int)step.back() + 1 - j.notes;
+        return j;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const juce::ScopedJuceInitialiser_GUI init;
+
+    Settings settings;
+    if (!parse(argc, argv, settings))
+    {
+        std::cerr << "usage: tribeat-midi-loopback [--seconds 10] [--bpm 120] [--sides 8] [--rate 48000] [--block 256]\n"
+                     "                             [--output virtual] [--input Tri-Beat] [--max-jitter-ms 0.5]\n";
+        return 2;
+    }
+
+    MidiTriggerOutput midiOut;
+    if (!midiOut.open(settings.output))
+    {
+        std::cerr << "Can't open the MIDI output '" << settings.output << "'"
+                  << (settings.output == "virtual" ? " (virtual ports need ALSA or CoreMIDI)" : "") << ".\n";
+        return 2;
+    }
+
+    Receiver receiver;
+    auto input = openInput(settings.input, receiver);
+    if (input == nullptr)
+    {
+        std::cerr << "No MIDI input called '" << settings.input << "'. Inputs:\n";
+        for (const auto& d : juce::MidiInput::getAvailableDevices()) std::cerr << "  " << d.name << "\n";
+        std::cerr << "Connect the output to one of them and pass it with --input.\n";
+        return 2;
+    }
+    input->start();
+
+    LayerEngine engine;
+    ClickAudioSource layer;
+    layer.setTempo(settings.bpm);
+    layer.setPolyrhythm(true);
+    layer.setHostBeatsPerBar(4);
+    layer.setSubdivisions(settings.sides);
+    layer.setUpbeatIndex(settings.sides > 1 ? settings.sides / 2 : -1);
+    layer.setDownbeatIndex(0);
+    layer.setPlaying(true);
+
+    engine.prepareToPlay(settings.block, settings.rate);
+    engine.addLayer(&layer);
+    engine.setMidiOutput(&midiOut);
+
+    const double stepMs = 1000.0 * 60.0 / settings.bpm * 4.0 / settings.sides;
+    std::printf("%d steps per bar at %.1f bpm (%.2f ms apart), %d-sample blocks at %.0f Hz, %s -> %s, %.0f s\n",
+                settings.sides, settings.bpm, stepMs, settings.block, settings.rate,
+                settings.output.toRawUTF8(), settings.input.toRawUTF8(), settings.seconds);
+    std::fflush(stdout);
+
+    Pacer pacer(engine, settings.rate, settings.block);
+    pacer.startThread(juce::Thread::Priority::highest);
+
+    juce::Thread::sleep((int)(1000.0 * settings.warmupSeconds));
+    receiver.take();
+    midiOut.resetJitterStats();
+
+    juce::Thread::sleep((int)(1000.0 * (settings.seconds - settings.warmupSeconds)));
+    pacer.stopThread(1000);
+    engine.releaseResources();   // nothing drains the engine's changes from here on
+    juce::Thread::sleep(50);   // the last notes are still on their way
+    input->stop();
+
+    engine.setMidiOutput(nullptr);
+    midiOut.close();
+    engine.removeLayer(&layer);
+
+    const auto j = measure(receiver.take(), stepMs);
+    const auto sent = midiOut.getJitterStats();
+
+    std::printf("sender: %lld message(s), lateness mean %.3f ms, max %.3f ms, %lld dropped\n",
+                (long long)sent.count, sent.meanMs, sent.maxMs, (long long)sent.dropped);
+    std::printf("loopback: %d note(s), jitter mean %.3f ms, max %.3f ms, %d lost\n", j.notes, j.meanMs, j.maxMs, j.lost);
+
+    juce::StringArray problems;
+    if (j.notes < 3)
+        problems.add("only " + juce::String(j.notes) + " note(s) came back");
+    if (j.lost > 0 || sent.dropped > 0)
+        problems.add(juce::String(j.lost) + " note(s) lost, " + juce::String(sent.dropped) + " dropped by the sender");
+    if (j.maxMs > settings.maxJitterMs)
+        problems.add("jitter " + juce::String(j.maxMs, 3) + " ms, at most " + juce::String(settings.maxJitterMs, 3) + " ms allowed");
+
+    for (const auto& p : problems) std::printf("FAIL  %s\n", p.toRawUTF8());
+    if (problems.isEmpty()) std::printf("Done.\n");
+    return problems.isEmpty() ? 0 : 1;
+}
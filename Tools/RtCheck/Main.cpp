@@ -0,0 +1,328 @@
+#include <JuceHeader.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "LayerEngine.h"
+#include "PitchCache.h"
+#include "RtCheck.h"
+#include "TestSignals.h"
+
+// =========== tribeat-rtcheck ===========
+// Drives LayerEngine through everything the UI does to it (transport,
+// tempo, shapes, accents, samples, routing, master bus, preset switches,
+// recording, practice, MIDI clock, host transport, parallel rendering),
+// rendering blocks in between, with the RtCheck hooks compiled in. Every
+// allocation or lock inside a callback is reported with its stack trace;
+// the exit code is 1 if there was any.
+//
+//   cmake -B build -DTRIBEAT_BUILD_TOOLS=ON && cmake --build build --target TriBeatRtCheck
+//   tribeat-rtcheck [--verbose]
+#if !TRIBEAT_RT_CHECKS
+ #error "tribeat-rtcheck needs TRIBEAT_RT_CHECKS=1"
+#endif
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int    blockSize = 256, numOutputs = 4;
+
+    struct Harness
+    {
+        LayerEngine       engine;
+        MetronomeSource   metronome;
+        PresetBank        bank;
+        MidiTriggerOutput midi;
+        MidiClockFollower follower;
+        BounceRecorder    recorder;
+        PracticeMonitor   practice;
+        PitchCache        pitchCache;
+
+        std::vector<std::unique_ptr<ClickAudioSource>> layers, retired;
+        juce::AudioBuffer<float> device{ numOutputs, blockSize };
+        SampleBuffer::Ptr kick, snare, hihat;
+        double ppq = 0.0;
+        bool   hostPlaying = false;
+
+        Harness()
+        {
+            engine.setMetronome(&metronome);
+            engine.setPresetBank(&bank);
+            engine.setMidiOutput(&midi);
+            engine.setClockFollower(&follower);
+            engine.setRecorder(&recorder);
+            engine.setPracticeMonitor(&practice);
+            engine.prepareToPlay(blockSize, sampleRate);
+
+            kick = TestSignals::makeHit(sampleRate, 60.0, 0.3);
+            snare = TestSignals::makeHit(sampleRate, 180.0, 0.2, 3, 2);
+            hihat = TestSignals::makeHit(sampleRate, 6000.0, 0.05, 4);
+        }
+
+        ~Harness()
+        {
+            recorder.stop();
+            engine.releaseResources();   // the device stops; what is still queued runs now
+            engine.setRenderThreads(0);
+            for (auto& l : layers)  engine.removeLayer(l.get());
+            for (auto& r : retired) engine.removeLayer(r.get());
+        }
+
+        ClickAudioSource& addLayer(int sides)
+        {
+            auto src = std::make_unique<ClickAudioSource>();
+            src->setTempo(120.0);
+            src->setPolyrhythm(true);
+            src->setSubdivisions(sides);
+            src->setPlaying(true);
+            engine.addLayer(src.get());
+            layers.push_back(std::move(src));
+            return *layers.back();
+        }
+
+        void loadSamples(ClickAudioSource& l)
+        {
+            engine.setSample(l.kick, kick);
+            engine.setSample(l.snare, snare);
+            engine.setSample(l.hihat, hihat);
+        }
+
+        // `input`: a click on channel 0 every half second, as from the device input
+        void render(int blocks, bool input = false, bool host = false)
+        {
+            for (int b = 0; b < blocks; ++b)
+            {
+                device.clear();
+                if (input && (b * blockSize) % 24000 < blockSize)
+                    for (int i = 0; i < 8; ++i) device.setSample(0, i, 0.8f);
+
+                if (host)
+                {
+                    engine.followHost(hostPlaying, 120.0, ppq, 4);
+                    ppq += blockSize / (sampleRate * 0.5);
+                }
+
+                juce::AudioSourceChannelInfo info(&device, 0, blockSize);
+                engine.getNextAudioBlock(info);
+            }
+
+            if (!retired.empty() && engine.isFadeIdle())
+                retired.clear();
+        }
+
+        // as MainComponent::adoptSwitchedSlot: the engine switches on a bar line
+        bool switchPreset(int slot, const PatternPreset& p)
+        {
+            bank.setPreset(slot, p);
+            bank.requestSlot(slot);
+            for (int tries = 0; tries < 2000; ++tries)
+            {
+                render(4);
+                const int done = bank.takeCompletedSwitch();
+                if (done < 0) { juce::Thread::sleep(1); continue; }
+
+                PatternPreset taken;
+                auto voices = bank.takeVoices(done, taken);
+                for (auto& l : layers) retired.push_back(std::move(l));
+                layers = std::move(voices);
+                bank.reload(done);
+                return true;
+            }
+            return false;
+        }
+    };
+
+    PatternPreset makePattern(std::initializer_list<int> sides, double bpm)
+    {
+        PatternPreset p;
+        p.bpm = bpm;
+        for (int s : sides)
+        {
+            LayerPreset l;
+            l.sides = s;
+            l.upIndex = 1; l.downIndex = 0;
+            p.layers.push_back(l);
+        }
+        return p;
+    }
+
+    struct Step
+    {
+        const char* name;
+        std::function<void(Harness&)> run;
+    };
+
+    std::vector<Step> steps()
+    {
+        return {
+            { "start transport", [](Harness& h)
+                {
+                    h.addLayer(3); h.addLayer(4);
+                    h.metronome.setTempo(120.0);
+                    h.metronome.setPlaying(true);
+                    h.render(200);
+                } },
+            { "tempo changes", [](Harness& h)
+                {
+                    for (double bpm : { 60.0, 181.0, 300.0, 97.5 })
+                    {
+                        for (auto& l : h.layers) l->setTempo(bpm);
+                        h.metronome.setTempo(bpm);
+                        h.render(40);
+                    }
+                } },
+            { "shapes and mode", [](Harness& h)
+                {
+                    auto& l = *h.layers.front();
+                    for (int n : { 5, 7, 12, 2 }) { l.setSubdivisions(n); h.render(30); }
+                    for (auto& x : h.layers) x->setPolyrhythm(false);
+                    l.setBeatsPerBar(5);
+                    h.render(60);
+                    for (auto& x : h.layers) x->setPolyrhythm(true);
+                    h.render(60);
+                } },
+            { "accents, notes, mute subdivisions", [](Harness& h)
+                {
+                    auto& l = *h.layers.front();
+                    l.setUpbeatIndex(1); l.setDownbeatIndex(0);
+                    l.setUpbeatFreqHz(660.0); l.setDownbeatFreqHz(330.0);
+                    h.render(100);
+                    l.setMuteSubdivisions(true);  h.render(60);
+                    l.setMuteSubdivisions(false); h.render(60);
+                } },
+            { "add and remove layers", [](Harness& h)
+                {
+                    for (int n = 3; n < 11; ++n) { h.addLayer(n); h.render(10); }
+                    for (int i = 0; i < 6; ++i)
+                    {
+                        h.engine.removeLayer(h.layers.back().get());
+                        h.retired.push_back(std::move(h.layers.back()));
+                        h.layers.pop_back();
+                        h.render(10);
+                    }
+                } },
+            { "load samples", [](Harness& h)
+                {
+                    for (auto& l : h.layers) { h.loadSamples(*l); h.render(20); }
+                    h.render(200);
+                } },
+            { "repitch samples", [](Harness& h)
+                {
+                    auto& l = *h.layers.front();
+                    for (double semis : { 3.0, -5.0, 12.0 })
+                    {
+                        h.engine.setSample(l.kick, h.pitchCache.get(h.kick, semis), h.kick);
+                        h.render(60);
+                    }
+                } },
+            { "routing, level, pan", [](Harness& h)
+                {
+                    auto& l = *h.layers.front();
+                    l.outChannel = 2; l.outWidth = 2; h.render(40);
+                    l.outWidth = 1;                   h.render(40);
+                    l.outChannel = 7;                 h.render(40);   // not on this device
+                    l.outChannel = 0; l.outWidth = 2;
+                    l.outGain = 0.25f; l.outPan = -0.8f; h.render(40);
+                    h.metronome.outChannel = 1; h.metronome.outWidth = 1; h.render(40);
+                } },
+            { "master bus", [](Harness& h)
+                {
+                    h.engine.setMasterGainDb(-6.0f);       h.render(40);
+                    h.engine.setLimiterEnabled(false);     h.render(40);
+                    h.engine.setLimiterEnabled(true);
+                    h.engine.setLimiterCeilingDb(-3.0f);   h.render(40);
+                    h.engine.setMasterGainDb(12.0f);       h.render(40);
+                    h.engine.setMasterGainDb(0.0f);
+                } },
+            { "preset switch, hard cut", [](Harness& h)
+                {
+                    h.engine.setCrossfadeMs(0.0);
+                    if (!h.switchPreset(0, makePattern({ 3, 5, 7 }, 110.0))) std::cerr << "  (preset 0 never armed)\n";
+                    h.render(200);
+                } },
+            { "preset switch, crossfade", [](Harness& h)
+                {
+                    h.engine.setCrossfadeMs(250.0);
+                    if (!h.switchPreset(1, makePattern({ 4, 6 }, 140.0))) std::cerr << "  (preset 1 never armed)\n";
+                    h.render(400);
+                } },
+            { "record mix and stems", [](Harness& h)
+                {
+                    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("tribeat-rtcheck.wav");
+                    h.recorder.start(file, BounceRecorder::Format::wav, sampleRate, numOutputs, (int)h.layers.size());
+                    h.render(400);
+                    h.recorder.stop();
+                    h.render(20);
+                    file.deleteFile();
+                    for (int i = 0; i < (int)h.layers.size(); ++i)
+                        file.getSiblingFile(file.getFileNameWithoutExtension() + "-layer" + juce::String(i + 1) + ".wav").deleteFile();
+                } },
+            { "practice monitor", [](Harness& h)
+                {
+                    h.practice.setEnabled(true);
+                    h.render(400, true);
+                    h.practice.collect();
+                    h.practice.setEnabled(false);
+                } },
+            { "external MIDI clock", [](Harness& h)
+                {
+                    h.follower.setEnabled(true);
+                    h.follower.handleMessage(juce::MidiMessage::midiStart());
+                    for (int b = 0; b < 200; ++b)
+                    {
+                        if (b % 2 == 0) h.follower.handleMessage(juce::MidiMessage::midiClock());
+                        h.render(1);
+                    }
+                    h.follower.handleMessage(juce::MidiMessage::midiStop());
+                    h.render(20);
+                    h.follower.setEnabled(false);
+                } },
+            { "host transport", [](Harness& h)
+                {
+                    h.hostPlaying = true;  h.render(200, false, true);
+                    h.ppq = 64.0;          h.render(40, false, true);   // relocate
+                    h.hostPlaying = false; h.render(40, false, true);
+                    for (auto& l : h.layers) l->setPlaying(true);
+                } },
+            { "parallel rendering", [](Harness& h)
+                {
+                    while (h.layers.size() < 40) h.loadSamples(h.addLayer(3 + (int)h.layers.size() % 9));
+                    h.engine.setRenderThreads(3, 8);
+                    h.render(400);
+                    h.engine.setRenderThreads(0);
+                    h.render(40);
+                } },
+            { "stop transport", [](Harness& h)
+                {
+                    for (auto& l : h.layers) l->setPlaying(false);
+                    h.metronome.setPlaying(false);
+                    h.render(40);
+                } },
+        };
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const juce::ScopedJuceInitialiser_GUI init;
+    const bool verbose = argc > 1 && juce::String(argv[1]) == "--verbose";
+
+    int failed = 0;
+    {
+        Harness h;
+        for (const auto& step : steps())
+        {
+            const int before = RtCheck::getViolationCount();
+            step.run(h);
+            const int found = RtCheck::getViolationCount() - before;
+            if (found > 0) ++failed;
+            if (verbose || found > 0)
+                std::cout << (found > 0 ? "FAIL " : "ok   ") << step.name
+                          << (found > 0 ? "  (" + juce::String(found) + " violations)" : juce::String()) << "\n";
+        }
+    }
+
+    std::cout << (failed == 0 ? "No real-time violations.\n"
+                              : juce::String(failed) + " step(s) allocated or locked on the audio thread.\n");
+    return failed == 0 ? 0 : 1;
+}
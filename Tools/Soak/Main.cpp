@@ -0,0 +1,301 @@
+#include <JuceHeader.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "LayerEngine.h"
+#include "TestSignals.h"
+
+#if JUCE_LINUX
+ #include <unistd.h>
+#elif JUCE_MAC
+ #include <sys/resource.h>
+#endif
+
+// =========== tribeat-soak ===========
+// Plays a pattern through LayerEngine for a day or more of simulated time,
+// as fast as it renders, and watches three things over time:
+//  - drift: every trigger of every layer (and the metronome) against its
+//    exact time on the ideal grid, step k at k * step length. A correct
+//    grid fires each step on the first sample at or after that time, so
+//    the difference stays within [0, 1) samples however long it runs;
+//  - memory: resident size, which must not grow after the first interval;
+//  - cost: mean and worst time per block, which must not creep up.
+// One line is printed per reporting interval (a simulated hour by default);
+// the exit code is 1 if any of the three is out of bounds. --events writes
+// every trigger (layer, step, sample, drift) to a text file.
+//
+//   cmake -B build -DTRIBEAT_BUILD_TOOLS=ON -DCMAKE_BUILD_TYPE=Release
+//   cmake --build build --target TriBeatSoak
+//   tribeat-soak [--hours 24] [--layers 3,4,5,7,11,64,m5] [--bpm 97.3] [--rate 48000] [--block 256]
+//                [--synth] [--report-minutes 60] [--events <file>]
+namespace
+{
+    struct Settings
+    {
+        double hours = 24.0, bpm = 97.3, rate = 48000.0, reportMinutes = 60.0;
+        int    block = 256, meter = 4;
+        bool   samples = true;
+        juce::String layers = "3,4,5,7,11,64,m5";   // n: polyrhythm with n sides, mN: polymeter in N
+        juce::String eventsFile;
+
+        // bounds
+        double driftTolerance = 0.01;   // samples outside [0, 1)
+        double maxGrowthMb = 4.0, maxCostGrowth = 1.5;
+    };
+
+    // One layer's (or the metronome's) triggers against the exact grid.
+    struct Track
+    {
+        juce::String name;
+        double stepLength = 1.0;     // samples, exact
+        juce::int64 steps = 0;
+        double minDrift = 0.0, maxDrift = 0.0;
+
+        struct Hit { juce::int64 step, sample; double drift; };
+        std::vector<Hit> pending;    // for --events, flushed after every block
+        bool keep = false;
+        juce::int64 dropped = 0;
+
+        void add(juce::int64 sample)
+        {
+            const double drift = (double)sample - (double)steps * stepLength;
+            if (steps == 0) minDrift = maxDrift = drift;
+            minDrift = juce::jmin(minDrift, drift);
+            maxDrift = juce::jmax(maxDrift, drift);
+            if (keep)
+            {
+                if (pending.size() < pending.capacity()) pending.push_back({ steps, sample, drift });
+                else                                     ++dropped;
+            }
+            ++steps;
+        }
+    };
+
+    // Takes the MIDI output's place in the engine, so it hears every
+    // trigger. While a source renders, its transport is the sample being
+    // rendered, which makes each trigger's absolute position exact whatever
+    // the block or chunk it falls in.
+    struct TriggerLog : MidiTriggerOutput
+    {
+        std::vector<Track>* tracks = nullptr;                 // layers, then the metronome
+        const std::vector<std::unique_ptr<ClickAudioSource>>* layers = nullptr;
+        const MetronomeSource* metronome = nullptr;
+
+        void trigger(int, int layer, Role, float) override
+        {
+            if (layer < 0) tracks->back().add(metronome->transportSamples);
+            else if (layer < (int)layers->size()) (*tracks)[(size_t)layer].add((*layers)[(size_t)layer]->getTransportSamples());
+        }
+    };
+
+    double residentMb()
+    {
+       #if JUCE_LINUX
+        long size = 0, resident = 0;
+        if (auto* f = std::fopen("/proc/self/statm", "r"))
+        {
+            if (std::fscanf(f, "%ld %ld", &size, &resident) != 2) resident = 0;
+            std::fclose(f);
+        }
+        return (double)resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+       #elif JUCE_MAC
+        rusage u {};
+        getrusage(RUSAGE_SELF, &u);
+        return (double)u.ru_maxrss / (1024.0 * 1024.0);   // peak, in bytes here
+       #else
+        return 0.0;   // not measured
+       #endif
+    }
+
+    bool parse(int argc, char* argv[], Settings& s)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const juce::String a(argv[i]);
+            const bool hasValue = i + 1 < argc;
+            if (a == "--synth")                               s.samples = false;
+            else if (a == "--hours" && hasValue)              s.hours = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--layers" && hasValue)             s.layers = argv[++i];
+            else if (a == "--bpm" && hasValue)                s.bpm = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--rate" && hasValue)               s.rate = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--block" && hasValue)              s.block = juce::String(argv[++i]).getIntValue();
+            else if (a == "--report-minutes" && hasValue)     s.reportMinutes = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--events" && hasValue)             s.eventsFile = argv[++i];
+            else return false;
+        }
+        return s.hours > 0.0 && s.bpm > 0.0 && s.rate > 0.0 && s.block > 0 && s.reportMinutes > 0.0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    if (!parse(argc, argv, settings))
+    {
+        std::cerr << "usage: tribeat-soak [--hours 24] [--layers 3,4,5,7,11,64,m5] [--bpm 97.3] [--rate 48000] [--block 256]\n"
+                     "                    [--synth] [--report-minutes 60] [--events <file>]\n";
+        return 2;
+    }
+    const juce::ScopedJuceInitialiser_GUI init;
+
+    std::FILE* events = nullptr;
+    if (settings.eventsFile.isNotEmpty() && (events = std::fopen(settings.eventsFile.toRawUTF8(), "w")) == nullptr)
+    {
+        std::cerr << "Can't write " << settings.eventsFile << "\n";
+        return 2;
+    }
+
+    const double samplesPerBeat = settings.rate * 60.0 / settings.bpm;
+    LayerEngine       engine;
+    MetronomeSource   metronome;
+    TriggerLog        log;
+    std::vector<std::unique_ptr<ClickAudioSource>> layers;
+    std::vector<Track> tracks;
+
+    engine.setMetronome(&metronome);
+    engine.setMidiOutput(&log);
+    metronome.setTempo(settings.bpm);
+    metronome.setBeatsPerBar(settings.meter);
+
+    SampleBuffer::Ptr kick, snare, hihat;
+    if (settings.samples)
+    {
+        kick = TestSignals::makeHit(settings.rate, 60.0, 0.3, 1);
+        snare = TestSignals::makeHit(settings.rate, 180.0, 0.2, 3);
+        hihat = TestSignals::makeHit(settings.rate, 6000.0, 0.05, 4);
+    }
+
+    for (auto spec : juce::StringArray::fromTokens(settings.layers, ",", ""))
+    {
+        spec = spec.trim();
+        const bool meter = spec.startsWithIgnoreCase("m");
+        const int  n = juce::jlimit(1, 64, (meter ? spec.substring(1) : spec).getIntValue());
+
+        auto src = std::make_unique<ClickAudioSource>();
+        src->setTempo(settings.bpm);
+        src->setPolyrhythm(!meter);
+        src->setHostBeatsPerBar(settings.meter);
+        if (meter) src->setBeatsPerBar(n);
+        else       src->setSubdivisions(n);
+        src->setDownbeatIndex(0);
+        src->setUpbeatIndex(n > 1 ? n / 2 : -1);
+        engine.addLayer(src.get());
+        if (settings.samples)
+        {
+            engine.setSample(src->kick, kick);
+            engine.setSample(src->snare, snare);
+            engine.setSample(src->hihat, hihat);
+        }
+
+        Track t;
+        t.name = (meter ? "meter " : "poly ") + juce::String(n);
+        t.stepLength = meter ? samplesPerBeat : samplesPerBeat * settings.meter / n;
+        tracks.push_back(t);
+        layers.push_back(std::move(src));
+    }
+    engine.prepareToPlay(settings.block, settings.rate);   // the layers above went live at once
+
+    Track click;
+    click.name = "metronome";
+    click.stepLength = samplesPerBeat;
+    tracks.push_back(click);
+
+    if (events != nullptr)
+    {
+        std::fprintf(events, "# track step sample drift\n");
+        for (auto& t : tracks) { t.keep = true; t.pending.reserve(4096); }
+    }
+
+    log.tracks = &tracks;
+    log.layers = &layers;
+    log.metronome = &metronome;
+    for (auto& l : layers) l->restart();
+    metronome.resetTransport();
+
+    // ===== run =====
+    const auto totalBlocks = (juce::int64)(settings.hours * 3600.0 * settings.rate / settings.block);
+    const auto blocksPerReport = juce::jmax<juce::int64>(1, (juce::int64)(settings.reportMinutes * 60.0 * settings.rate / settings.block));
+    const double blockNs = 1.0e9 * settings.block / settings.rate;
+
+    juce::AudioBuffer<float> device(2, settings.block);
+    const juce::AudioSourceChannelInfo info(&device, 0, settings.block);
+
+    double firstMeanNs = 0.0, lastMeanNs = 0.0, baseMb = 0.0, lastMb = 0.0;
+    double sumNs = 0.0, maxNs = 0.0;
+    juce::int64 inInterval = 0;
+    int intervals = 0;
+    const auto wallStart = std::chrono::steady_clock::now();
+
+    std::printf("%10s %12s %10s %10s %7s %9s %22s\n", "hours", "blocks", "mean us", "max us", "load %", "rss MB", "drift min/max (smp)");
+    for (juce::int64 b = 0; b < totalBlocks; ++b)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        engine.getNextAudioBlock(info);
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        sumNs += ns;
+        maxNs = juce::jmax(maxNs, ns);
+        ++inInterval;
+
+        if (events != nullptr)
+            for (auto& t : tracks)
+            {
+                for (const auto& h : t.pending)
+                    std::fprintf(events, "%s %lld %lld %.6f\n", t.name.toRawUTF8(), (long long)h.step, (long long)h.sample, h.drift);
+                t.pending.clear();
+            }
+
+        if (inInterval == blocksPerReport || b == totalBlocks - 1)
+        {
+            double minDrift = 0.0, maxDrift = 0.0;
+            for (const auto& t : tracks) { minDrift = juce::jmin(minDrift, t.minDrift); maxDrift = juce::jmax(maxDrift, t.maxDrift); }
+
+            const double meanNs = sumNs / (double)inInterval;
+            lastMb = residentMb();
+            if (intervals == 0) { firstMeanNs = meanNs; baseMb = lastMb; }
+            lastMeanNs = meanNs;
+            ++intervals;
+
+            std::printf("%10.2f %12lld %10.2f %10.2f %7.1f %9.1f %10.4f / %9.4f\n",
+                        (double)(b + 1) * settings.block / settings.rate / 3600.0, (long long)(b + 1),
+                        meanNs / 1000.0, maxNs / 1000.0, 100.0 * meanNs / blockNs, lastMb, minDrift, maxDrift);
+            std::fflush(stdout);
+            sumNs = maxNs = 0.0;
+            inInterval = 0;
+        }
+    }
+    if (events != nullptr) std::fclose(events);
+    engine.releaseResources();
+    for (auto& l : layers) engine.removeLayer(l.get());
+
+    // ===== verdict =====
+    const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    std::printf("\n%.1f simulated hours in %.0f s (%.0fx real time)\n", settings.hours, wallSec, settings.hours * 3600.0 / juce::jmax(1.0e-3, wallSec));
+
+    int failures = 0;
+    for (const auto& t : tracks)
+    {
+        const bool drifted = t.minDrift < -settings.driftTolerance || t.maxDrift > 1.0 + settings.driftTolerance;
+        std::printf("%-10s %12lld triggers, drift %.4f .. %.4f samples%s%s\n", t.name.toRawUTF8(), (long long)t.steps,
+                    t.minDrift, t.maxDrift, drifted ? "  DRIFT" : "",
+                    t.dropped > 0 ? ("  (" + juce::String(t.dropped) + " not logged)").toRawUTF8() : "");
+        if (drifted) ++failures;
+        if (t.steps == 0) { std::printf("%-10s never fired\n", t.name.toRawUTF8()); ++failures; }
+    }
+
+    if (intervals > 1 && lastMb - baseMb > settings.maxGrowthMb)
+    {
+        std::printf("memory grew by %.1f MB after the first interval\n", lastMb - baseMb);
+        ++failures;
+    }
+    if (intervals > 1 && lastMeanNs > firstMeanNs * settings.maxCostGrowth)
+    {
+        std::printf("mean block cost grew from %.2f to %.2f us\n", firstMeanNs / 1000.0, lastMeanNs / 1000.0);
+        ++failures;
+    }
+
+    if (failures == 0) std::printf("Stable.\n");
+    else               std::printf("%d problem(s).\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,547 @@
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "LayerEngine.h"
+#include "PitchCache.h"
+#include "TestSignals.h"
+
+// =========== tribeat-stress ===========
+// Runs the real LayerEngine on a simulated audio thread while a second
+// thread, standing in for the message thread, changes it the way
+// MainComponent does, thousands of times a second: sides (setSidesForActive),
+// accent edits (mouseDown), tempo drags, mode and mute toggles, play/stop,
+// adding and removing layers, gain/pan/routing, and sample loads. Loads go
+// through a PitchCache on a third thread and come back to the "message
+// thread" to be applied, like applySample's background jobs.
+// Meant to be built with a sanitizer (-DTRIBEAT_SANITIZE=thread or address),
+// which then reports any race or use-after-free the mutations cause; the
+// tool itself prints the callback time distribution, first without and then
+// under the mutation load, and how many blocks missed their deadline. The
+// callback never waits for a mutation: they reach it as changes posted to
+// the engine, or as atomics.
+//
+//   cmake -B build -DTRIBEAT_BUILD_TOOLS=ON -DTRIBEAT_SANITIZE=thread
+//   cmake --build build --target TriBeatStress
+//   tribeat-stress [--seconds 20] [--baseline 3] [--ops 5000] [--max-layers 12] [--rate 48000] [--block 256]
+//                  [--free-running] [--seed 1]
+namespace
+{
+    struct Settings
+    {
+        double seconds = 20.0, baseline = 3.0, rate = 48000.0;
+        int    opsPerSecond = 5000;     // 0: as fast as possible
+        int    block = 256, maxLayers = 12;
+        bool   paced = true;
+        juce::int64 seed = 1;
+    };
+
+    // ===== callback times =====
+    // Quarter-octave buckets from 0.25 us up; written by the audio thread
+    // only, read once it has stopped.
+    struct Histogram
+    {
+        static constexpr int numBuckets = 80;
+        static constexpr double firstNs = 250.0;
+
+        std::array<juce::int64, numBuckets> counts {};
+        juce::int64 total = 0, overDeadline = 0;
+        double sumNs = 0.0, maxNs = 0.0;
+
+        static double upperNs(int b) { return firstNs * std::pow(2.0, (b + 1) / 4.0); }
+
+        void add(double ns, double deadlineNs)
+        {
+            const int b = ns <= firstNs ? 0 : juce::jlimit(0, numBuckets - 1, (int)(4.0 * std::log2(ns / firstNs)));
+            ++counts[(size_t)b];
+            ++total;
+            sumNs += ns;
+            maxNs = juce::jmax(maxNs, ns);
+            if (ns > deadlineNs) ++overDeadline;
+        }
+
+        double percentileNs(double p) const
+        {
+            const auto want = (juce::int64)std::ceil(p * (double)total);
+            juce::int64 seen = 0;
+            for (int b = 0; b < numBuckets; ++b)
+                if ((seen += counts[(size_t)b]) >= want)
+                    return juce::jmin(upperNs(b), maxNs);
+            return maxNs;
+        }
+
+        void print(const char* title, double deadlineNs) const
+        {
+            std::printf("\n%s: %lld callbacks\n", title, (long long)total);
+            if (total == 0) return;
+            std::printf("  mean %.2f us, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f us\n",
+                        sumNs / (double)total / 1000.0, percentileNs(0.5) / 1000.0, percentileNs(0.9) / 1000.0,
+                        percentileNs(0.99) / 1000.0, percentileNs(0.999) / 1000.0, maxNs / 1000.0);
+            std::printf("  %lld over the %.0f us block period (%.4f%%)\n", (long long)overDeadline,
+                        deadlineNs / 1000.0, 100.0 * (double)overDeadline / (double)total);
+
+            const auto peak = *std::max_element(counts.begin(), counts.end());
+            for (int b = 0; b < numBuckets; ++b)
+            {
+                if (counts[(size_t)b] == 0) continue;
+                const int bar = (int)std::ceil(50.0 * (double)counts[(size_t)b] / (double)peak);
+                std::printf("  <= %10.2f us %10lld  %s\n", upperNs(b) / 1000.0, (long long)counts[(size_t)b],
+                            juce::String::repeatedString("#", bar).toRawUTF8());
+            }
+        }
+    };
+
+    // ===== audio thread =====
+    // Pulls blocks from the engine like a device callback, paced by the clock
+    // or back to back. Times each one into the histogram of the current phase.
+    class AudioThread : public juce::Thread
+    {
+    public:
+        AudioThread(LayerEngine& e, const Settings& s)
+            : juce::Thread("Stress audio"), engine(e), settings(s), device(4, s.block) {}
+
+        std::array<Histogram, 2> phases;     // before and under mutations
+        std::atomic<int> phase{ 0 };
+
+        void run() override
+        {
+            const juce::AudioSourceChannelInfo info(&device, 0, settings.block);
+            const double periodMs = 1000.0 * settings.block / settings.rate;
+            const double deadlineNs = periodMs * 1.0e6;
+            double due = juce::Time::getMillisecondCounterHiRes();
+
+            while (!threadShouldExit())
+            {
+                if (settings.paced)
+                {
+                    for (double left = due - juce::Time::getMillisecondCounterHiRes(); left > 0.0 && !threadShouldExit();
+                         left = due - juce::Time::getMillisecondCounterHiRes())
+                    {
+                        if (left > 2.0) juce::Thread::sleep((int)(left - 1.0));
+                        else            juce::Thread::yield();
+                    }
+                }
+
+                const auto t0 = std::chrono::steady_clock::now();
+                engine.getNextAudioBlock(info);
+                const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+                phases[(size_t)phase.load(std::memory_order_relaxed)].add(ns, deadlineNs);
+
+                if (settings.paced)
+                {
+                    due += periodMs;
+                    due = juce::jmax(due, juce::Time::getMillisecondCounterHiRes());   // no catching up after a dropout
+                }
+            }
+        }
+
+    private:
+        LayerEngine& engine;
+        const Settings& settings;
+        juce::AudioBuffer<float> device;
+    };
+
+    // ===== sample loads =====
+    // The background half of applySample: renders the repitched copy, then
+    // hands it back to the message thread.
+    struct LoadRequest
+    {
+        int layerId = 0, role = 0, request = 0;
+        SampleBuffer::Ptr original, data;
+        double semitones = 0.0;
+    };
+
+    class LoaderThread : public juce::Thread
+    {
+    public:
+        explicit LoaderThread(PitchCache& c) : juce::Thread("Stress loader"), cache(c) {}
+
+        void post(LoadRequest r)
+        {
+            { const juce::ScopedLock sl(lock); todo.push_back(std::move(r)); }
+            wake.signal();
+        }
+
+        std::vector<LoadRequest> takeDone()
+        {
+            const juce::ScopedLock sl(lock);
+            return std::exchange(done, {});
+        }
+
+        void run() override
+        {
+            while (!threadShouldExit())
+            {
+                std::vector<LoadRequest> batch;
+                { const juce::ScopedLock sl(lock); std::swap(batch, todo); }
+                if (batch.empty()) { wake.wait(20); continue; }
+
+                for (auto& r : batch)
+                    r.data = cache.get(r.original, r.semitones);
+
+                const juce::ScopedLock sl(lock);
+                for (auto& r : batch) done.push_back(std::move(r));
+            }
+        }
+
+    private:
+        PitchCache& cache;
+        juce::CriticalSection lock;
+        juce::WaitableEvent wake;
+        std::vector<LoadRequest> todo, done;
+    };
+
+    // ===== message thread =====
+    // The parts of MainComponent that touch the engine, the same way: shape,
+    // accents, tempo, mode and transport are posted to the engine as
+    // changes, as are add/remove and sample swaps; routing, level, pan, tones
+    // and the subdivision mute are set directly. Removed layers are freed
+    // once the engine is done with them.
+    class MutatorThread : public juce::Thread
+    {
+    public:
+        enum Op { sides, accent, tempo, mode, mute, transport, addLayer, removeLayer, mix, note, sample, numOps };
+
+        static const char* opName(int op)
+        {
+            static const char* names[] = { "sides", "accent", "tempo", "mode", "mute subdivisions", "play/stop",
+                                           "add layer", "remove layer", "gain/pan/routing", "note", "sample load" };
+            return names[op];
+        }
+
+        MutatorThread(LayerEngine& e, MetronomeSource& m, PitchCache& c, LoaderThread& l,
+                      const std::vector<SampleBuffer::Ptr>& s, const Settings& st)
+            : juce::Thread("Stress message thread"), engine(e), metronome(m), cache(c), loader(l),
+              samples(s), settings(st), random(st.seed) {}
+
+        ~MutatorThread() override
+        {
+            stopThread(5000);
+            for (auto& l : layers) engine.removeLayer(l.src.get());
+        }
+
+        // Before the thread starts: the session the app opens with.
+        void addInitialLayers(int n) { for (int i = 0; i < n; ++i) doAddLayer(); }
+
+        std::array<juce::int64, numOps> counts {};
+        juce::int64 appliedLoads = 0, staleLoads = 0;
+
+        void run() override
+        {
+            const auto start = std::chrono::steady_clock::now();
+            juce::int64 total = 0;
+
+            while (!threadShouldExit())
+            {
+                applyFinishedLoads();
+                if (!retired.empty() && engine.isFadeIdle()) retired.clear();
+
+                const int op = random.nextInt(numOps);
+                perform(op);
+                ++counts[(size_t)op];
+                ++total;
+
+                if (settings.opsPerSecond > 0)
+                {
+                    const double due = (double)total / settings.opsPerSecond;
+                    const double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    if (due - now > 0.001) juce::Thread::sleep((int)((due - now) * 1000.0));
+                }
+            }
+        }
+
+    private:
+        struct Layer
+        {
+            std::unique_ptr<ClickAudioSource> src;
+            int id = 0, sides = 4;
+        };
+
+        void perform(int op)
+        {
+            auto& L = layers[(size_t)random.nextInt((int)layers.size())];
+            auto* a = L.src.get();
+
+            switch (op)
+            {
+                case sides:     // setSidesForActive
+                {
+                    const int n = 1 + random.nextInt(64);
+                    const int up = n > 1 ? random.nextInt(n) : -1, down = random.nextInt(n);
+                    L.sides = n;
+                    engine.post([a, n, up, down, poly = isPoly]
+                        {
+                            a->setUpbeatIndex(up);
+                            a->setDownbeatIndex(down);
+                            if (poly) a->setSubdivisions(n);
+                            else      a->setBeatsPerBar(n);
+                            if (a->isPlaying()) a->restart();
+                        });
+                    break;
+                }
+                case accent:    // mouseDown on a vertex
+                {
+                    const bool down = random.nextBool();
+                    const int vertex = random.nextInt(L.sides);
+                    engine.post([a, down, vertex]
+                        {
+                            if (down) a->setDownbeatIndex(vertex);
+                            else      a->setUpbeatIndex(vertex);
+                        });
+                    break;
+                }
+                case tempo:     // bpmSlider drag
+                {
+                    const double b = bpm = 30.0 + random.nextDouble() * 270.0;
+                    engine.post([this, b]
+                        {
+                            metronome.setTempo(b);
+                            engine.forEachLayer([b](ClickAudioSource& v) { v.setTempo(b); });
+                        });
+                    break;
+                }
+                case mode:      // modeToggle
+                {
+                    isPoly = !isPoly;
+                    for (auto& l : layers)
+                        engine.post([src = l.src.get(), n = l.sides, poly = isPoly]
+                            {
+                                src->setPolyrhythm(poly);
+                                if (poly) src->setSubdivisions(n);
+                                else      src->setBeatsPerBar(n);
+                            });
+                    break;
+                }
+                case mute:      // muteSubsToggle
+                {
+                    const bool m = random.nextBool();
+                    for (auto& l : layers) l.src->setMuteSubdivisions(m);
+                    break;
+                }
+                case transport: // play / stop
+                {
+                    const bool play = random.nextInt(4) != 0;
+                    engine.post([this, play]
+                        {
+                            metronome.resetTransport();
+                            metronome.setPlaying(play);
+                            engine.forEachLayer([play](ClickAudioSource& v)
+                                {
+                                    v.setPlaying(play);
+                                    v.restart();
+                                });
+                        });
+                    break;
+                }
+                case addLayer:
+                    if ((int)layers.size() < settings.maxLayers) doAddLayer();
+                    break;
+                case removeLayer:   // removeActiveLayer
+                    if (layers.size() > 1)
+                    {
+                        const auto it = layers.begin() + random.nextInt((int)layers.size());
+                        engine.removeLayer(it->src.get());
+                        retired.push_back(std::move(it->src));
+                        layers.erase(it);
+                    }
+                    break;
+                case mix:       // outputBox, gainSlider, panSlider
+                {
+                    a->outChannel = random.nextInt(4);
+                    a->outWidth = random.nextBool() ? 1 : 2;
+                    a->outGain = random.nextFloat();
+                    a->outPan = random.nextFloat() * 2.0f - 1.0f;
+                    break;
+                }
+                case note:      // up/down note boxes, then the accent sample follows
+                {
+                    const int role = random.nextInt(2);
+                    const double hz = 440.0 * std::pow(2.0, (random.nextInt(25) - 12) / 12.0);
+                    if (role == 0) a->setUpbeatFreqHz(hz);
+                    else           a->setDownbeatFreqHz(hz);
+                    applySample(L, role, a->getOneShot(role).source);
+                    break;
+                }
+                case sample:    // a file dropped on a role, or cleared
+                {
+                    const int pick = random.nextInt((int)samples.size() + 1);
+                    applySample(L, random.nextInt(3), pick < (int)samples.size() ? samples[(size_t)pick] : nullptr);
+                    break;
+                }
+                default: break;
+            }
+        }
+
+        void doAddLayer()
+        {
+            Layer L;
+            L.id = ++lastId;
+            L.sides = 1 + random.nextInt(16);
+            L.src = std::make_unique<ClickAudioSource>();
+
+            auto* src = L.src.get();
+            src->setUpbeatFreqHz(440.0);
+            src->setDownbeatFreqHz(220.0);
+            src->setTempo(bpm);
+            src->setPolyrhythm(isPoly);
+            if (isPoly) src->setSubdivisions(L.sides);
+            else        src->setBeatsPerBar(L.sides);
+            src->setHostBeatsPerBar(4);
+            engine.addLayer(src, layers.empty() ? nullptr : layers[0].src.get());   // on the running grid
+            layers.push_back(std::move(L));
+        }
+
+        // MainComponent::applySample: cached copies are swapped in at once,
+        // others rendered on the loader; a later request for the same slot
+        // supersedes an earlier one.
+        void applySample(Layer& L, int role, SampleBuffer::Ptr original)
+        {
+            const int request = ++requests[{ L.id, role }];
+            const double semis = L.src->getSampleSemitones(role);
+            auto& shot = L.src->getOneShot(role);
+
+            if (original == nullptr) { engine.setSample(shot, nullptr); return; }
+            if (auto data = cache.get(original, semis, false))
+            {
+                engine.setSample(shot, std::move(data), std::move(original));
+                return;
+            }
+            LoadRequest r;
+            r.layerId = L.id;
+            r.role = role;
+            r.request = request;
+            r.original = std::move(original);
+            r.semitones = semis;
+            loader.post(std::move(r));
+        }
+
+        void applyFinishedLoads()
+        {
+            for (auto& r : loader.takeDone())
+            {
+                const auto it = std::find_if(layers.begin(), layers.end(), [&r](const Layer& l) { return l.id == r.layerId; });
+                if (it == layers.end() || requests[{ r.layerId, r.role }] != r.request) { ++staleLoads; continue; }
+                engine.setSample(it->src->getOneShot(r.role), r.data, r.original);
+                ++appliedLoads;
+            }
+        }
+
+        LayerEngine&     engine;
+        MetronomeSource& metronome;
+        PitchCache&      cache;
+        LoaderThread&    loader;
+        const std::vector<SampleBuffer::Ptr>& samples;
+        const Settings&  settings;
+
+        juce::Random       random;
+        std::vector<Layer> layers;
+        std::vector<std::unique_ptr<ClickAudioSource>> retired;   // removed, until the engine is done with them
+        std::map<std::pair<int, int>, int> requests;
+        int    lastId = 0;
+        bool   isPoly = true;
+        double bpm = 120.0;
+    };
+
+    bool parse(int argc, char* argv[], Settings& s)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const juce::String a(argv[i]);
+            const bool hasValue = i + 1 < argc;
+            if (a == "--free-running")                    s.paced = false;
+            else if (a == "--seconds" && hasValue)        s.seconds = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--baseline" && hasValue)       s.baseline = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--ops" && hasValue)            s.opsPerSecond = juce::String(argv[++i]).getIntValue();
+            else if (a == "--max-layers" && hasValue)     s.maxLayers = juce::String(argv[++i]).getIntValue();
+            else if (a == "--rate" && hasValue)           s.rate = juce::String(argv[++i]).getDoubleValue();
+            else if (a == "--block" && hasValue)          s.block = juce::String(argv[++i]).getIntValue();
+            else if (a == "--seed" && hasValue)           s.seed = juce::String(argv[++i]).getLargeIntValue();
+            else return false;
+        }
+        return s.seconds > 0.0 && s.baseline >= 0.0 && s.opsPerSecond >= 0 && s.maxLayers >= 1
+            && s.rate > 0.0 && s.block > 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    if (!parse(argc, argv, settings))
+    {
+        std::cerr << "usage: tribeat-stress [--seconds 20] [--baseline 3] [--ops 5000] [--max-layers 12] [--rate 48000] [--block 256]\n"
+                     "                      [--free-running] [--seed 1]\n";
+        return 2;
+    }
+    const juce::ScopedJuceInitialiser_GUI init;
+
+    LayerEngine     engine;
+    MetronomeSource metronome;
+    PitchCache      pitchCache;
+
+    engine.setMetronome(&metronome);
+    engine.prepareToPlay(settings.block, settings.rate);
+    metronome.setTempo(120.0);
+    metronome.setPlaying(true);
+
+    const std::vector<SampleBuffer::Ptr> samples{ TestSignals::makeHit(settings.rate, 60.0, 0.3, 1),
+                                                  TestSignals::makeHit(settings.rate, 180.0, 0.2, 3),
+                                                  TestSignals::makeHit(settings.rate, 6000.0, 0.05, 4) };
+
+    const double deadlineNs = 1.0e9 * settings.block / settings.rate;
+    int failures = 0;
+    {
+        LoaderThread  loader(pitchCache);
+        MutatorThread mutator(engine, metronome, pitchCache, loader, samples, settings);
+        AudioThread   audio(engine, settings);
+        mutator.addInitialLayers(juce::jmin(3, settings.maxLayers));
+
+        std::printf("%s audio thread, %d-sample blocks at %.0f Hz; %.1f s baseline, then %.1f s at %s\n",
+                    settings.paced ? "paced" : "free-running", settings.block, settings.rate, settings.baseline, settings.seconds,
+                    settings.opsPerSecond > 0 ? (juce::String(settings.opsPerSecond) + " ops/s").toRawUTF8() : "full speed");
+        std::fflush(stdout);
+
+        audio.startThread(juce::Thread::Priority::highest);
+        juce::Thread::sleep((int)(settings.baseline * 1000.0));
+
+        audio.phase.store(1);
+        loader.startThread();
+        mutator.startThread();
+        juce::Thread::sleep((int)(settings.seconds * 1000.0));
+
+        mutator.stopThread(5000);
+        loader.stopThread(5000);
+        audio.stopThread(5000);
+        engine.releaseResources();   // the device stops; what is still queued runs now
+
+        audio.phases[0].print("Without mutations", deadlineNs);
+        audio.phases[1].print("Under mutations", deadlineNs);
+
+        juce::int64 total = 0;
+        std::printf("\nMutations:\n");
+        for (int op = 0; op < MutatorThread::numOps; ++op)
+        {
+            std::printf("  %-18s %10lld\n", MutatorThread::opName(op), (long long)mutator.counts[(size_t)op]);
+            total += mutator.counts[(size_t)op];
+        }
+        std::printf("  %lld in all (%.0f/s); %lld background sample loads applied, %lld superseded\n", (long long)total,
+                    (double)total / settings.seconds, (long long)mutator.appliedLoads, (long long)mutator.staleLoads);
+
+        if (audio.phases[1].total == 0) { std::printf("The audio thread rendered nothing under load.\n"); ++failures; }
+        if (total == 0)                 { std::printf("No mutations were made.\n"); ++failures; }
+    }
+
+    engine.setMetronome(nullptr);
+    if (!engine.isFadeIdle()) { std::printf("Faded-out voices are still referenced.\n"); ++failures; }
+
+    // Races and memory errors are the sanitizer's to report (and set the exit code).
+    if (failures == 0) std::printf("Done.\n");
+    return failures == 0 ? 0 : 1;
+}